@@ -4,21 +4,30 @@
  *           distribution of the vectors.  This version also
  *           illustrates the use of MPI_Scatter and MPI_Gather.
  *
- * Compile:  mpicc -g -Wall -o mpi_vector_add mpi_vector_add.c
- * Run:      mpiexec -n <comm_sz> ./vector_add
+ * Compile:  mpicc -g -Wall -o mpi_vector_add mpi_vector_add.c -lm
+ *           (add -fopenmp to split each process' block among
+ *           OMP_NUM_THREADS threads)
+ * Run:      mpiexec -n <comm_sz> ./vector_add [options]
  *
- * Input:    The order of the vectors, n, and the vectors x and y
+ *           --help lists the options (see Usage), and README.md
+ *           describes them and the compile time flags.
+ *
+ * Input:    The order of the vectors, n, the limit for the random
+ *           numbers, and the scalar, from the options or, on process
+ *           0, from stdin
  * Output:   The sum vector z = x+y
  *
  * Notes:
- * 1.  The order of the vectors, n, should be evenly divisible
- *     by comm_sz
+ * 1.  The order of the vectors, n, doesn't need to be evenly
+ *     divisible by comm_sz: the first n % comm_sz processes get one
+ *     more element than the others.
  * 2.  DEBUG compile flag.
  * 3.  This program does fairly extensive error checking.  When
  *     an error is detected, a message is printed and the processes
  *     quit.  Errors detected are incorrect values of the vector
- *     order (negative or not evenly divisible by comm_sz), and
- *     malloc failures.
+ *     order (negative), bad options, and malloc failures.  Failures
+ *     are recorded locally and checked with a single reduction at the
+ *     end of a phase (see Record_error and Check_errors).
  *
  * IPP:  Section 3.4.6 (pp. 109 and ff.)
  */
@@ -26,407 +35,8388 @@
 #include <stdlib.h>
 #include <mpi.h>
 #include <time.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <errno.h>
+#ifdef _OPENMP
+#  include <omp.h>
+#endif
+#ifdef __linux__
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  include <linux/mempolicy.h>
+#  include <linux/perf_event.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#elif defined(__aarch64__)
+#  include <arm_neon.h>
+#endif
+#include "vec_rng.h"
+#include "vec_lib.h"
+
+/* Everything but main, the Vec_ctx_* functions (declared in vec_lib.h)
+ * and the MPI_* profiling hooks is static, so the library objects of
+ * this file and of vector_add2.c can be linked into one program.  Without main most of
+ * it is never called, which isn't worth a warning. */
+#if defined(VEC_LIBRARY) && defined(__GNUC__)
+#  pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+
+/* Elements printed at each end of a vector by PrintTopDown_vector */
+#define PREVIEW_LEN 10
+#define PREVIEW_MAX (2*PREVIEW_LEN)
+
+/* Largest count passed to a single MPI call; bigger blocks are sent
+ * in pieces */
+#ifndef MAX_COUNT
+#  define MAX_COUNT ((size_t) 1 << 30)
+#endif
+
+/* Alignment of the local vectors: a cache line, or a huge page when
+ * compiled with -DHUGE_PAGES */
+#ifdef HUGE_PAGES
+#  define VEC_ALIGN ((size_t) 2 << 20)
+#else
+#  define VEC_ALIGN ((size_t) 64)
+#endif
+#define PAGE_ELEMS (4096/sizeof(elem_t))
+
+/* MPI datatype matching size_t */
+#if SIZE_MAX == UINT64_MAX
+#  define MPI_SIZE_T MPI_UINT64_T
+#else
+#  define MPI_SIZE_T MPI_UINT32_T
+#endif
+
+/* Operations selected with --ops */
+#define OP_PRINT 1
+#define OP_SCALE 2
+#define OP_DOT   4
+#define OP_ALL   (OP_PRINT | OP_SCALE | OP_DOT)
+/* BLAS-1 operations, not part of "all":  add, axpy and mul write z,
+ * norm and max reduce x, y and z (see Parallel_blas1) */
+#define OP_ADD   8
+#define OP_AXPY  16
+#define OP_MUL   32
+#define OP_NORM  64
+#define OP_MAX   128
+#define OP_Z     (OP_ADD | OP_AXPY | OP_MUL)
+#define OP_BLAS  (OP_Z | OP_NORM | OP_MAX)
+/* Run the --expr program instead of scale, dot and the BLAS-1 ops */
+#define OP_EXPR  256
+
+/* Ways of generating x and y (--gen) */
+#define GEN_LOCAL    0
+#define GEN_SCATTER  1
+#define GEN_PIPELINE 2
+
+/* Default elements per message of the pipelined scatter (--chunk), and
+ * the number of sends process 0 keeps in flight */
+#define PIPE_CHUNK ((size_t) 1 << 16)
+#define PIPE_DEPTH 32
+
+/* Elements of x and y summed as one block by the pairwise mode, and
+ * by the binned mode, whose blocks are split again (from L2) when they
+ * raise the top.  comp sums each thread's block in one go. */
+#define SUM_BLOCK 1024
+#define BIN_BLOCK 4096
+
+/* Products each running sum of the comp kernels adds with FMAs before
+ * the sum goes into a (sum, error) pair */
+#define COMP_RUN 8
+
+/* A binned sum (--sum binned) keeps BIN_FOLDS folds of BIN_WIDTH bits
+ * below a top that follows the largest product, see "Binned sums"
+ * below.  It takes BIN_PARTS doubles. */
+#define BIN_FOLDS   3
+#define BIN_WIDTH   32
+#define BIN_LANES   8
+#define BIN_PARTS   (1 + 2*BIN_FOLDS)
+#define BIN_MIN_TOP (-29*BIN_WIDTH)
+#if BIN_PARTS != VEC_PARTS
+#  error "VEC_PARTS in vec_lib.h has to be BIN_PARTS"
+#endif
+
+/* The comp and binned kernels need every product rounded before it's
+ * added, so GCC mustn't contract them into FMAs */
+#if defined(__GNUC__) && !defined(__clang__)
+#  define NO_CONTRACT __attribute__((optimize("fp-contract=off")))
+#else
+#  define NO_CONTRACT
+#endif
+
+/* Bytes before the elements of a vector file */
+#define VEC_HEADER ((MPI_Offset) sizeof(Vec_header_t))
+
+/* Bits of Params_t.have:  values that were given, so process 0
+ * doesn't prompt for them */
+#define HAVE_N       1
+#define HAVE_RANDMAX 2
+#define HAVE_SCALAR  4
+#define HAVE_SEED    8
+
+/* Benchmark report formats (--format) */
+#define FORMAT_TEXT 0
+#define FORMAT_CSV  1
+#define FORMAT_JSON 2
+
+/* Phases timed in benchmark mode */
+#define PH_TRIAD     0
+#define PH_GEN       1
+#define PH_SCATTER   2
+#define PH_PIPELINE  3
+#define PH_SCALE     4
+#define PH_DOT       5
+#define PH_SCALE_DOT 6
+#define PH_REDUCE    7
+#define PH_GATHER    8
+#define NUM_PHASES   9
+static char* phase_names[NUM_PHASES] = {"triad", "gen", "scatter", "pipeline",
+   "scale", "dot", "scale_dot", "reduce", "gather"};
+/* Phases counted as communication in a scaling study.  The triad is
+ * only a reference, so it isn't counted at all. */
+static int phase_is_comm[NUM_PHASES] = {-1, 0, 1, 1, 0, 0, 0, 1, 1};
+
+/* Vector expressions (--expr).  Expr_compile turns the text into
+ * postfix code for a small stack machine, and Run_expr runs the whole
+ * program on one EXPR_TILE-element tile of the blocks at a time. */
+#define EXPR_TILE   512
+#define EXPR_CODE   64
+#define EXPR_STACK  8
+#define EXPR_STMTS  8
+#define EXPR_LABEL  48
+
+/* Operations of the expression code */
+#define EX_VEC    0   /* push x, y or z */
+#define EX_CONST  1   /* push a number */
+#define EX_SCALAR 2   /* push the --scalar */
+#define EX_ADD    3
+#define EX_SUB    4
+#define EX_MUL    5
+#define EX_NEG    6
+#define EX_STORE  7   /* pop into x, y or z */
+#define EX_DOT    8   /* pop two values, add their dot product to a result */
+#define EX_SUM    9   /* pop one value, add its sum to a result */
+
+typedef struct {
+   int     op;
+   int     arg;     /* vector (0, 1, 2 for x, y, z) or result index */
+   double  value;   /* number of EX_CONST */
+} Expr_code_t;
+
+/* A compiled --expr.  Statement k is either a store into vector
+ * stmt_arg[k] or a reduction into result stmt_arg[k], and label[k] is
+ * its text. */
+typedef struct {
+   Expr_code_t  code[EXPR_CODE];
+   int          len;
+   int          num_stmts;
+   int          stmt_op[EXPR_STMTS];
+   int          stmt_arg[EXPR_STMTS];
+   char         label[EXPR_STMTS][EXPR_LABEL];
+   int          num_results;
+   int          scalar;   /* nonzero if s is used */
+   int          reads;    /* bit v set if vector v is read */
+   int          writes;   /* bit v set if vector v is written */
+} Expr_t;
+
+/* State of the --expr parser, and a value on the stack of Expr_tile:
+ * a tile t, or the number c if t is NULL */
+typedef struct {
+   char*    p;
+   Expr_t*  prog;
+   int      depth;
+   char*    error;
+} Expr_parser_t;
+
+typedef struct {
+   double*  t;
+   double   c;
+} Expr_val_t;
+
+/* Scaling studies (--sweep) */
+#define SWEEP_NONE   0
+#define SWEEP_STRONG 1
+#define SWEEP_WEAK   2
+#define MAX_SWEEP    32
+
+/* Regression runs (--regress, see Regress):  a result passes within
+ * REGRESS_ULPS ulps of the serial one (plus a forward error bound for
+ * the sum modes that aren't exact, see Print_regress_row), every timed
+ * sample runs the dot for at least REGRESS_MIN_TIME seconds, in at
+ * most REGRESS_MAX_CALLS calls, and a run's rates are kept to compare
+ * with the baseline. */
+#define REGRESS_ULPS      4
+#define REGRESS_MIN_TIME  0.02
+#define REGRESS_MAX_CALLS 1000
+typedef struct {
+   long long n;
+   int       procs;
+   double    gb_s;
+   double    speedup;
+} Regress_row_t;
+
+/* Run parameters.  Process 0 fills them in from the config file, the
+ * environment, the command line and stdin, and broadcasts them in a
+ * single MPI_Bcast. */
+typedef struct {
+   long long n;
+   int       randmax;
+   int       scalar;
+   uint64_t  seed;
+   int       rng;
+   int       ops;
+   int       threads;
+   int       gen;
+   int       unfused;
+   int       sum;
+   int       reduce;
+   int       hier;
+   int       shm;
+   int       offload;
+   long long chunk;
+   long long tile;
+   long long batch;
+   char      expr[256];
+   char      trace[256];
+   Expr_t    prog;
+   char      xin[256];
+   char      yin[256];
+   char      xout[256];
+   char      yout[256];
+   int       reps;
+   int       warmup;
+   int       format;
+   int       sweep;
+   int       num_sizes;
+   long long sizes[MAX_SWEEP];
+   int       num_procs;
+   int       procs[MAX_SWEEP];
+   char      regress[256];
+   double    margin;
+   char      serial[256];
+   char      checkpoint[256];
+   char      restart[256];
+   int       ckpt_stage;
+   int       ckpt_slot;
+   double    ckpt_result;
+   int       help;
+   int       have;
+   char      error[128];
+} Params_t;
+
+/* A dot product reduction started with Start_dot_reduce.  The datatype
+ * and op have to live until Wait_dot_reduce, and total gets the
+ * reduced parts of the --sum mode sum. */
+typedef struct {
+   int           sum;
+   MPI_Request   req;
+   MPI_Datatype  type;
+   MPI_Op        op;
+   double        total[BIN_PARTS];
+} Dot_reduce_t;
+
+/* Results of Parallel_blas1 for x, y and z (indices 0, 1 and 2):  the
+ * 2-norms, and the largest and smallest elements with the global index
+ * of their first occurrence. */
+typedef struct {
+   double  nrm2[3];
+   double  max[3];
+   double  min[3];
+   size_t  imax[3];
+   size_t  imin[3];
+} Blas1_t;
+
+/* Hierarchical reduction (--hier, see Hier_init):  the processes of
+ * comm on each node share a window with two sets of node_sz + 1 slots
+ * of cap doubles, a slot for each process and one for the result, and
+ * the node leaders (node_rank 0) have a communicator of their own. */
+typedef struct {
+   int       active;
+   MPI_Comm  comm;
+   MPI_Comm  node;
+   MPI_Comm  leaders;
+   int       node_rank;
+   int       node_sz;
+   MPI_Win   win;
+   double*   base;
+   size_t    cap;
+   int       parity;
+} Hier_t;
+
+/* Vectors in node shared memory (--shm, see Allocate_shared_vector):
+ * each vector is an MPI_Win_allocate_shared window over the processes
+ * of a node, and node_of gives the rank in node of each process of
+ * comm (MPI_UNDEFINED for the processes on other nodes). */
+#define SHM_VECS 4
+typedef struct {
+   int       active;
+   MPI_Comm  comm;
+   MPI_Comm  node;
+   int*      node_of;
+   int       num_vecs;
+   elem_t*   vec[SHM_VECS];
+   MPI_Win   win[SHM_VECS];
+} Shm_t;
+
+/* Counts and displacements of the blocks of MPI_Scatterv (--gen
+ * scatter, see Scatter_remote), only allocated on process 0. */
+typedef struct {
+   int*  counts;
+   int*  displs;
+} Scatter_t;
+
+/* Tracing (--trace, see Trace_init):  a ring buffer of the last
+ * TRACE_EVENTS phases and MPI calls of the process, with times in
+ * seconds since Trace_init and cycles -1 if there's no counter. */
+#define TRACE_EVENTS 4096
+#define TRACE_NAME   24
+#define TRACE_NAMES  64
+#define TRACE_PHASE  0
+#define TRACE_MPI    1
+typedef struct {
+   char       name[TRACE_NAME];
+   int        cat;
+   double     start;
+   double     dur;
+   long long  bytes;
+   long long  cycles;
+} Trace_event_t;
 
-void Check_for_error(int local_ok, char fname[], char message[],
+typedef struct {
+   double     t;
+   long long  cycles;
+} Trace_mark_t;
+
+typedef struct {
+   int            on;
+   int            fd;
+   double         t0;
+   long long      total;
+   Trace_event_t  events[TRACE_EVENTS];
+} Trace_t;
+
+/* Checkpoints (--checkpoint, see Ckpt_save):  the stages after which
+ * x and y are saved, and the state of the one being written.  Slots 0
+ * and 1 are used in turn, so the last complete one is never
+ * overwritten. */
+#define CKPT_GENERATED 1
+#define CKPT_SCALED    2
+#define CKPT_DOT       3
+#define CKPT_NAME      300
+#define CKPT_MAGIC     "VECCKPT1"
+typedef struct {
+   int           active;
+   char*         prefix;
+   int           slot;
+   size_t        local_n;
+   size_t        local_first;
+   size_t        n;
+   MPI_Comm      comm;
+   elem_t*       buf;
+   MPI_File      fh[2];
+   MPI_Request*  reqs;
+   int           num_reqs;
+   int           used_reqs;
+   int           pending;
+   int           stage;
+   double        result;
+} Ckpt_t;
+
+/* Options of a run that don't go together (see Check_conflicts).
+ * Use_bits sets a USE_ bit for each option or mode a run has, and a
+ * run is refused by the first row of conflicts whose option and one
+ * of whose conflicting options it has.  A new option that can't be
+ * combined with some others gets a bit and a row. */
+#define USE_BENCH     (1 << 0)    /* --bench */
+#define USE_SWEEP     (1 << 1)    /* --sweep */
+#define USE_GEN       (1 << 2)    /* --gen scatter or pipeline */
+#define USE_PIPELINE  (1 << 3)    /* --gen pipeline */
+#define USE_TILE      (1 << 4)    /* --tile */
+#define USE_BATCH     (1 << 5)    /* --batch K, K > 1 */
+#define USE_FILES     (1 << 6)    /* --xin, --yin, --xout or --yout */
+#define USE_XYIN      (1 << 7)    /* --xin or --yin */
+#define USE_BLAS      (1 << 8)    /* add, axpy, mul, norm or max */
+#define USE_NORM_MAX  (1 << 9)    /* norm or max */
+#define USE_EXPR      (1 << 10)   /* --expr */
+#define USE_HIER      (1 << 11)   /* --hier */
+#define USE_IALL      (1 << 12)   /* --reduce iallreduce */
+#define USE_SHM       (1 << 13)   /* --shm */
+#define USE_OFFLOAD   (1 << 14)   /* --offload */
+#define USE_NO_OPENMP (1 << 15)   /* a build without -fopenmp */
+#define USE_SUM       (1 << 16)   /* --sum other than naive */
+#define USE_RNG       (1 << 17)   /* --rng other than splitmix */
+#define USE_REGRESS   (1 << 18)   /* --regress */
+#define USE_CKPT      (1 << 19)   /* --checkpoint or --restart */
+#define USE_RESTART   (1 << 20)   /* --restart */
+typedef struct {
+   int          option;
+   int          conflicts;
+   const char*  message;
+} Conflict_t;
+static const Conflict_t conflicts[] = {
+   {USE_BATCH, USE_BENCH | USE_SWEEP | USE_GEN | USE_TILE | USE_FILES,
+      "--batch can't be used with --bench, --sweep, --gen, --tile or "
+      "vector files"},
+   {USE_BLAS | USE_EXPR, USE_BENCH | USE_SWEEP | USE_PIPELINE | USE_TILE,
+      "--expr, add, axpy, mul, norm and max can't be used with --bench, "
+      "--sweep, --gen pipeline or --tile"},
+   {USE_NORM_MAX | USE_EXPR, USE_BATCH,
+      "--expr, norm and max can't be used with --batch"},
+   {USE_TILE, USE_BENCH | USE_SWEEP | USE_GEN,
+      "--tile can't be used with --bench, --sweep or --gen "
+      "scatter|pipeline"},
+   {USE_FILES, USE_BENCH | USE_SWEEP | USE_PIPELINE,
+      "vector files can't be used with --bench, --sweep or --gen "
+      "pipeline"},
+   {USE_HIER, USE_IALL | USE_SWEEP,
+      "--hier can't be used with --reduce iallreduce or --sweep"},
+   {USE_SHM, USE_SWEEP | USE_PIPELINE | USE_TILE | USE_BATCH,
+      "--shm can't be used with --sweep, --gen pipeline, --tile or "
+      "--batch"},
+   {USE_OFFLOAD, USE_NO_OPENMP,
+      "--offload needs a build with -fopenmp"},
+   {USE_OFFLOAD, USE_BENCH | USE_SWEEP | USE_GEN | USE_TILE | USE_BATCH
+         | USE_SHM | USE_BLAS | USE_EXPR,
+      "--offload can't be used with --bench, --sweep, --gen, --tile, "
+      "--batch, --shm, --expr, add, axpy, mul, norm or max"},
+   {USE_OFFLOAD, USE_SUM | USE_RNG,
+      "--offload needs --sum naive and --rng splitmix"},
+   {USE_REGRESS, USE_SWEEP | USE_GEN | USE_TILE | USE_BATCH | USE_SHM
+         | USE_OFFLOAD | USE_FILES,
+      "--regress can't be used with --sweep, --gen, --tile, --batch, "
+      "--shm, --offload or vector files"},
+   {USE_CKPT, USE_BENCH | USE_SWEEP | USE_PIPELINE | USE_TILE | USE_BATCH
+         | USE_OFFLOAD | USE_REGRESS,
+      "--checkpoint and --restart can't be used with --bench, --sweep, "
+      "--gen pipeline, --tile, --batch, --offload or --regress"},
+   {USE_RESTART, USE_XYIN,
+      "--restart can't be used with --xin or --yin"}
+};
+
+static void Default_params(Params_t* params);
+static int Set_param(Params_t* params, char key[], char value[]);
+static void Read_config_file(Params_t* params, char path[]);
+static void Read_env_params(Params_t* params);
+static void Read_args(Params_t* params, int argc, char* argv[]);
+static void Prompt_missing(Params_t* params);
+static void Read_input_sizes(Params_t* params);
+static void Read_params(Params_t* params, int argc, char* argv[], int my_rank,
+      MPI_Comm comm);
+static int Use_bits(Params_t* params);
+static void Check_conflicts(Params_t* params);
+static void Usage(char prog_name[]);
+/* ERR_ bits (see vec_lib.h) this process has found since the last
+ * Check_errors */
+static int local_errors = 0;
+
+/* Tags of the point-to-point messages */
+#define SCATTER_TAG 2
+#define SAMPLE_TAG  3
+#define PIPE_TAG    4
+
+static void Thread_block(size_t n, size_t* first_p, size_t* count_p);
+static void Print_layout(int my_rank, int comm_sz, MPI_Comm comm);
+static void Record_error(int err);
+static void Check_errors(MPI_Comm comm);
+static void Block_range(size_t n, int comm_sz, int rank, size_t* first_p,
+      size_t* count_p);
+static int Block_owner(size_t n, int comm_sz, size_t i);
+static void Allocate_vector(elem_t** local_a_pp, size_t local_n);
+#ifdef BIND_MEMORY
+static void Bind_to_local_node(void* a, size_t bytes);
+#endif
+static void Free_vector(elem_t* local_a, size_t local_n);
+static void First_touch(elem_t local_a[], size_t local_n);
+static void Shm_init(Shm_t* s, MPI_Comm comm);
+static void Shm_free(Shm_t* s);
+static void Allocate_shared_vector(elem_t** local_a_pp, size_t local_n);
+static int Shm_find(elem_t local_a[], MPI_Comm comm);
+static elem_t* Shm_peer(int v, int q);
+static void Shm_sync(int v);
+static void Scatter_init(Scatter_t* s, int my_rank, MPI_Comm comm);
+static void Scatter_free(Scatter_t* s);
+static void Scatter_remote(elem_t a[], size_t n, elem_t local_a[],
+      size_t local_n, int my_rank, int v, MPI_Comm comm);
+static void Scatter_blocks(elem_t a[], size_t n, elem_t local_a[],
+      size_t local_n, int my_rank, MPI_Comm comm);
+static void Pipeline_scatter(Params_t* params, elem_t ax[], elem_t ay[],
+      size_t n, elem_t local_x[], elem_t local_y[], size_t local_n,
+      int my_rank, double part[], MPI_Comm comm);
+static void Pipeline_chunk(Params_t* params, elem_t x[], elem_t y[],
+      size_t len, double part[]);
+static int Read_vec_header(char fname[], long long* n_p, char error[]);
+static void Read_vector_file(char fname[], elem_t local_a[], size_t local_n,
+      size_t local_first, size_t n, MPI_Comm comm);
+static void Write_vector_file(char fname[], elem_t local_a[], size_t local_n,
+      size_t local_first, size_t n, MPI_Comm comm);
+static int Create_vector_file(char fname[], size_t n, MPI_File* fh_p,
+      MPI_Comm comm);
+static void Ckpt_init(Ckpt_t* ck, Params_t* params, size_t local_n,
+      size_t local_first, size_t n, MPI_Comm comm);
+static void Ckpt_save(Ckpt_t* ck, Params_t* params, int stage,
+      elem_t local_x[], elem_t local_y[], double result);
+static void Ckpt_wait(Ckpt_t* ck, Params_t* params);
+static void Ckpt_free(Ckpt_t* ck, Params_t* params);
+static void Read_checkpoint(Params_t* params);
+static void Restore_checkpoint(Params_t* params, elem_t local_x[],
+      elem_t local_y[], size_t local_n, size_t local_first, size_t n,
       MPI_Comm comm);
-void Read_n(int* n_p, int* local_n_p, int my_rank, int comm_sz,
+static void Batch_operations(Params_t* params, Hier_t* h, elem_t local_x[],
+      elem_t local_y[], elem_t local_z[], size_t n, size_t local_n,
+      size_t local_first, int my_rank, MPI_Comm comm);
+static void Reduce_dot_batch(int sum, int reduce, Hier_t* h, double parts[],
+      double results[], int k, MPI_Comm comm);
+static void Stream_operations(Params_t* params, Hier_t* h, elem_t local_x[],
+      elem_t local_y[], size_t n, size_t local_n, size_t local_first,
+      int my_rank, MPI_Comm comm);
+static void Stream_read(Params_t* params, MPI_File fh[], elem_t* buf[],
+      size_t first, size_t len, MPI_Request reqs[]);
+static int Stream_sample(Params_t* params, MPI_File fh, int v, size_t n,
+      double sample[]);
+static void Offload_operations(Params_t* params, Hier_t* h, elem_t local_x[],
+      elem_t local_y[], size_t n, size_t local_n, size_t local_first,
+      int my_rank, MPI_Comm comm);
+static void Select_device(int my_rank, MPI_Comm comm);
+static void Device_generate(elem_t local_a[], size_t local_n,
+      size_t local_first, uint64_t stream, int randmax, uint64_t seed);
+static void Device_scale(int scalar, elem_t local_a[], size_t local_n);
+static double Device_dot(int scalar, elem_t local_x[], elem_t local_y[],
+      size_t local_n, int scale);
+static void Device_preview(elem_t local_a[], size_t local_n, size_t n,
+      size_t local_first, char title[], int my_rank, MPI_Comm comm);
+static void Generate_vector(elem_t local_a[], size_t local_n, size_t n,
+      elem_t a[], uint64_t stream, int my_rank, MPI_Comm comm,int randmax,
+      uint64_t seed);
+static void Generate_local_vector(int engine, elem_t local_a[], size_t local_n,
+      size_t local_first, uint64_t stream, int randmax, uint64_t seed);
+#ifdef _OPENMP
+// The generator also runs in the target regions of --offload
+#  pragma omp declare target (Counter_rand, Mul_hi, Rand_range)
+#endif
+static void Gather_sample(elem_t local_b[], size_t n, size_t idx[], int k,
+      double sample[], int my_rank, MPI_Comm comm);
+static int Preview_indices(size_t n, size_t idx[]);
+static void Print_sample(double sample[], size_t n, char title[]);
+static void PrintTopDown_vector(elem_t local_b[], size_t n, char title[],
+      int my_rank, MPI_Comm comm);
+static void Parallel_vector_scalar(int scalar, elem_t local_arr[],
+      size_t local_n);
+static void Parallel_vector_dot(int sum, int reduce, Hier_t* h,
+      elem_t local_x[], elem_t local_y[],
+      size_t local_n, double* result, MPI_Comm comm);
+static void Parallel_vector_scalar_dot(int sum, int reduce, Hier_t* h,
+      int scalar, elem_t local_x[],
+      elem_t local_y[], size_t local_n, int keep_scaled, int my_rank,
+      double* result, MPI_Comm comm);
+static void Display_dot_result(int my_rank, double result);
+static void Parallel_blas1(int ops, int reduce, int scalar, int first_vec,
+      elem_t local_x[], elem_t local_y[], elem_t local_z[], size_t local_n,
+      size_t local_first, int my_rank, Blas1_t* res, MPI_Comm comm);
+static void Block_minmax(elem_t a[], size_t n, size_t first, double* max_p,
+      size_t* imax_p, double* min_p, size_t* imin_p);
+static void Display_blas1(int ops, int first_vec, int my_rank,
+      Blas1_t* res);
+static int Expr_compile(char text[], Expr_t* prog, char error[]);
+static void Expr_statement(Expr_parser_t* ps);
+static void Expr_sum(Expr_parser_t* ps);
+static void Expr_term(Expr_parser_t* ps);
+static void Expr_factor(Expr_parser_t* ps);
+static void Expr_emit(Expr_parser_t* ps, int op, int arg, double value,
+      int push);
+static void Expr_fail(Expr_parser_t* ps, char what[]);
+static void Run_expr(Params_t* params, elem_t local_x[], elem_t local_y[],
+      elem_t local_z[], size_t n, size_t local_n, int my_rank, MPI_Comm comm);
+static void Expr_tile(Expr_t* prog, elem_t* vec[], size_t first, size_t len,
+      double s, double buf[][EXPR_TILE], double results[]);
+static void Expr_binary(int op, Expr_val_t* a, Expr_val_t* b, double out[],
+      size_t len);
+static double Expr_dot(Expr_val_t* a, Expr_val_t* b, size_t len);
+static void Ctx_tree_init(Vec_ctx_t* ctx);
+static double Ctx_tree_reduce(Vec_ctx_t* ctx);
+static void Trace_init(MPI_Comm comm);
+static long long Trace_cycles(void);
+static void Trace_begin(Trace_mark_t* m);
+static void Trace_end(const char name[], int cat, Trace_mark_t* m,
+      long long bytes);
+static long long Trace_bytes(int count, MPI_Datatype type);
+static void Trace_finish(char fname[], int my_rank, int comm_sz,
+      MPI_Comm comm);
+static void Write_chrome_trace(FILE* fp, Trace_event_t* all, int counts[],
+      int displs[], int comm_sz);
+static void Print_imbalance(Trace_event_t* all, int counts[], int displs[],
+      int comm_sz);
+static double Local_vector_dot(elem_t local_x[], elem_t local_y[],
+      size_t local_n);
+static double Local_vector_scalar_dot(int scalar, elem_t local_x[],
+      elem_t local_y[], size_t local_n, int keep_scaled);
+static void Local_dot_parts(int sum, int scalar, elem_t local_x[],
+      elem_t local_y[], size_t local_n, int scale, double part[]);
+static void Init_dot_parts(int sum, double part[]);
+static void Add_dot_parts(int sum, double part[], double other[]);
+static void Reduce_dot_parts(int sum, int reduce, Hier_t* h, double part[],
+      double* result, MPI_Comm comm);
+static void Start_dot_reduce(int sum, double part[], Dot_reduce_t* dr,
       MPI_Comm comm);
-void Read_RandMax(int* randmax, int my_rank, int comm_sz, 
+static void Wait_dot_reduce(Dot_reduce_t* dr, double* result);
+static void Dot_reduce_ops(int sum, MPI_Datatype* type_p, MPI_Op* op_p);
+static void Hier_init(Hier_t* h, MPI_Comm comm);
+static void Hier_free(Hier_t* h);
+static void Hier_reserve(Hier_t* h, size_t cap);
+static void Hier_reduce(Hier_t* h, double send[], double recv[], int count,
+      int width, MPI_Datatype type, MPI_Op op, int all);
+static void Free_dot_reduce_ops(int sum, MPI_Datatype* type_p, MPI_Op* op_p);
+static double Dot_total(int sum, double total[]);
+static void Comp_sum_op(void* in, void* inout, int* len, MPI_Datatype* type);
+static void Bin_sum_op(void* in, void* inout, int* len, MPI_Datatype* type);
+static void Two_sum_add(double* sum_p, double* comp_p, double a);
+static void Pairwise_push(double level[], size_t* blocks_p, double block_sum);
+static double Pairwise_total(double level[], size_t blocks);
+static void Bin_init(double bin[]);
+static void Bin_dot(double s, elem_t x[], elem_t y[], size_t n, int scale,
+      double bin[]);
+static void Bin_raise_top(double bin[], double max);
+static void Bin_normalize(double bin[]);
+static void Bin_add(double bin[], double other[]);
+static double Bin_total(double bin[]);
+static void Local_triad(double s, elem_t local_x[], elem_t local_y[],
+      elem_t local_z[], size_t local_n);
+static void Local_z(int ops, double s, elem_t local_x[], elem_t local_y[],
+      elem_t local_z[], size_t local_n);
+static const char* Z_expr(int ops);
+static void Run_operations(Params_t* params, Hier_t* h, elem_t local_x[],
+      elem_t local_y[], elem_t local_z[], elem_t a[], size_t n, size_t local_n,
+      size_t local_first, int my_rank, MPI_Comm comm);
+static void Run_pipeline(Params_t* params, Hier_t* h, elem_t local_x[],
+      elem_t local_y[], elem_t a[], size_t n, size_t local_n, int my_rank,
       MPI_Comm comm);
-void Allocate_vectors(double** local_x_pp, double** local_y_pp,
-      double** local_z_pp, int local_n, MPI_Comm comm);
-void Generate_vector(double local_a[], int local_n, int n, char vec_name[],
-      int my_rank, MPI_Comm comm,int randmax);
-void PrintTopDown_vector(double local_b[], int local_n, int n, char title[],
+static int Load_vectors(Params_t* params, Ckpt_t* ck, elem_t local_x[],
+      elem_t local_y[], elem_t a[], size_t n, size_t local_n,
+      size_t local_first, int my_rank, MPI_Comm comm, double* result_p);
+static void Run_restarted_dot(Params_t* params, Hier_t* h, Ckpt_t* ck,
+      int stage, elem_t local_x[], elem_t local_y[], size_t n,
+      size_t local_n, int my_rank, MPI_Comm comm, double* result_p);
+static void Run_fused_scale_dot(Params_t* params, Hier_t* h, Ckpt_t* ck,
+      elem_t local_x[], elem_t local_y[], size_t n, size_t local_n,
+      int my_rank, MPI_Comm comm, double* result_p);
+static void Run_unfused_scale_dot(Params_t* params, Hier_t* h, Ckpt_t* ck,
+      elem_t local_x[], elem_t local_y[], size_t n, size_t local_n,
+      int my_rank, MPI_Comm comm, double* result_p);
+static void Run_blas1(Params_t* params, elem_t local_x[], elem_t local_y[],
+      elem_t local_z[], size_t n, size_t local_n, size_t local_first,
       int my_rank, MPI_Comm comm);
-void Read_Scalar(int* scalar, int my_rank, int comm_sz, 
+static void Write_vectors(Params_t* params, elem_t local_x[],
+      elem_t local_y[], size_t n, size_t local_n, size_t local_first,
       MPI_Comm comm);
-void Parallel_vector_scalar(int scalar, double local_arr[], int local_n, 
-      int my_rank);
-void Parallel_vector_dot(double local_x[], double local_y[],
-      int local_n, int my_rank, double* result, MPI_Comm comm);
-void Display_dot_result(int my_rank, double result);
+
+static void Benchmark(Params_t* params, Hier_t* h, elem_t local_x[],
+      elem_t local_y[], elem_t local_z[], elem_t a[], size_t n,
+      size_t local_n, size_t local_first, double times[],
+      double all_times[], int my_rank, int comm_sz, MPI_Comm comm);
+static void Bench_stats(Params_t* params, Hier_t* h, elem_t local_x[],
+      elem_t local_y[], elem_t local_z[], elem_t a[], size_t n,
+      size_t local_n, size_t local_first, double times[],
+      double all_times[], int my_rank, int comm_sz, MPI_Comm comm,
+      double stats[][3]);
+static void Bench_rep(Params_t* params, Hier_t* h, elem_t local_x[],
+      elem_t local_y[], elem_t local_z[], elem_t a[], size_t n,
+      size_t local_n, size_t local_first, int my_rank, MPI_Comm comm,
+      double times[]);
+static double Bench_start(MPI_Comm comm);
+static void Bench_costs(Params_t* params, size_t n, double bytes[],
+      double flops[]);
+static int Compare_doubles(const void* p, const void* q);
+static double Median(double a[], int count);
+static void Print_bench(Params_t* params, size_t n, int comm_sz,
+      double stats[][3]);
+static void Print_rate(char fmt[], char empty[], double rate);
+static void Sweep(Params_t* params, int my_rank, int comm_sz, MPI_Comm comm);
+static int Sweep_procs(Params_t* params, int comm_sz, int procs[]);
+static void Print_sweep_row(Params_t* params, int num_procs, size_t n,
+      double stats[][3], double base_total, int base_procs, int first);
+static int Regress(Params_t* params, int my_rank, int comm_sz, MPI_Comm comm);
+static double Regress_call(Params_t* params, elem_t local_x[],
+      elem_t local_y[], size_t local_n, size_t local_first, int my_rank,
+      double* result_p, MPI_Comm comm);
+static void Serial_reference(Params_t* params, size_t n, double* ref_p);
+static int Print_regress_row(Params_t* params, Regress_row_t* row,
+      double result, double ref, double abs_sum, double t,
+      Regress_row_t base[], int num_base);
+static int Read_baseline(char fname[], Regress_row_t base[]);
+static void Write_baseline(char fname[], Regress_row_t rows[], int num_rows);
+
+/* Local kernels.  Select_kernels fills in the fastest ones the CPU
+ * supports, so the same binary runs on every node. */
+typedef struct {
+   const char* name;
+   void   (*scale)(double s, elem_t a[], size_t n);
+   double (*dot)(elem_t x[], elem_t y[], size_t n);
+   double (*scale_dot)(double s, elem_t x[], elem_t y[], size_t n);
+   void   (*dot_comp)(double s, elem_t x[], elem_t y[], size_t n, int scale,
+                      double res[]);
+   double (*bin_split)(double s, elem_t x[], elem_t y[], size_t n, int scale,
+                       double m[], double sums[]);
+   void   (*axpy)(double a, elem_t x[], elem_t y[], elem_t z[], size_t n);
+   void   (*mul)(elem_t x[], elem_t y[], elem_t z[], size_t n);
+} Kernels_t;
+static Kernels_t kernels;
+static void Select_kernels(void);
+static void Scale_generic(double s, elem_t a[], size_t n);
+static double Dot_generic(elem_t x[], elem_t y[], size_t n);
+static double Scale_dot_generic(double s, elem_t x[], elem_t y[], size_t n);
+static void Dot_comp_generic(double s, elem_t x[], elem_t y[], size_t n,
+      int scale, double res[]);
+static double Bin_split_generic(double s, elem_t x[], elem_t y[], size_t n,
+      int scale, double m[], double sums[]);
+static void Axpy_generic(double a, elem_t x[], elem_t y[], elem_t z[],
+      size_t n);
+static void Mul_generic(elem_t x[], elem_t y[], elem_t z[], size_t n);
+
+/* Shared windows of the vectors, with --shm */
+static Shm_t shm;
+
+/* Counts and displacements of MPI_Scatterv, with --gen scatter */
+static Scatter_t scatter;
+
+/* Events of the calling process, with --trace */
+static Trace_t trace;
+
+/* Random number engine of Generate_local_vector, from --rng */
+static int rng_engine = RNG_SPLITMIX;
 
 
 /*-------------------------------------------------------------------*/
-int main(void) {
-   srand(time(NULL));
-   int n, local_n, randmax;
-   int comm_sz, my_rank;
-   double *local_x, *local_y, *local_z;
+#ifndef VEC_LIBRARY
+int main(int argc, char* argv[]) {
+   Params_t params;
+   size_t n, local_n, local_first, buf_n, z_n;
+   int comm_sz, my_rank, failed;
+   elem_t *local_x, *local_y;
+   elem_t* local_z = NULL;
+   elem_t* a = NULL;
+   double *times = NULL, *all_times = NULL;
+   Hier_t hier;
+   Hier_t* h = NULL;
    MPI_Comm comm;
    double tstart, tend;
 
-   MPI_Init(NULL, NULL);
+   int thread_level;
+
+   // Only the master thread of each process makes MPI calls
+   MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &thread_level);
    comm = MPI_COMM_WORLD;
    MPI_Comm_size(comm, &comm_sz);
    MPI_Comm_rank(comm, &my_rank);
+   Select_kernels();
+#  ifdef DEBUG
+   if (my_rank == 0)
+      printf("Using %s kernels on %s elements\n", kernels.name, ELEM_NAME);
+#  endif
 
-   Read_n(&n, &local_n, my_rank, comm_sz, comm);
-   Read_RandMax(&randmax, my_rank, comm_sz, comm);
-   // n = 10000000;
-   tstart = MPI_Wtime();
-   Allocate_vectors(&local_x, &local_y, &local_z, local_n, comm);
-
-   Generate_vector(local_x, local_n, n, "x", my_rank, comm, randmax);
-   PrintTopDown_vector(local_x, local_n, n, "Vector x", my_rank, comm);
-   Generate_vector(local_y, local_n, n, "y", my_rank, comm, randmax);
-   PrintTopDown_vector(local_y, local_n, n, "Vector y", my_rank, comm);
+   Read_params(&params, argc, argv, my_rank, comm);
+   rng_engine = params.rng;
+   if (params.trace[0] != '\0') Trace_init(comm);
+   hier.active = 0;
+   if (params.hier) {
+      // Only the runs on comm itself reduce through the nodes
+      Hier_init(&hier, comm);
+      h = &hier;
+   }
+#  ifdef _OPENMP
+   if (params.threads > 0) omp_set_num_threads(params.threads);
+#  endif
+   // Keep CSV and JSON benchmark reports machine-readable
+   if (params.reps == 0 || params.format == FORMAT_TEXT)
+      Print_layout(my_rank, comm_sz, comm);
+   if (params.sweep != SWEEP_NONE) {
+      Sweep(&params, my_rank, comm_sz, comm);
+      if (params.trace[0] != '\0')
+         Trace_finish(params.trace, my_rank, comm_sz, comm);
+      MPI_Finalize();
+      return 0;
+   }
+   if (params.regress[0] != '\0') {
+      // The exit status tells scripts whether the regression passed
+      failed = Regress(&params, my_rank, comm_sz, comm);
+      if (params.trace[0] != '\0')
+         Trace_finish(params.trace, my_rank, comm_sz, comm);
+      MPI_Finalize();
+      return failed;
+   }
+   n = params.n;
+   Block_range(n, comm_sz, my_rank, &local_first, &local_n);
 
-   // Scalar Multiplication
-   int scalar;
-   Read_Scalar(&scalar, my_rank, comm_sz, comm);
-   Parallel_vector_scalar(scalar, local_x, local_n, my_rank);
-   PrintTopDown_vector(local_x, local_n, n, "Vector x by scalar", my_rank, comm);
-   Parallel_vector_scalar(scalar, local_y, local_n, my_rank);
-   PrintTopDown_vector(local_y, local_n, n, "Vector y by scalar", my_rank, comm);
+   tstart = MPI_Wtime();
+   // Allocate what the run needs and check all the allocations at once.
+   // Streaming only needs two tiles of each vector.
+   buf_n = local_n*params.batch;
+   if (params.tile > 0 && (size_t) params.tile < local_n)
+      buf_n = 2*params.tile;
+   if (params.shm) {
+      // One window per vector over the processes of each node
+      Shm_init(&shm, comm);
+      Allocate_shared_vector(&local_x, buf_n);
+      Allocate_shared_vector(&local_y, buf_n);
+   } else {
+      Allocate_vector(&local_x, buf_n);
+      Allocate_vector(&local_y, buf_n);
+   }
+   if (params.gen != GEN_LOCAL && my_rank == 0) {
+      // The pipeline needs x and y on process 0 at the same time
+      a = malloc((params.gen == GEN_PIPELINE && params.reps == 0 ? 2 : 1)
+            *n*sizeof(elem_t));
+      if (a == NULL && n > 0) Record_error(ERR_ALLOC_TEMP);
+   }
+   // z has a block per pair with --batch
+   z_n = local_n*params.batch;
+   if (params.reps > 0 || (params.ops & OP_Z)
+         || ((params.ops & OP_EXPR) && (params.prog.writes & 4))) { // z
+      if (params.shm) Allocate_shared_vector(&local_z, z_n);
+      else Allocate_vector(&local_z, z_n);
+   }
+   if (params.reps > 0) {
+      // The times of every repetition
+      times = malloc(params.reps*NUM_PHASES*sizeof(double));
+      if (times == NULL) Record_error(ERR_ALLOC_BENCH);
+      if (my_rank == 0) {
+         all_times = malloc(2*comm_sz*NUM_PHASES*sizeof(double));
+         if (all_times == NULL) Record_error(ERR_ALLOC_BENCH);
+      }
+   }
+   if (params.gen == GEN_SCATTER) Scatter_init(&scatter, my_rank, comm);
+   Check_errors(comm);
 
-   // dot product
-   double result; // Cambiar int result a double result
-   Parallel_vector_dot(local_x,local_y,local_n,my_rank,&result,comm);
-   Display_dot_result(my_rank,result);
+   if (params.reps > 0)
+      Benchmark(&params, h, local_x, local_y, local_z, a, n, local_n,
+            local_first, times, all_times, my_rank, comm_sz, comm);
+   else if (params.tile > 0)
+      Stream_operations(&params, h, local_x, local_y, n, local_n,
+            local_first, my_rank, comm);
+   else if (params.offload)
+      Offload_operations(&params, h, local_x, local_y, n, local_n,
+            local_first, my_rank, comm);
+   else if (params.batch > 1)
+      Batch_operations(&params, h, local_x, local_y, local_z, n, local_n,
+            local_first, my_rank, comm);
+   else
+      Run_operations(&params, h, local_x, local_y, local_z, a, n, local_n,
+            local_first, my_rank, comm);
 
    tend = MPI_Wtime();
-   if(my_rank==0)
+   if(my_rank==0 && params.reps == 0)
     printf("\nTook %.3lf s to run\n",(tend-tstart));
+   if (params.trace[0] != '\0')
+      Trace_finish(params.trace, my_rank, comm_sz, comm);
 
-   free(local_x);
-   free(local_y);
-   free(local_z);
+   free(a);
+   free(times);
+   free(all_times);
+   Free_vector(local_x, buf_n);
+   Free_vector(local_y, buf_n);
+   Free_vector(local_z, z_n);
+   Shm_free(&shm);
+   Hier_free(&hier);
+   Scatter_free(&scatter);
 
    MPI_Finalize();
 
    return 0;
 }  /* main */
+#endif
 
 /*-------------------------------------------------------------------
- * Function:  Check_for_error
- * Purpose:   Check whether any process has found an error.  If so,
- *            print message and terminate all processes.  Otherwise,
- *            continue execution.
- * In args:   local_ok:  1 if calling process has found an error, 0
- *               otherwise
- *            fname:     name of function calling Check_for_error
- *            message:   message to print if there's an error
- *            comm:      communicator containing processes calling
- *                       Check_for_error:  should be MPI_COMM_WORLD.
- *
- * Note:
- *    The communicator containing the processes calling Check_for_error
- *    should be MPI_COMM_WORLD.
+ * Function:  Run_operations
+ * Purpose:   Generate x and y and run the operations selected with
+ *            --ops, printing the previews and the results
+ * In args:   params:       the run parameters
+ *            h:            hierarchical reduction of comm (--hier),
+ *                          or NULL
+ *            a:            scratch storage for the global vector on
+ *                          process 0 (only used with --gen scatter,
+ *                          and for x and y, 2*n doubles, with --gen
+ *                          pipeline)
+ *            n:            order of the global vectors
+ *            local_n:      size of the local blocks
+ *            local_first:  global index of the first local element
+ *            my_rank:      calling process' rank in comm
+ *            comm:         communicator containing all the processes
+ * Out args:  local_x, local_y:  local blocks of the vectors
+ *            local_z:      local block of z, if add, axpy or mul is
+ *                          selected
  */
-void Check_for_error(
-      int       local_ok   /* in */,
-      char      fname[]    /* in */,
-      char      message[]  /* in */,
-      MPI_Comm  comm       /* in */) {
-   int ok;
+static void Run_operations(
+      Params_t*  params       /* in  */,
+      Hier_t*    h            /* in  */,
+      elem_t     local_x[]    /* out */,
+      elem_t     local_y[]    /* out */,
+      elem_t     local_z[]    /* out */,
+      elem_t     a[]          /* scratch */,
+      size_t     n            /* in  */,
+      size_t     local_n      /* in  */,
+      size_t     local_first  /* in  */,
+      int        my_rank      /* in  */,
+      MPI_Comm   comm         /* in  */) {
+   double result; // Cambiar int result a double result
+   Trace_mark_t m;
+   Ckpt_t ck;
+   int stage;
 
-   MPI_Allreduce(&local_ok, &ok, 1, MPI_INT, MPI_MIN, comm);
-   if (ok == 0) {
-      int my_rank;
-      MPI_Comm_rank(comm, &my_rank);
-      if (my_rank == 0) {
-         fprintf(stderr, "Proc %d > In %s, %s\n", my_rank, fname,
-               message);
-         fflush(stderr);
-      }
-      MPI_Finalize();
-      exit(-1);
+   if (params->gen == GEN_PIPELINE) {
+      Run_pipeline(params, h, local_x, local_y, a, n, local_n, my_rank,
+            comm);
+      return;
+   }
+
+   Ckpt_init(&ck, params, local_n, local_first, n, comm);
+   Check_errors(comm);
+   stage = Load_vectors(params, &ck, local_x, local_y, a, n, local_n,
+         local_first, my_rank, comm, &result);
+   if (stage >= CKPT_SCALED)
+      Run_restarted_dot(params, h, &ck, stage, local_x, local_y, n,
+            local_n, my_rank, comm, &result);
+   else if ((params->ops & OP_SCALE) && (params->ops & OP_DOT) &&
+         !params->unfused)
+      Run_fused_scale_dot(params, h, &ck, local_x, local_y, n, local_n,
+            my_rank, comm, &result);
+   else
+      Run_unfused_scale_dot(params, h, &ck, local_x, local_y, n, local_n,
+            my_rank, comm, &result);
+   Ckpt_free(&ck, params);
+   if (params->ops & OP_DOT)
+      Display_dot_result(my_rank,result);
+   if (params->ops & OP_EXPR) {
+      Trace_begin(&m);
+      Run_expr(params, local_x, local_y, local_z, n, local_n, my_rank, comm);
+      Trace_end("expr", TRACE_PHASE, &m, 0);
    }
-}  /* Check_for_error */
+   if (params->ops & OP_BLAS)
+      Run_blas1(params, local_x, local_y, local_z, n, local_n, local_first,
+            my_rank, comm);
+   Write_vectors(params, local_x, local_y, n, local_n, local_first, comm);
+}  /* Run_operations */
 
 
 /*-------------------------------------------------------------------
- * Function:  Read_n
- * Purpose:   Get the order of the vectors from stdin on proc 0 and
- *            broadcast to other processes.
- * In args:   my_rank:    process rank in communicator
- *            comm_sz:    number of processes in communicator
- *            comm:       communicator containing all the processes
- *                        calling Read_n
- * Out args:  n_p:        global value of n
- *            local_n_p:  local value of n = n/comm_sz
- *
- * Errors:    n should be positive and evenly divisible by comm_sz
+ * Function:  Run_pipeline
+ * Purpose:   Run the operations with --gen pipeline:  generate x and
+ *            y on process 0 and scatter them in chunks, scaling them
+ *            and adding up the dot product of each chunk as it
+ *            arrives
+ * In args:   params:   the run parameters
+ *            h:        hierarchical reduction of comm, or NULL
+ *            n:        order of the global vectors
+ *            local_n:  size of the local blocks
+ *            my_rank:  calling process' rank in comm
+ *            comm:     communicator containing all the processes
+ * Out args:  local_x, local_y:  local blocks of the vectors
+ * Scratch:   a:        x and y on process 0, 2*n elements
  */
-void Read_n(
-      int*      n_p        /* out */,
-      int*      local_n_p  /* out */,
-      int       my_rank    /* in  */,
-      int       comm_sz    /* in  */,
-      MPI_Comm  comm       /* in  */) {
-   int local_ok = 1;
-   char *fname = "Read_n";
+static void Run_pipeline(
+      Params_t*  params     /* in  */,
+      Hier_t*    h          /* in  */,
+      elem_t     local_x[]  /* out */,
+      elem_t     local_y[]  /* out */,
+      elem_t     a[]        /* scratch */,
+      size_t     n          /* in  */,
+      size_t     local_n    /* in  */,
+      int        my_rank    /* in  */,
+      MPI_Comm   comm       /* in  */) {
+   double result;
+   double part[BIN_PARTS];
 
+   // x and y start out on process 0, in a[0..n) and a[n..2n)
    if (my_rank == 0) {
-      printf("What's the order of the vectors?\n");
-      scanf("%d", n_p);
+      Generate_local_vector(rng_engine, a, n, 0, 0, params->randmax,
+            params->seed);
+      Generate_local_vector(rng_engine, a + n, n, 0, 1, params->randmax,
+            params->seed);
+      if (params->ops & OP_PRINT) {
+         PrintTopDown_vector(a, n, "Vector x", 0, MPI_COMM_SELF);
+         PrintTopDown_vector(a + n, n, "Vector y", 0, MPI_COMM_SELF);
+      }
    }
-   MPI_Bcast(n_p, 1, MPI_INT, 0, comm);
-   if (*n_p < 0 || *n_p % comm_sz != 0) local_ok = 0;
-   Check_for_error(local_ok, fname,
-         "n should be >= 100,000 and evenly divisible by comm_sz", comm);
-   *local_n_p = *n_p/comm_sz;
-}  /* Read_n */
+   Pipeline_scatter(params, a, a + n, n, local_x, local_y, local_n,
+         my_rank, part, comm);
+   if ((params->ops & OP_PRINT) && (params->ops & OP_SCALE)) {
+      PrintTopDown_vector(local_x, n, "Vector x by scalar",
+            my_rank, comm);
+      PrintTopDown_vector(local_y, n, "Vector y by scalar",
+            my_rank, comm);
+   }
+   if (params->ops & OP_DOT) {
+      Reduce_dot_parts(params->sum, params->reduce, h, part, &result,
+            comm);
+      Display_dot_result(my_rank, result);
+   }
+}  /* Run_pipeline */
+
 
 /*-------------------------------------------------------------------
- * Function:  Read_RandMax
- * Purpose:   Read limit for random numbers.
- * In args:   my_rank:    process rank in communicator
- *            comm_sz:    number of processes in communicator
- *            comm:       communicator containing all the processes
- *                        calling Read_n
- * Out args:  randmax:        global value of randmax
- *
- * Errors:    randmax is < 0
+ * Function:  Load_vectors
+ * Purpose:   Get x and y from the checkpoint of --restart, the vector
+ *            files or the generator, print them and checkpoint them
+ * In args:   params:       the run parameters
+ *            n:            order of the global vectors
+ *            local_n:      size of the local blocks
+ *            local_first:  global index of the first local element
+ *            my_rank:      calling process' rank in comm
+ *            comm:         communicator containing all the processes
+ * In/out:    ck:           the checkpoints of the run
+ * Out args:  local_x, local_y:  local blocks of the vectors
+ *            result_p:     the dot product, if the restart has it
+ * Scratch:   a:            global vector on process 0 (--gen scatter)
+ * Ret val:   the last CKPT_ stage x and y have been through
  */
-void Read_RandMax(
-      int*      randmax        /* out */,
-      int       my_rank    /* in  */,
-      int       comm_sz    /* in  */,
-      MPI_Comm  comm       /* in  */) {
-   int local_ok = 1;
-   char *fname = "Read_RandMax";
+static int Load_vectors(
+      Params_t*  params       /* in  */,
+      Ckpt_t*    ck           /* in/out */,
+      elem_t     local_x[]    /* out */,
+      elem_t     local_y[]    /* out */,
+      elem_t     a[]          /* scratch */,
+      size_t     n            /* in  */,
+      size_t     local_n      /* in  */,
+      size_t     local_first  /* in  */,
+      int        my_rank      /* in  */,
+      MPI_Comm   comm         /* in  */,
+      double*    result_p     /* out */) {
+   Trace_mark_t m;
+   int stage = 0;
+   long long vb = (long long) local_n*sizeof(elem_t);
 
-   if (my_rank == 0) {
-      printf("What's the max number for random?\n");
-      scanf("%d", randmax);
+   if (params->restart[0] != '\0') {
+      // x and y as they were after stage params->ckpt_stage
+      Trace_begin(&m);
+      Restore_checkpoint(params, local_x, local_y, local_n, local_first, n,
+            comm);
+      Trace_end("restore", TRACE_PHASE, &m, 2*vb);
+      stage = params->ckpt_stage;
+      *result_p = params->ckpt_result;
+   }
+
+   // Read the vector files first, so one Check_errors covers both
+   Trace_begin(&m);
+   if (params->xin[0] != '\0')
+      Read_vector_file(params->xin, local_x, local_n, local_first, n, comm);
+   if (params->yin[0] != '\0')
+      Read_vector_file(params->yin, local_y, local_n, local_first, n, comm);
+   Check_errors(comm);
+   if (params->xin[0] != '\0' || params->yin[0] != '\0')
+      Trace_end("read files", TRACE_PHASE, &m,
+            ((params->xin[0] != '\0') + (params->yin[0] != '\0'))*vb);
+
+   if (stage < CKPT_GENERATED && params->xin[0] == '\0') {
+      Trace_begin(&m);
+      if (params->gen == GEN_SCATTER)
+         Generate_vector(local_x, local_n, n, a, 0, my_rank, comm,
+               params->randmax, params->seed);
+      else
+         Generate_local_vector(rng_engine, local_x, local_n, local_first, 0,
+               params->randmax, params->seed);
+      Trace_end("generate x", TRACE_PHASE, &m, vb);
+   }
+   if ((params->ops & OP_PRINT) && stage < CKPT_SCALED)
+      PrintTopDown_vector(local_x, n, "Vector x", my_rank, comm);
+   if (stage < CKPT_GENERATED && params->yin[0] == '\0') {
+      Trace_begin(&m);
+      if (params->gen == GEN_SCATTER)
+         Generate_vector(local_y, local_n, n, a, 1, my_rank, comm,
+               params->randmax, params->seed);
+      else
+         Generate_local_vector(rng_engine, local_y, local_n, local_first, 1,
+               params->randmax, params->seed);
+      Trace_end("generate y", TRACE_PHASE, &m, vb);
    }
-   MPI_Bcast(randmax, 1, MPI_INT, 0, comm);
-   if (*randmax < 0) local_ok = 0;
-   Check_for_error(local_ok, fname,
-         "randmax should be >= 100,000", comm);
-}  /* Read_RandMax */
+   if ((params->ops & OP_PRINT) && stage < CKPT_SCALED)
+      PrintTopDown_vector(local_y, n, "Vector y", my_rank, comm);
+   if (stage < CKPT_GENERATED)
+      Ckpt_save(ck, params, stage = CKPT_GENERATED, local_x, local_y, 0.0);
+   return stage;
+}  /* Load_vectors */
 
 
 /*-------------------------------------------------------------------
- * Function:  Allocate_vectors
- * Purpose:   Allocate storage for x, y, and z
- * In args:   local_n:  the size of the local vectors
- *            comm:     the communicator containing the calling processes
- * Out args:  local_x_pp, local_y_pp, local_z_pp:  pointers to memory
- *               blocks to be allocated for local vectors
- *
- * Errors:    One or more of the calls to malloc fails
+ * Function:  Run_restarted_dot
+ * Purpose:   Finish a run restarted after the scaling:  x and y are
+ *            already scaled, so only the dot product is left, unless
+ *            the checkpoint has it too
+ * In args:   params:   the run parameters
+ *            h:        hierarchical reduction of comm, or NULL
+ *            stage:    the CKPT_ stage of the restart
+ *            local_x, local_y:  local blocks of the scaled vectors
+ *            n:        order of the global vectors
+ *            local_n:  size of the local blocks
+ *            my_rank:  calling process' rank in comm
+ *            comm:     communicator containing all the processes
+ * In/out:    ck:       the checkpoints of the run
+ *            result_p:  the dot product
  */
-void Allocate_vectors(
-      double**   local_x_pp  /* out */,
-      double**   local_y_pp  /* out */,
-      double**   local_z_pp  /* out */,
-      int        local_n     /* in  */,
-      MPI_Comm   comm        /* in  */) {
-   int local_ok = 1;
-   char* fname = "Allocate_vectors";
+static void Run_restarted_dot(
+      Params_t*  params     /* in  */,
+      Hier_t*    h          /* in  */,
+      Ckpt_t*    ck         /* in/out */,
+      int        stage      /* in  */,
+      elem_t     local_x[]  /* in  */,
+      elem_t     local_y[]  /* in  */,
+      size_t     n          /* in  */,
+      size_t     local_n    /* in  */,
+      int        my_rank    /* in  */,
+      MPI_Comm   comm       /* in  */,
+      double*    result_p   /* in/out */) {
+   Trace_mark_t m;
+   long long vb = (long long) local_n*sizeof(elem_t);
+
+   Trace_begin(&m);
+   if ((params->ops & OP_PRINT) && (params->ops & OP_SCALE)) {
+      PrintTopDown_vector(local_x, n, "Vector x by scalar",
+            my_rank, comm);
+      PrintTopDown_vector(local_y, n, "Vector y by scalar",
+            my_rank, comm);
+   }
+   if ((params->ops & OP_DOT) && stage < CKPT_DOT) {
+      Parallel_vector_dot(params->sum, params->reduce, h, local_x,
+            local_y, local_n, result_p, comm);
+      Trace_end("dot", TRACE_PHASE, &m, 2*vb);
+      Ckpt_save(ck, params, CKPT_DOT, local_x, local_y, *result_p);
+   }
+}  /* Run_restarted_dot */
 
-   *local_x_pp = malloc(local_n*sizeof(double));
-   *local_y_pp = malloc(local_n*sizeof(double));
-   *local_z_pp = malloc(local_n*sizeof(double));
 
-   if (*local_x_pp == NULL || *local_y_pp == NULL ||
-       *local_z_pp == NULL) local_ok = 0;
-   Check_for_error(local_ok, fname, "Can't allocate local vector(s)",
-         comm);
-}  /* Allocate_vectors */
+/*-------------------------------------------------------------------
+ * Function:  Run_fused_scale_dot
+ * Purpose:   Scale x and y and compute their dot product in one pass
+ * In args:   params:   the run parameters
+ *            h:        hierarchical reduction of comm, or NULL
+ *            n:        order of the global vectors
+ *            local_n:  size of the local blocks
+ *            my_rank:  calling process' rank in comm
+ *            comm:     communicator containing all the processes
+ * In/out:    ck:       the checkpoints of the run
+ *            local_x, local_y:  local blocks of the vectors
+ * Out arg:   result_p:  the dot product
+ */
+static void Run_fused_scale_dot(
+      Params_t*  params     /* in  */,
+      Hier_t*    h          /* in  */,
+      Ckpt_t*    ck         /* in/out */,
+      elem_t     local_x[]  /* in/out */,
+      elem_t     local_y[]  /* in/out */,
+      size_t     n          /* in  */,
+      size_t     local_n    /* in  */,
+      int        my_rank    /* in  */,
+      MPI_Comm   comm       /* in  */,
+      double*    result_p   /* out */) {
+   double part[BIN_PARTS];
+   Dot_reduce_t dr;
+   Trace_mark_t m;
+   long long vb = (long long) local_n*sizeof(elem_t);
+
+   Trace_begin(&m);
+   if (params->reduce == REDUCE_IALL) {
+      // print the scaled vectors while the reduction runs
+      Local_dot_parts(params->sum, params->scalar, local_x, local_y,
+            local_n, 1, part);
+      Start_dot_reduce(params->sum, part, &dr, comm);
+   } else {
+      Parallel_vector_scalar_dot(params->sum, params->reduce, h,
+            params->scalar, local_x, local_y, local_n, 1, my_rank,
+            result_p, comm);
+   }
+   if (params->ops & OP_PRINT) {
+      PrintTopDown_vector(local_x, n, "Vector x by scalar",
+            my_rank, comm);
+      PrintTopDown_vector(local_y, n, "Vector y by scalar",
+            my_rank, comm);
+   }
+   if (params->reduce == REDUCE_IALL) Wait_dot_reduce(&dr, result_p);
+   Trace_end("scale and dot", TRACE_PHASE, &m, 4*vb);
+   Ckpt_save(ck, params, CKPT_DOT, local_x, local_y, *result_p);
+}  /* Run_fused_scale_dot */
 
 
 /*-------------------------------------------------------------------
- * Function:   Generate_vector
- * Purpose:    Read a vector from stdin on process 0 and distribute
- *             among the processes using a block distribution.
- * In args:    local_n:  size of local vectors
- *             n:        size of global vector
- *             vec_name: name of vector being read (e.g., "x")
- *             my_rank:  calling process' rank in comm
- *             comm:     communicator containing calling processes
- *             randmax: global variable for random limit
- * Out arg:    local_a:  local vector read
- *
- * Errors:     if the malloc on process 0 for temporary storage
- *             fails the program terminates
- *
- * Note:
- *    This function assumes a block distribution and the order
- *   of the vector evenly divisible by comm_sz.
+ * Function:  Run_unfused_scale_dot
+ * Purpose:   Scale x and y and then compute their dot product, with
+ *            a pass over the vectors for each (--unfused, or when
+ *            only one of scale and dot is selected)
+ * In args:   params:   the run parameters
+ *            h:        hierarchical reduction of comm, or NULL
+ *            n:        order of the global vectors
+ *            local_n:  size of the local blocks
+ *            my_rank:  calling process' rank in comm
+ *            comm:     communicator containing all the processes
+ * In/out:    ck:       the checkpoints of the run
+ *            local_x, local_y:  local blocks of the vectors
+ * Out arg:   result_p:  the dot product, if dot is selected
  */
-void Generate_vector(
-      double    local_a[]   /* out */,
-      int       local_n     /* in  */,
-      int       n           /* in  */,
-      char      vec_name[]  /* in  */,
-      int       my_rank     /* in  */,
-      MPI_Comm  comm        /* in  */,
-      int       randmax         /* in  */) {
+static void Run_unfused_scale_dot(
+      Params_t*  params     /* in  */,
+      Hier_t*    h          /* in  */,
+      Ckpt_t*    ck         /* in/out */,
+      elem_t     local_x[]  /* in/out */,
+      elem_t     local_y[]  /* in/out */,
+      size_t     n          /* in  */,
+      size_t     local_n    /* in  */,
+      int        my_rank    /* in  */,
+      MPI_Comm   comm       /* in  */,
+      double*    result_p   /* out */) {
+   Trace_mark_t m;
+   long long vb = (long long) local_n*sizeof(elem_t);
 
-   double* a = NULL;
-   int i;
-   int local_ok = 1;
-   char* fname = "Generate_vector";
+   // Scalar Multiplication
+   if (params->ops & OP_SCALE) {
+      Trace_begin(&m);
+      Parallel_vector_scalar(params->scalar, local_x, local_n);
+      if (params->ops & OP_PRINT)
+         PrintTopDown_vector(local_x, n, "Vector x by scalar",
+               my_rank, comm);
+      Parallel_vector_scalar(params->scalar, local_y, local_n);
+      if (params->ops & OP_PRINT)
+         PrintTopDown_vector(local_y, n, "Vector y by scalar",
+               my_rank, comm);
+      Trace_end("scale", TRACE_PHASE, &m, 4*vb);
+      Ckpt_save(ck, params, CKPT_SCALED, local_x, local_y, 0.0);
+   }
 
-   if (my_rank == 0) {
-      a = malloc(n*sizeof(double));
-      if (a == NULL) local_ok = 0;
-      Check_for_error(local_ok, fname, "Can't allocate temporary vector",
-            comm);
-      //printf("Enter the vector %s\n", vec_name);
-      //fill vec with indez
-      for (i = 0; i < n; i++)
-         a[i] = rand() % randmax;
-      MPI_Scatter(a, local_n, MPI_DOUBLE, local_a, local_n, MPI_DOUBLE, 0,
-         comm);
-      free(a);
-   } else {
-      Check_for_error(local_ok, fname, "Can't allocate temporary vector",
+   // dot product
+   if (params->ops & OP_DOT) {
+      Trace_begin(&m);
+      Parallel_vector_dot(params->sum, params->reduce, h, local_x,
+            local_y, local_n, result_p, comm);
+      Trace_end("dot", TRACE_PHASE, &m, 2*vb);
+      Ckpt_save(ck, params, CKPT_DOT, local_x, local_y, *result_p);
+   }
+}  /* Run_unfused_scale_dot */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Run_blas1
+ * Purpose:   Compute z and the norms and extremes, in one pass over
+ *            x and y for each of add, axpy and mul that's selected,
+ *            in that order, and print them.  x's and y's norms and
+ *            extremes are only taken in the first pass; the others
+ *            read x and y to form their z, and only reduce z.
+ * In args:   params:       the run parameters
+ *            local_x, local_y:  local blocks of the vectors
+ *            n:            order of the global vectors
+ *            local_n:      size of the local blocks
+ *            local_first:  global index of the first local element
+ *            my_rank:      calling process' rank in comm
+ *            comm:         communicator containing all the processes
+ * Out arg:   local_z:      local block of z, if add, axpy or mul is
+ *                          selected
+ */
+static void Run_blas1(
+      Params_t*  params       /* in  */,
+      elem_t     local_x[]    /* in  */,
+      elem_t     local_y[]    /* in  */,
+      elem_t     local_z[]    /* out */,
+      size_t     n            /* in  */,
+      size_t     local_n      /* in  */,
+      size_t     local_first  /* in  */,
+      int        my_rank      /* in  */,
+      MPI_Comm   comm         /* in  */) {
+   Blas1_t blas;
+   Trace_mark_t m;
+   char title[64];
+   int zop, ops, first_vec = 0;
+   long long vb = (long long) local_n*sizeof(elem_t);
+
+   for (zop = OP_ADD; zop <= OP_MUL; zop <<= 1) {
+      if ((params->ops & OP_Z) && !(params->ops & zop)) continue;
+      ops = (params->ops & ~OP_Z) | (params->ops & zop);
+      Trace_begin(&m);
+      Parallel_blas1(ops, params->reduce, params->scalar, first_vec,
+            local_x, local_y, local_z, local_n, local_first, my_rank, &blas,
             comm);
-      MPI_Scatter(a, local_n, MPI_DOUBLE, local_a, local_n, MPI_DOUBLE, 0,
-         comm);
+      Trace_end("blas1", TRACE_PHASE, &m, (ops & OP_Z ? 3 : 2)*vb);
+      if ((ops & OP_PRINT) && (ops & OP_Z)) {
+         sprintf(title, "Vector z = %s", Z_expr(ops));
+         PrintTopDown_vector(local_z, n, title, my_rank, comm);
+      }
+      Display_blas1(ops, first_vec, my_rank, &blas);
+      // Only norm and max:  one pass over x and y
+      if (!(params->ops & OP_Z)) break;
+      first_vec = 2;
    }
-}  /* Generate_vector */
+}  /* Run_blas1 */
 
 
 /*-------------------------------------------------------------------
- * Function:  PrintTopDown_vector
- * Purpose:   Print a vector that has a block distribution to stdout
- * In args:   local_b:  local storage for vector to be printed
- *            local_n:  order of local vectors
- *            n:        order of global vector (local_n*comm_sz)
- *            title:    title to precede print out
- *            comm:     communicator containing processes calling
- *                      PrintTopDown_vector
- *
- * Error:     if process 0 can't allocate temporary storage for
- *            the full vector, the program terminates.
+ * Function:  Write_vectors
+ * Purpose:   Write x and y to the files of --xout and --yout
+ * In args:   params:       the run parameters
+ *            local_x, local_y:  local blocks of the vectors
+ *            n:            order of the global vectors
+ *            local_n:      size of the local blocks
+ *            local_first:  global index of the first local element
+ *            comm:         communicator containing all the processes
+ */
+static void Write_vectors(
+      Params_t*  params       /* in  */,
+      elem_t     local_x[]    /* in  */,
+      elem_t     local_y[]    /* in  */,
+      size_t     n            /* in  */,
+      size_t     local_n      /* in  */,
+      size_t     local_first  /* in  */,
+      MPI_Comm   comm         /* in  */) {
+   Trace_mark_t m;
+   long long vb = (long long) local_n*sizeof(elem_t);
+
+   Trace_begin(&m);
+   if (params->xout[0] != '\0')
+      Write_vector_file(params->xout, local_x, local_n, local_first, n,
+            comm);
+   if (params->yout[0] != '\0')
+      Write_vector_file(params->yout, local_y, local_n, local_first, n,
+            comm);
+   Check_errors(comm);
+   if (params->xout[0] != '\0' || params->yout[0] != '\0')
+      Trace_end("write files", TRACE_PHASE, &m,
+            ((params->xout[0] != '\0') + (params->yout[0] != '\0'))*vb);
+}  /* Write_vectors */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Benchmark
+ * Purpose:   Time each phase of the program over params->reps
+ *            repetitions and print a report on process 0
+ * In args:   as in Bench_stats
+ */
+static void Benchmark(
+      Params_t*  params       /* in  */,
+      Hier_t*    h            /* in  */,
+      elem_t     local_x[]    /* scratch */,
+      elem_t     local_y[]    /* scratch */,
+      elem_t     local_z[]    /* scratch */,
+      elem_t     a[]          /* scratch */,
+      size_t     n            /* in  */,
+      size_t     local_n      /* in  */,
+      size_t     local_first  /* in  */,
+      double     times[]      /* scratch */,
+      double     all_times[]  /* scratch */,
+      int        my_rank      /* in  */,
+      int        comm_sz      /* in  */,
+      MPI_Comm   comm         /* in  */) {
+   double stats[NUM_PHASES][3];
+
+   Bench_stats(params, h, local_x, local_y, local_z, a, n, local_n,
+         local_first, times, all_times, my_rank, comm_sz, comm, stats);
+   if (my_rank == 0) Print_bench(params, n, comm_sz, stats);
+}  /* Benchmark */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Bench_stats
+ * Purpose:   Time each phase of the program over params->reps
+ *            repetitions and collect the times of all the processes
+ * In args:   params:       the run parameters
+ *            h:            hierarchical reduction of comm (--hier),
+ *                          or NULL
+ *            n:            order of the global vectors
+ *            local_n:      size of the local blocks
+ *            local_first:  global index of the first local element
+ *            my_rank:      calling process' rank in comm
+ *            comm_sz:      number of processes in comm
+ *            comm:         communicator containing all the processes
+ * Scratch:   local_x, local_y, local_z:  local blocks of the vectors
+ *            a:            global vector on process 0 (only used with
+ *                          --gen scatter)
+ *            times:        params->reps*NUM_PHASES doubles
+ *            all_times:    2*comm_sz*NUM_PHASES doubles on process 0
+ * Out arg:   stats:        on process 0, min, median and max over the
+ *                          processes of each phase's time (negative if
+ *                          it wasn't run)
  *
  * Note:
- *    Assumes order of vector is evenly divisible by the number of
- *    processes
+ *    A process' time for a phase is its median over the repetitions,
+ *    so an occasional slow repetition doesn't skew it.  The report
+ *    gives the min, median and max of these over the processes.
  */
-void PrintTopDown_vector(
-      double    local_b[]  /* in */,
-      int       local_n    /* in */,
-      int       n          /* in */,
-      char      title[]    /* in */,
-      int       my_rank    /* in */,
-      MPI_Comm  comm       /* in */) {
+static void Bench_stats(
+      Params_t*  params       /* in  */,
+      Hier_t*    h            /* in  */,
+      elem_t     local_x[]    /* scratch */,
+      elem_t     local_y[]    /* scratch */,
+      elem_t     local_z[]    /* scratch */,
+      elem_t     a[]          /* scratch */,
+      size_t     n            /* in  */,
+      size_t     local_n      /* in  */,
+      size_t     local_first  /* in  */,
+      double     times[]      /* scratch */,
+      double     all_times[]  /* scratch */,
+      int        my_rank      /* in  */,
+      int        comm_sz      /* in  */,
+      MPI_Comm   comm         /* in  */,
+      double     stats[][3]   /* out */) {
+   double rep_times[NUM_PHASES], med[NUM_PHASES];
+   double* col = all_times + comm_sz*NUM_PHASES;
+   int reps = params->reps, r, p, q;
 
-   double* b = NULL;
-   int i;
-   int local_ok = 1;
-   char* fname = "PrintTopDown_vector";
+   for (r = 0; r < params->warmup; r++)
+      Bench_rep(params, h, local_x, local_y, local_z, a, n, local_n,
+            local_first, my_rank, comm, rep_times);
+   // times is stored by phase, so each phase's repetitions are
+   // contiguous for Median
+   for (r = 0; r < reps; r++) {
+      Bench_rep(params, h, local_x, local_y, local_z, a, n, local_n,
+            local_first, my_rank, comm, rep_times);
+      for (p = 0; p < NUM_PHASES; p++)
+         times[p*reps + r] = rep_times[p];
+   }
+   for (p = 0; p < NUM_PHASES; p++)
+      med[p] = Median(times + p*reps, reps);
 
+   MPI_Gather(med, NUM_PHASES, MPI_DOUBLE, all_times, NUM_PHASES,
+         MPI_DOUBLE, 0, comm);
    if (my_rank == 0) {
-      b = malloc(n*sizeof(double));
-      if (b == NULL) local_ok = 0;
-      Check_for_error(local_ok, fname, "Can't allocate temporary vector",
-            comm);
-      MPI_Gather(local_b, local_n, MPI_DOUBLE, b, local_n, MPI_DOUBLE,
-            0, comm);
-      printf("%s\n", title);
-      printf("0 - 10: [");
-      for (i = 0; i < 9; i++)
-         printf("%lf,", b[i]);
-      printf("%lf]\n", b[9]);
-      printf("%d - %d: [",n-10,n);
-      for (i = n-10; i < n-1; i++)
-         printf("%lf,", b[i]);
-      printf("%lf]\n", b[n-1]);
-      free(b);
-   } else {
-      Check_for_error(local_ok, fname, "Can't allocate temporary vector",
-            comm);
-      MPI_Gather(local_b, local_n, MPI_DOUBLE, b, local_n, MPI_DOUBLE, 0,
-         comm);
+      for (p = 0; p < NUM_PHASES; p++) {
+         for (q = 0; q < comm_sz; q++)
+            col[q] = all_times[q*NUM_PHASES + p];
+         stats[p][1] = Median(col, comm_sz);
+         stats[p][0] = col[0];
+         stats[p][2] = col[comm_sz-1];
+      }
    }
-}  /* PrintTopDown_vector */
+}  /* Bench_stats */
+
 
 /*-------------------------------------------------------------------
- * Function:  Read_Scalar
- * Purpose:   Read scalar to multiply vectors with.
- * In args:   my_rank:    process rank in communicator
- *            comm_sz:    number of processes in communicator
- *            comm:       communicator containing all the processes
- *                        calling Read_n
- * Out args:  scalar:        global value of scalar
+ * Function:  Bench_rep
+ * Purpose:   Run and time one repetition of every phase selected by
+ *            params
+ * In args:   params:       the run parameters
+ *            h:            hierarchical reduction of comm (--hier),
+ *                          or NULL
+ *            n:            order of the global vectors
+ *            local_n:      size of the local blocks
+ *            local_first:  global index of the first local element
+ *            my_rank:      calling process' rank in comm
+ *            comm:         communicator containing all the processes
+ * Scratch:   local_x, local_y, local_z, a:  as in Benchmark
+ * Out arg:   times:        the calling process' time for each phase,
+ *                          or -1 for phases that weren't run
  *
- * Errors:    None
+ * Notes:
+ * 1. x and y are generated again in every repetition, so repeated
+ *    scaling doesn't overflow them.
+ * 2. The dot and reduce phases use the --sum mode.
+ * 3. With --gen pipeline, x and y are both sent from the one vector a,
+ *    as with --gen scatter, and the pipeline phase includes the
+ *    scaling and the local dot product of the chunks.
  */
-void Read_Scalar(
-      int*      scalar        /* out */,
-      int       my_rank    /* in  */,
-      int       comm_sz    /* in  */,
-      MPI_Comm  comm       /* in  */) {
-   int local_ok = 1;
-   char *fname = "Read_Scalar";
+static void Bench_rep(
+      Params_t*  params       /* in  */,
+      Hier_t*    h            /* in  */,
+      elem_t     local_x[]    /* scratch */,
+      elem_t     local_y[]    /* scratch */,
+      elem_t     local_z[]    /* scratch */,
+      elem_t     a[]          /* scratch */,
+      size_t     n            /* in  */,
+      size_t     local_n      /* in  */,
+      size_t     local_first  /* in  */,
+      int        my_rank      /* in  */,
+      MPI_Comm   comm         /* in  */,
+      double     times[]      /* out */) {
+   size_t idx[PREVIEW_MAX];
+   double sample[PREVIEW_MAX];
+   double part[BIN_PARTS], result, t0;
+   int scale = params->ops & OP_SCALE, dot = params->ops & OP_DOT;
+   int p, k;
 
-   if (my_rank == 0) {
-      printf("\nWhat's the number for the scalar?\n");
-      scanf("%d", scalar);
+   for (p = 0; p < NUM_PHASES; p++)
+      times[p] = -1.0;
+
+   t0 = Bench_start(comm);
+   if (params->gen != GEN_LOCAL) {
+      if (my_rank == 0)
+         Generate_local_vector(rng_engine, a, n, 0, 0, params->randmax,
+               params->seed);
+   } else {
+      Generate_local_vector(rng_engine, local_x, local_n, local_first, 0,
+            params->randmax, params->seed);
+      Generate_local_vector(rng_engine, local_y, local_n, local_first, 1,
+            params->randmax, params->seed);
    }
-   MPI_Bcast(scalar, 1, MPI_INT, 0, comm);
-}  /* Read_Scalar */
+   times[PH_GEN] = MPI_Wtime() - t0;
+
+   if (params->gen == GEN_SCATTER) {
+      t0 = Bench_start(comm);
+      Scatter_blocks(a, n, local_x, local_n, my_rank, comm);
+      Scatter_blocks(a, n, local_y, local_n, my_rank, comm);
+      times[PH_SCATTER] = MPI_Wtime() - t0;
+   }
+   if (params->gen == GEN_PIPELINE) {
+      t0 = Bench_start(comm);
+      Pipeline_scatter(params, a, a, n, local_x, local_y, local_n, my_rank,
+            part, comm);
+      times[PH_PIPELINE] = MPI_Wtime() - t0;
+   }
+
+   t0 = Bench_start(comm);
+   Local_triad(params->scalar, local_x, local_y, local_z, local_n);
+   times[PH_TRIAD] = MPI_Wtime() - t0;
+
+   if (scale) {
+      t0 = Bench_start(comm);
+      Parallel_vector_scalar(params->scalar, local_x, local_n);
+      Parallel_vector_scalar(params->scalar, local_y, local_n);
+      times[PH_SCALE] = MPI_Wtime() - t0;
+   }
+   if (dot) {
+      t0 = Bench_start(comm);
+      Local_dot_parts(params->sum, 1, local_x, local_y, local_n, 0, part);
+      times[PH_DOT] = MPI_Wtime() - t0;
+   }
+   if (scale && dot && !params->unfused) {
+      t0 = Bench_start(comm);
+      Local_dot_parts(params->sum, params->scalar, local_x, local_y, local_n,
+            1, part);
+      times[PH_SCALE_DOT] = MPI_Wtime() - t0;
+   }
+   if (dot) {
+      t0 = Bench_start(comm);
+      Reduce_dot_parts(params->sum, params->reduce, h, part, &result, comm);
+      times[PH_REDUCE] = MPI_Wtime() - t0;
+   }
+   if (params->ops & OP_PRINT) {
+      k = Preview_indices(n, idx);
+      t0 = Bench_start(comm);
+      Gather_sample(local_x, n, idx, k, sample, my_rank, comm);
+      times[PH_GATHER] = MPI_Wtime() - t0;
+   }
+}  /* Bench_rep */
+
 
 /*-------------------------------------------------------------------
- * Function:  Parallel_vector_scalar
- * Purpose:   Multiply a vector by a scalar that's been distributed among the processes
- * In args:   my_rank:  calling process' rank in comm
- *            local_n:  the number of components in local_x, local_y,
- *                      and local_z
- *            scalar: Scalar number to multiply vectors with
- * Out arg:   local_arr:  local storage of the vector multiplied by the scalar
+ * Function:  Bench_start
+ * Purpose:   Line up the processes and start timing a phase
+ * In arg:    comm:  communicator containing all the processes
+ * Ret val:   MPI_Wtime() after the barrier
  */
-void Parallel_vector_scalar(
-      int     scalar,
-      double  local_arr[]  /* out */,
-      int     local_n    /* in  */,
-      int     my_rank) {
-   int local_i;
-
-   for (local_i = 0; local_i < local_n; local_i++)
-      local_arr[local_i] = local_arr[local_i] * scalar;
-      //local_arr[i] = local_arr[i]*scalar;
-}  /* Parallel_vector_scalar */
+static double Bench_start(MPI_Comm comm /* in */) {
+   MPI_Barrier(comm);
+   return MPI_Wtime();
+}  /* Bench_start */
+
 
 /*-------------------------------------------------------------------
- * Function:  Parallel_vector_dot
- * Purpose:   Add a vector that's been distributed among the processes
- * In args:   local_x:  local storage of one of the vectors being added
- *            local_y:  local storage for the second vector being added
- *            local_n:  the number of components in local_x and local_y
- *            my_rank: calling process' rank in comm
- * Out arg:   result:  local storage for the dot product of the two vectors
+ * Function:  Bench_costs
+ * Purpose:   Find the bytes of memory traffic and the floating point
+ *            operations of each phase
+ * In args:   params:  the run parameters
+ *            n:       order of the global vectors
+ * Out args:  bytes:   bytes read and written by each phase, 0 if the
+ *                     phase isn't limited by bandwidth
+ *            flops:   floating point operations of each phase
+ *
+ * Note:
+ *    As in STREAM, the write-allocate reads of stored vectors aren't
+ *    counted, so phases that update x and y in place can come out
+ *    faster than the triad, which writes a third vector.
  */
-void Parallel_vector_dot(
-      double    local_x[]   /* in  */,
-      double    local_y[]   /* in  */,
-      int       local_n     /* in  */,
-      int       my_rank     /* in  */,
-      double*   result      /* out */,
-      MPI_Comm  comm        /* in  */) {
+static void Bench_costs(
+      Params_t*  params  /* in  */,
+      size_t     n       /* in  */,
+      double     bytes[] /* out */,
+      double     flops[] /* out */) {
+   double d = (double) n * sizeof(elem_t);
+   int p;
 
-   double local_dot = 0.0;
-   int i;
+   for (p = 0; p < NUM_PHASES; p++)
+      bytes[p] = flops[p] = 0.0;
+   bytes[PH_TRIAD] = 3*d;          flops[PH_TRIAD] = 2.0*n;
+   // --gen scatter only fills one vector, which is scattered twice
+   bytes[PH_GEN] = params->gen == GEN_LOCAL ? 2*d : d;
+   bytes[PH_SCATTER] = 2*d;
+   bytes[PH_PIPELINE] = 2*d;
+   bytes[PH_SCALE] = 4*d;          flops[PH_SCALE] = 2.0*n;
+   bytes[PH_DOT] = 2*d;            flops[PH_DOT] = 2.0*n;
+   bytes[PH_SCALE_DOT] = 4*d;      flops[PH_SCALE_DOT] = 4.0*n;
+}  /* Bench_costs */
 
-   for (i = 0; i < local_n; i++)
-      local_dot += local_x[i]*local_y[i];
 
-   //Reduce los resultados de cada proceso hacia el proceso 0
-   MPI_Reduce(&local_dot, result, 1, MPI_DOUBLE, MPI_SUM, 0, comm);
+/*-------------------------------------------------------------------
+ * Function:  Compare_doubles
+ * Purpose:   qsort comparison function for doubles
+ */
+static int Compare_doubles(const void* p, const void* q) {
+   double x = *(const double*) p, y = *(const double*) q;
+
+   return (x > y) - (x < y);
+}  /* Compare_doubles */
 
-}  /* Parallel_vector_dot */
 
 /*-------------------------------------------------------------------
- * Function:  Display_dot_result
- * Purpose:   Add a vector that's been distributed among the processes
- * In args:   local_x:  local storage of one of the vectors being added
- *            local_y:  local storage for the second vector being added
- *            local_n:  the number of components in local_x and local_y
- *            my_rank: calling process' rank in comm
- * Out arg:   result:  local storage for the dot product of the two vectors
+ * Function:  Median
+ * Purpose:   Sort an array and return its median
+ * In arg:    count:  number of elements in a
+ * In/out:    a:      the values; sorted on return
+ * Ret val:   the median, or 0 if count is 0
  */
-void Display_dot_result(
-      int     my_rank    /* in  */,
-      double result      /* in  */) {
-   if(my_rank == 0) {
-      printf("\nResult of dot product: %lf\n",result);
+
+static double Median(
+      double  a[]    /* in/out */,
+      int     count  /* in     */) {
+   if (count == 0) return 0.0;
+   qsort(a, count, sizeof(double), Compare_doubles);
+   return count % 2 ? a[count/2] : (a[count/2 - 1] + a[count/2])/2;
+}  /* Median */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Print_rate
+ * Purpose:   Print one rate of the benchmark report, or the format's
+ *            placeholder if it's missing
+ * In args:   fmt:    printf format for the rate
+ *            empty:  printf format for a missing rate; any %s gets "-"
+ *            rate:   the rate, negative if it's missing
+ */
+static void Print_rate(
+      char    fmt[]    /* in */,
+      char    empty[]  /* in */,
+      double  rate     /* in */) {
+   if (rate < 0)
+      printf(empty, "-");
+   else
+      printf(fmt, rate);
+}  /* Print_rate */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Print_bench
+ * Purpose:   Print the benchmark report in the format of
+ *            params->format
+ * In args:   params:   the run parameters
+ *            n:        order of the global vectors
+ *            comm_sz:  number of processes
+ *            stats:    min, median and max over the processes of
+ *                      each phase's time (negative if it wasn't run)
+ *
+ * Note:
+ *    Rates use the max time, since a phase isn't over until the
+ *    slowest process is done.  Rates of phases that aren't limited by
+ *    bandwidth are left empty ("-" in text, null in JSON).
+ */
+static void Print_bench(
+      Params_t*  params         /* in */,
+      size_t     n              /* in */,
+      int        comm_sz        /* in */,
+      double     stats[][3]     /* in */) {
+   double bytes[NUM_PHASES], flops[NUM_PHASES];
+   double gbs, gflops, pct, triad_gbs = 0.0;
+   int num_t = 1, p, first = 1;
+
+#  ifdef _OPENMP
+   num_t = omp_get_max_threads();
+#  endif
+   Bench_costs(params, n, bytes, flops);
+   if (stats[PH_TRIAD][2] > 0)
+      triad_gbs = bytes[PH_TRIAD]/stats[PH_TRIAD][2]/1e9;
+
+   if (params->format == FORMAT_TEXT) {
+      printf("Benchmark: n = %zu, %d processes x %d thread(s), "
+            "%s kernels\n", n, comm_sz, num_t, kernels.name);
+      printf("%d repetitions after %d warmup; times are the "
+            "processes' medians\n\n", params->reps, params->warmup);
+      printf("%-10s %11s %11s %11s %9s %9s %8s\n", "phase", "min (s)",
+            "median (s)", "max (s)", "GB/s", "GFLOP/s", "triad %");
+   } else if (params->format == FORMAT_CSV) {
+      printf("phase,n,procs,threads,kernels,reps,min_s,median_s,max_s,"
+            "gb_s,gflop_s,triad_pct\n");
+   } else {
+      printf("{\"n\": %zu, \"procs\": %d, \"threads\": %d, "
+            "\"kernels\": \"%s\", \"reps\": %d, \"warmup\": %d,\n"
+            " \"phases\": [", n, comm_sz, num_t, kernels.name,
+            params->reps, params->warmup);
    }
-}  /* Display_dot_result */
+
+   for (p = 0; p < NUM_PHASES; p++) {
+      if (stats[p][0] < 0) continue;
+      gbs = gflops = pct = -1.0;
+      if (bytes[p] > 0 && stats[p][2] > 0) {
+         gbs = bytes[p]/stats[p][2]/1e9;
+         if (flops[p] > 0) gflops = flops[p]/stats[p][2]/1e9;
+         if (triad_gbs > 0) pct = 100*gbs/triad_gbs;
+      }
+      if (params->format == FORMAT_TEXT) {
+         printf("%-10s %11.3e %11.3e %11.3e", phase_names[p], stats[p][0],
+               stats[p][1], stats[p][2]);
+         Print_rate(" %9.2f", " %9s", gbs);
+         Print_rate(" %9.2f", " %9s", gflops);
+         Print_rate(" %8.1f\n", " %8s\n", pct);
+      } else if (params->format == FORMAT_CSV) {
+         printf("%s,%zu,%d,%d,%s,%d,%.9g,%.9g,%.9g", phase_names[p], n,
+               comm_sz, num_t, kernels.name, params->reps, stats[p][0],
+               stats[p][1], stats[p][2]);
+         Print_rate(",%.6g", ",", gbs);
+         Print_rate(",%.6g", ",", gflops);
+         Print_rate(",%.6g\n", ",\n", pct);
+      } else {
+         printf("%s\n  {\"phase\": \"%s\", \"min_s\": %.9g, "
+               "\"median_s\": %.9g, \"max_s\": %.9g, ", first ? "" : ",",
+               phase_names[p], stats[p][0], stats[p][1], stats[p][2]);
+         Print_rate("\"gb_s\": %.6g, ", "\"gb_s\": null, ", gbs);
+         Print_rate("\"gflop_s\": %.6g, ", "\"gflop_s\": null, ", gflops);
+         Print_rate("\"triad_pct\": %.6g}", "\"triad_pct\": null}", pct);
+      }
+      first = 0;
+   }
+   if (params->format == FORMAT_JSON) printf("\n ]}\n");
+}  /* Print_bench */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Sweep
+ * Purpose:   Run a strong or weak scaling study:  benchmark every size
+ *            in params->sizes on the first P processes of comm for
+ *            each P chosen by Sweep_procs, and print a row for each
+ *            run on process 0
+ * In args:   params:   the run parameters
+ *            my_rank:  calling process' rank in comm
+ *            comm_sz:  number of processes in comm
+ *            comm:     communicator containing all the processes
+ *
+ * Notes:
+ * 1. Each run gets a sub-communicator from MPI_Comm_split.  The
+ *    processes that aren't in it just wait in the next split, so they
+ *    don't disturb the timings.
+ * 2. The buffers of a run are allocated for that run only and checked
+ *    over all of comm, so every process gets to Check_errors.
+ */
+static void Sweep(
+      Params_t*  params   /* in */,
+      int        my_rank  /* in */,
+      int        comm_sz  /* in */,
+      MPI_Comm   comm     /* in */) {
+   int procs[MAX_SWEEP];
+   int num_procs = Sweep_procs(params, comm_sz, procs);
+   int i, j, p, first = 1;
+   double stats[NUM_PHASES][3];
+   elem_t *local_x, *local_y, *local_z, *a;
+   double *times, *all_times;
+   double base_total = 0.0, total;
+   size_t n, local_n, local_first;
+   MPI_Comm sub;
+
+   if (my_rank == 0) {
+      int num_t = 1;
+#     ifdef _OPENMP
+      num_t = omp_get_max_threads();
+#     endif
+      if (params->format == FORMAT_TEXT) {
+         printf("%s scaling: %d thread(s) per process, %s kernels, "
+               "%d repetitions after %d warmup\n\n",
+               params->sweep == SWEEP_STRONG ? "Strong" : "Weak", num_t,
+               kernels.name, params->reps, params->warmup);
+         printf("%6s %14s %14s %12s %12s %12s %8s %10s\n", "procs", "n",
+               "local_n", "compute (s)", "comm (s)", "total (s)",
+               "speedup", "efficiency");
+      } else if (params->format == FORMAT_CSV) {
+         printf("mode,procs,n,local_n,compute_s,comm_s,total_s,speedup,"
+               "efficiency");
+         for (p = 0; p < NUM_PHASES; p++)
+            printf(",%s_s", phase_names[p]);
+         printf("\n");
+      } else {
+         printf("{\"mode\": \"%s\", \"threads\": %d, \"kernels\": \"%s\", "
+               "\"reps\": %d, \"warmup\": %d,\n \"runs\": [",
+               params->sweep == SWEEP_STRONG ? "strong" : "weak", num_t,
+               kernels.name, params->reps, params->warmup);
+      }
+   }
+
+   for (i = 0; i < params->num_sizes; i++) {
+      for (j = 0; j < num_procs; j++) {
+         n = params->sizes[i];
+         if (params->sweep == SWEEP_WEAK) n *= procs[j];
+         MPI_Comm_split(comm, my_rank < procs[j] ? 0 : MPI_UNDEFINED,
+               my_rank, &sub);
+         local_x = local_y = local_z = a = NULL;
+         times = all_times = NULL;
+         local_n = local_first = 0;
+         if (sub != MPI_COMM_NULL) {
+            Block_range(n, procs[j], my_rank, &local_first, &local_n);
+            Allocate_vector(&local_x, local_n);
+            Allocate_vector(&local_y, local_n);
+            Allocate_vector(&local_z, local_n);
+            times = malloc(params->reps*NUM_PHASES*sizeof(double));
+            if (times == NULL) Record_error(ERR_ALLOC_BENCH);
+            if (my_rank == 0) {
+               all_times = malloc(2*procs[j]*NUM_PHASES*sizeof(double));
+               if (all_times == NULL) Record_error(ERR_ALLOC_BENCH);
+               if (params->gen != GEN_LOCAL) {
+                  a = malloc(n*sizeof(elem_t));
+                  if (a == NULL && n > 0) Record_error(ERR_ALLOC_TEMP);
+               }
+            }
+         }
+         Check_errors(comm);
+
+         if (sub != MPI_COMM_NULL) {
+            Bench_stats(params, NULL, local_x, local_y, local_z, a, n,
+                  local_n, local_first, times, all_times, my_rank,
+                  procs[j], sub, stats);
+            MPI_Comm_free(&sub);
+         }
+         if (my_rank == 0) {
+            for (total = 0.0, p = 0; p < NUM_PHASES; p++)
+               if (phase_is_comm[p] >= 0 && stats[p][2] > 0)
+                  total += stats[p][2];
+            if (j == 0) base_total = total;
+            Print_sweep_row(params, procs[j], n, stats, base_total,
+                  procs[0], first);
+            first = 0;
+         }
+
+         free(a);
+         free(times);
+         free(all_times);
+         Free_vector(local_x, local_n);
+         Free_vector(local_y, local_n);
+         Free_vector(local_z, local_n);
+      }
+   }
+   if (my_rank == 0 && params->format == FORMAT_JSON) printf("\n ]}\n");
+}  /* Sweep */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Sweep_procs
+ * Purpose:   Get the process counts of a scaling study in increasing
+ *            order
+ * In args:   params:   the run parameters
+ *            comm_sz:  number of processes available
+ * Out arg:   procs:    the process counts:  params->procs if it was
+ *                      given, 1, 2, 4, ..., comm_sz otherwise
+ * Ret val:   number of process counts in procs
+ */
+static int Sweep_procs(
+      Params_t*  params   /* in  */,
+      int        comm_sz  /* in  */,
+      int        procs[]  /* out */) {
+   int num_procs = 0, i, j, tmp;
+
+   if (params->num_procs > 0) {
+      for (i = 0; i < params->num_procs; i++)
+         procs[num_procs++] = params->procs[i];
+      // Insertion sort:  there are at most MAX_SWEEP counts
+      for (i = 1; i < num_procs; i++)
+         for (j = i; j > 0 && procs[j-1] > procs[j]; j--) {
+            tmp = procs[j];
+            procs[j] = procs[j-1];
+            procs[j-1] = tmp;
+         }
+   } else {
+      for (i = 1; i < comm_sz && num_procs < MAX_SWEEP - 1; i *= 2)
+         procs[num_procs++] = i;
+      procs[num_procs++] = comm_sz;
+   }
+   return num_procs;
+}  /* Sweep_procs */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Print_sweep_row
+ * Purpose:   Print the results of one run of a scaling study
+ * In args:   params:      the run parameters
+ *            num_procs:   number of processes of the run
+ *            n:           order of the vectors of the run
+ *            stats:       min, median and max over the processes of
+ *                         each phase's time, as from Bench_stats
+ *            base_total:  total time of the run with base_procs
+ *                         processes and the same size
+ *            base_procs:  smallest number of processes of the study
+ *            first:       nonzero for the first row of the report
+ *
+ * Note:
+ *    Times are those of the slowest process.  For strong scaling the
+ *    speedup is base_total/total and the efficiency is the speedup
+ *    divided by num_procs/base_procs.  For weak scaling the efficiency
+ *    is base_total/total and the (scaled) speedup is the efficiency
+ *    times num_procs/base_procs.
+ */
+static void Print_sweep_row(
+      Params_t*  params      /* in */,
+      int        num_procs   /* in */,
+      size_t     n           /* in */,
+      double     stats[][3]  /* in */,
+      double     base_total  /* in */,
+      int        base_procs  /* in */,
+      int        first       /* in */) {
+   double compute = 0.0, comm_time = 0.0, total, speedup, efficiency;
+   double ratio = (double) num_procs/base_procs;
+   size_t local_n = (n + num_procs - 1)/num_procs;
+   int p;
+
+   for (p = 0; p < NUM_PHASES; p++) {
+      if (stats[p][2] < 0) continue;
+      if (phase_is_comm[p] == 1) comm_time += stats[p][2];
+      else if (phase_is_comm[p] == 0) compute += stats[p][2];
+   }
+   total = compute + comm_time;
+   speedup = efficiency = 0.0;
+   if (total > 0) {
+      if (params->sweep == SWEEP_STRONG) {
+         speedup = base_total/total;
+         efficiency = speedup/ratio;
+      } else {
+         efficiency = base_total/total;
+         speedup = efficiency*ratio;
+      }
+   }
+
+   if (params->format == FORMAT_TEXT) {
+      printf("%6d %14zu %14zu %12.4e %12.4e %12.4e %8.2f %10.3f\n",
+            num_procs, n, local_n, compute, comm_time, total, speedup,
+            efficiency);
+   } else if (params->format == FORMAT_CSV) {
+      printf("%s,%d,%zu,%zu,%.9g,%.9g,%.9g,%.6g,%.6g",
+            params->sweep == SWEEP_STRONG ? "strong" : "weak", num_procs,
+            n, local_n, compute, comm_time, total, speedup, efficiency);
+      for (p = 0; p < NUM_PHASES; p++)
+         Print_rate(",%.9g", ",", stats[p][2]);
+      printf("\n");
+   } else {
+      printf("%s\n  {\"procs\": %d, \"n\": %zu, \"local_n\": %zu, "
+            "\"compute_s\": %.9g, \"comm_s\": %.9g, \"total_s\": %.9g, "
+            "\"speedup\": %.6g, \"efficiency\": %.6g, \"phases\": {",
+            first ? "" : ",", num_procs, n, local_n, compute, comm_time,
+            total, speedup, efficiency);
+      for (p = 0; p < NUM_PHASES; p++) {
+         printf("%s\"%s\": ", p == 0 ? "" : ", ", phase_names[p]);
+         Print_rate("%.9g", "null", stats[p][2]);
+      }
+      printf("}}");
+   }
+}  /* Print_sweep_row */
+
+/*-------------------------------------------------------------------
+ * Function:  Regress
+ * Purpose:   Check the fused scale and dot of every size in
+ *            params->sizes on the first P processes of comm, for each
+ *            P chosen by Sweep_procs, against the serial algorithm on
+ *            the same vectors, and its throughput against the
+ *            baseline file params->regress
+ * In args:   params:   the run parameters
+ *            my_rank:  calling process' rank in comm
+ *            comm_sz:  number of processes in comm
+ *            comm:     communicator containing all the processes
+ * Ret val:   1 on every process if a run gave a wrong result or was
+ *            more than params->margin percent slower than its
+ *            baseline, 0 otherwise
+ *
+ * Notes:
+ * 1. The reference is the result the serial program params->serial
+ *    prints for the same n, randmax, scalar, seed and --rng engine,
+ *    which generate the same x and y (vec_rng.h).  See
+ *    Print_regress_row for the check.
+ * 2. Each call of the dot is timed on freshly generated vectors.
+ *    After params->warmup untimed calls, one more call sets the
+ *    number of calls in a sample so that it lasts REGRESS_MIN_TIME
+ *    on the slowest process.  A sample is the mean time of its calls,
+ *    and a run's time is the median of params->reps samples of the
+ *    slowest process, so short runs don't compare single
+ *    microsecond timings against the baseline.
+ * 3. GB/s counts x and y read and written once, and the speedup is
+ *    over the first process count.
+ * 4. If the baseline file doesn't exist, it's written with this
+ *    run's rates, one "n procs gb_s speedup" line per run.
+ */
+static int Regress(
+      Params_t*  params   /* in */,
+      int        my_rank  /* in */,
+      int        comm_sz  /* in */,
+      MPI_Comm   comm     /* in */) {
+   int procs[MAX_SWEEP];
+   int num_procs = Sweep_procs(params, comm_sz, procs);
+   int num_base = 0, num_rows = 0, failed = 0, calls, i, j, r, c;
+   Regress_row_t* base = NULL;
+   Regress_row_t* rows = NULL;
+   elem_t *local_x, *local_y;
+   double *times = NULL, ref = 0.0, abs_sum = 0.0, result = 0.0;
+   double t, t_max, my_abs, base_t = 0.0;
+   size_t n, local_n, local_first, local_i;
+   MPI_Comm sub;
+
+   times = malloc(params->reps*sizeof(double));
+   if (times == NULL) Record_error(ERR_ALLOC_BENCH);
+   if (my_rank == 0) {
+      rows = malloc(MAX_SWEEP*MAX_SWEEP*sizeof(Regress_row_t));
+      base = malloc(MAX_SWEEP*MAX_SWEEP*sizeof(Regress_row_t));
+      if (rows == NULL || base == NULL) Record_error(ERR_ALLOC_BENCH);
+      else num_base = Read_baseline(params->regress, base);
+   }
+   Check_errors(comm);
+   if (my_rank == 0)
+      printf("Regression: %s kernels, %s elements, %d repetitions "
+            "after %d warmup, margin %.1f%%, reference %s\n\n%14s %6s "
+            "%20s %8s %6s %11s %9s %8s %9s %7s\n", kernels.name,
+            ELEM_NAME, params->reps, params->warmup, params->margin,
+            params->serial, "n", "procs", "dot", "ulps", "check",
+            "time (s)", "GB/s", "speedup", "base GB/s", "status");
+
+   for (i = 0; i < params->num_sizes; i++) {
+      n = params->sizes[i];
+      if (my_rank == 0)
+         Serial_reference(params, n, &ref);
+      Check_errors(comm);
+      for (j = 0; j < num_procs; j++) {
+         MPI_Comm_split(comm, my_rank < procs[j] ? 0 : MPI_UNDEFINED,
+               my_rank, &sub);
+         local_x = local_y = NULL;
+         local_n = local_first = 0;
+         if (sub != MPI_COMM_NULL) {
+            Block_range(n, procs[j], my_rank, &local_first, &local_n);
+            Allocate_vector(&local_x, local_n);
+            Allocate_vector(&local_y, local_n);
+         }
+         Check_errors(comm);
+
+         if (sub != MPI_COMM_NULL) {
+            // The last warmup call also sizes the samples
+            for (r = 0; r <= params->warmup; r++)
+               t = Regress_call(params, local_x, local_y, local_n,
+                     local_first, my_rank, &result, sub);
+            MPI_Allreduce(&t, &t_max, 1, MPI_DOUBLE, MPI_MAX, sub);
+            calls = t_max*REGRESS_MAX_CALLS > REGRESS_MIN_TIME
+                  ? (int) ceil(REGRESS_MIN_TIME/t_max) : REGRESS_MAX_CALLS;
+            for (r = 0; r < params->reps; r++) {
+               for (c = 0, t = 0.0; c < calls; c++)
+                  t += Regress_call(params, local_x, local_y, local_n,
+                        local_first, my_rank, &result, sub);
+               t /= calls;
+               MPI_Reduce(&t, &times[r], 1, MPI_DOUBLE, MPI_MAX, 0, sub);
+            }
+
+            // sum |x_i*y_i| of the scaled vectors, for the error bound
+            for (my_abs = 0.0, local_i = 0; local_i < local_n; local_i++)
+               my_abs += fabs((double) local_x[local_i]*local_y[local_i]);
+            MPI_Reduce(&my_abs, &abs_sum, 1, MPI_DOUBLE, MPI_SUM, 0, sub);
+            MPI_Comm_free(&sub);
+         }
+         if (my_rank == 0) {
+            t = Median(times, params->reps);
+            if (j == 0) base_t = t;
+            rows[num_rows].n = n;
+            rows[num_rows].procs = procs[j];
+            rows[num_rows].gb_s = t > 0 ? 4.0*n*sizeof(elem_t)/t/1e9 : 0;
+            rows[num_rows].speedup = t > 0 ? base_t/t : 0;
+            failed |= Print_regress_row(params, &rows[num_rows], result,
+                  ref, abs_sum, t, base, num_base);
+            num_rows++;
+         }
+         Free_vector(local_x, local_n);
+         Free_vector(local_y, local_n);
+      }
+   }
+
+   if (my_rank == 0) {
+      if (failed)
+         printf("\nRegression FAILED\n");
+      else
+         printf("\nRegression passed\n");
+      if (num_base < 0) Write_baseline(params->regress, rows, num_rows);
+   }
+   free(times);
+   free(rows);
+   free(base);
+   Check_errors(comm);
+   MPI_Bcast(&failed, 1, MPI_INT, 0, comm);
+   return failed;
+}  /* Regress */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Regress_call
+ * Purpose:   Generate x and y and time one scale and dot of the
+ *            regression, fused unless --unfused is given
+ * In args:   params:       the run parameters
+ *            local_n:      number of local elements
+ *            local_first:  global index of the first local element
+ *            my_rank:      calling process' rank in comm
+ *            comm:         communicator of the run
+ * Out args:  local_x, local_y:  the scaled local blocks
+ *            result_p:     the dot product, on process 0 of comm
+ * Ret val:   the calling process' time of the dot, generation excluded
+ */
+static double Regress_call(
+      Params_t*  params       /* in  */,
+      elem_t     local_x[]    /* out */,
+      elem_t     local_y[]    /* out */,
+      size_t     local_n      /* in  */,
+      size_t     local_first  /* in  */,
+      int        my_rank      /* in  */,
+      double*    result_p     /* out */,
+      MPI_Comm   comm         /* in  */) {
+   double t;
+
+   Generate_local_vector(rng_engine, local_x, local_n, local_first, 0,
+         params->randmax, params->seed);
+   Generate_local_vector(rng_engine, local_y, local_n, local_first, 1,
+         params->randmax, params->seed);
+   MPI_Barrier(comm);
+   t = MPI_Wtime();
+   if (params->unfused) {
+      Parallel_vector_scalar(params->scalar, local_x, local_n);
+      Parallel_vector_scalar(params->scalar, local_y, local_n);
+      Parallel_vector_dot(params->sum, params->reduce, NULL, local_x,
+            local_y, local_n, result_p, comm);
+   } else {
+      Parallel_vector_scalar_dot(params->sum, params->reduce, NULL,
+            params->scalar, local_x, local_y, local_n, 1, my_rank, result_p,
+            comm);
+   }
+   return MPI_Wtime() - t;
+}  /* Regress_call */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Serial_reference
+ * Purpose:   Run the serial program on the vectors of the regression
+ *            and get its dot product
+ * In args:   params:  the run parameters
+ *            n:       order of the vectors
+ * Out arg:   ref_p:   the serial program's dot product
+ * Errors:    If the program can't be run, fails, or doesn't print a
+ *            result, ERR_SERIAL is recorded.
+ *
+ * Note:
+ *    vector_add2 reads n, randmax and the scalar from stdin, and
+ *    generates x and y from --seed and --rng with the generators
+ *    of vec_rng.h that Generate_local_vector uses, so they're the
+ *    vectors of the parallel runs.  With --unfused it's run with
+ *    --unfused too.  It prints the result with %lf,
+ *    which is exact here:  the products of the integer elements
+ *    and scalar are integers, and so are their sums.
+ */
+static void Serial_reference(
+      Params_t*  params  /* in  */,
+      size_t     n       /* in  */,
+      double*    ref_p   /* out */) {
+   char* engines[] = {"splitmix", "philox", "xoshiro"};
+   char cmd[512], line[256];
+   int found = 0;
+   FILE* fp;
+
+   snprintf(cmd, sizeof(cmd), "printf '%zu\\n%d\\n%d\\n' | '%s' --seed "
+         "%llu --rng %s%s", n, params->randmax, params->scalar,
+         params->serial, (unsigned long long) params->seed,
+         engines[rng_engine], params->unfused ? " --unfused" : "");
+   fflush(stdout);
+   fp = popen(cmd, "r");
+   if (fp == NULL) {
+      Record_error(ERR_SERIAL);
+      return;
+   }
+   while (fgets(line, sizeof(line), fp) != NULL)
+      if (sscanf(line, "Result of dot product: %lf", ref_p) == 1)
+         found = 1;
+   if (pclose(fp) != 0 || !found) Record_error(ERR_SERIAL);
+}  /* Serial_reference */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Print_regress_row
+ * Purpose:   Check one run of the regression and print its row
+ * In args:   params:    the run parameters
+ *            row:       n, procs and rates of the run
+ *            result:    its dot product
+ *            ref:       the serial dot product
+ *            abs_sum:   sum of |x_i*y_i| of the scaled vectors
+ *            t:         its time
+ *            base:      the baseline rows
+ *            num_base:  number of baseline rows (< 0 if there's no
+ *                       baseline file)
+ * Ret val:   1 if the result is wrong or the run is slower than its
+ *            baseline by more than the margin, 0 otherwise
+ *
+ * Notes:
+ * 1. The binned sum and int64 elements are exact modes:  the result
+ *    doesn't depend on the order of the additions, so it has to be
+ *    within REGRESS_ULPS ulps of ref, and nothing else is allowed.
+ *    The other modes (naive, comp and pairwise, even on one process,
+ *    whose SIMD kernels and threads don't add in the serial order)
+ *    get the forward error bound of two recursive sums of n terms,
+ *    the serial one and the parallel one,
+ *       |result - ref| <= 2*(n-1)*u*sum |x_i*y_i|,
+ *    with u the unit roundoff of acc_t (of both for float elements).
+ * 2. The serial sum is exact while sum |x_i*y_i| < 2^53, since the
+ *    terms are integers.  Past that ref has its own rounding error,
+ *    (n-1)*u*sum |x_i*y_i|, which the exact modes are allowed too.
+ */
+static int Print_regress_row(
+      Params_t*       params    /* in */,
+      Regress_row_t*  row       /* in */,
+      double          result    /* in */,
+      double          ref       /* in */,
+      double          abs_sum   /* in */,
+      double          t         /* in */,
+      Regress_row_t   base[]    /* in */,
+      int             num_base  /* in */) {
+   double u = (sizeof(acc_t) == sizeof(float) ? FLT_EPSILON
+         : DBL_EPSILON)/2;
+   double ulp = nextafter(fabs(ref), INFINITY) - fabs(ref);
+   double diff = fabs(result - ref);
+   double keep = 1 - params->margin/100;
+   double terms = row->n > 1 ? row->n - 1 : 0;
+   double bound = REGRESS_ULPS*ulp;
+#  ifdef ELEM_INT64
+   int exact = 1;
+#  else
+   int exact = params->sum == SUM_BINNED;
+#  endif
+   int ok, slow = 0, k;
+   Regress_row_t* b = NULL;
+
+   // ref's own error, which is 0 in the exact modes while the integer
+   // partial sums fit in a double (note 2)
+   if (!exact || abs_sum >= 0x1p53) bound += terms*(DBL_EPSILON/2)*abs_sum;
+   if (!exact) bound += terms*u*abs_sum;
+   ok = diff <= bound;
+   for (k = 0; k < num_base; k++)
+      if (base[k].n == row->n && base[k].procs == row->procs) b = &base[k];
+   if (b != NULL)
+      slow = row->gb_s < keep*b->gb_s || row->speedup < keep*b->speedup;
+   printf("%14lld %6d %20.6f %8.1f %6s %11.3e %9.3f %8.2f ", row->n,
+         row->procs, result, diff/ulp, ok ? "ok" : "FAIL", t, row->gb_s,
+         row->speedup);
+   if (b != NULL)
+      printf("%9.3f %7s\n", b->gb_s, slow ? "SLOW" : "ok");
+   else
+      printf("%9s %7s\n", "-", "new");
+   return !ok || slow;
+}  /* Print_regress_row */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Read_baseline
+ * Purpose:   Read the "n procs gb_s speedup" lines of a baseline file
+ * In arg:    fname:  name of the file
+ * Out arg:   base:   the rows, at most MAX_SWEEP*MAX_SWEEP
+ * Ret val:   the number of rows, or -1 if the file can't be opened
+ */
+static int Read_baseline(
+      char           fname[]  /* in  */,
+      Regress_row_t  base[]   /* out */) {
+   FILE* fp = fopen(fname, "r");
+   int k = 0;
+
+   if (fp == NULL) return -1;
+   while (k < MAX_SWEEP*MAX_SWEEP && fscanf(fp, "%lld %d %lf %lf",
+            &base[k].n, &base[k].procs, &base[k].gb_s, &base[k].speedup)
+         == 4)
+      k++;
+   fclose(fp);
+   return k;
+}  /* Read_baseline */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Write_baseline
+ * Purpose:   Write the rows of a regression as a baseline file
+ * In args:   fname:     name of the file
+ *            rows:      the rows
+ *            num_rows:  number of rows
+ * Errors:    If the file can't be written ERR_FILE_WRITE is recorded.
+ */
+static void Write_baseline(
+      char           fname[]   /* in */,
+      Regress_row_t  rows[]    /* in */,
+      int            num_rows  /* in */) {
+   FILE* fp = fopen(fname, "w");
+   int k;
+
+   if (fp == NULL) {
+      Record_error(ERR_FILE_WRITE);
+      return;
+   }
+   for (k = 0; k < num_rows; k++)
+      fprintf(fp, "%lld %d %.6g %.6g\n", rows[k].n, rows[k].procs,
+            rows[k].gb_s, rows[k].speedup);
+   if (fclose(fp) != 0) Record_error(ERR_FILE_WRITE);
+   else printf("Baseline written to %s\n", fname);
+}  /* Write_baseline */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Block_range
+ * Purpose:   Find the block of a vector of order n assigned to a
+ *            process.  The first n % comm_sz processes get
+ *            ceil(n/comm_sz) elements and the rest get floor(n/comm_sz).
+ * In args:   n:        order of the vector
+ *            comm_sz:  number of processes
+ *            rank:     the process
+ * Out args:  first_p:  global index of the process' first element
+ *            count_p:  number of elements assigned to the process
+ */
+static void Block_range(
+      size_t   n        /* in  */,
+      int      comm_sz  /* in  */,
+      int      rank     /* in  */,
+      size_t*  first_p  /* out */,
+      size_t*  count_p  /* out */) {
+   size_t quotient = n/comm_sz;
+   size_t remainder = n % comm_sz;
+
+   *count_p = quotient + ((size_t) rank < remainder ? 1 : 0);
+   *first_p = rank*quotient + ((size_t) rank < remainder ? (size_t) rank : remainder);
+}  /* Block_range */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Block_owner
+ * Purpose:   Find the process whose block contains global index i
+ * In args:   n:        order of the vector
+ *            comm_sz:  number of processes
+ *            i:        global index, 0 <= i < n
+ * Ret val:   rank of the owner of element i
+ */
+static int Block_owner(
+      size_t  n        /* in */,
+      int     comm_sz  /* in */,
+      size_t  i        /* in */) {
+   size_t quotient = n/comm_sz;
+   size_t remainder = n % comm_sz;
+   size_t split = remainder*(quotient + 1);
+
+   if (i < split)
+      return i/(quotient + 1);
+   return remainder + (i - split)/quotient;
+}  /* Block_owner */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Thread_block
+ * Purpose:   Find the contiguous part of a process' block that the
+ *            calling thread works on.  Every loop over the local
+ *            vectors uses this split, so each thread keeps coming back
+ *            to the same elements.
+ * In arg:    n:        number of elements in the process' block
+ * Out args:  first_p:  index of the thread's first element
+ *            count_p:  number of elements assigned to the thread
+ *
+ * Note:
+ *    Outside a parallel region, or without OpenMP, the calling thread
+ *    gets the whole block.
+ */
+static void Thread_block(
+      size_t   n        /* in  */,
+      size_t*  first_p  /* out */,
+      size_t*  count_p  /* out */) {
+#  ifdef _OPENMP
+   Block_range(n, omp_get_num_threads(), omp_get_thread_num(), first_p,
+         count_p);
+#  else
+   *first_p = 0;
+   *count_p = n;
+#  endif
+}  /* Thread_block */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Print_layout
+ * Purpose:   Print the node and number of threads of every process
+ * In args:   my_rank:  calling process' rank in comm
+ *            comm_sz:  number of processes in comm
+ *            comm:     communicator containing the calling processes
+ *
+ * Note:
+ *    Process 0 gathers the names and thread counts of all the
+ *    processes, and the allocation of their storage is checked before
+ *    the gathers.
+ */
+static void Print_layout(
+      int       my_rank  /* in */,
+      int       comm_sz  /* in */,
+      MPI_Comm  comm     /* in */) {
+   char name[MPI_MAX_PROCESSOR_NAME];
+   char* names = NULL;
+   int len, num_t = 1, q;
+   int* all_t = NULL;
+
+   memset(name, 0, sizeof(name));
+   MPI_Get_processor_name(name, &len);
+#  ifdef _OPENMP
+   num_t = omp_get_max_threads();
+#  endif
+   if (my_rank == 0) {
+      names = malloc(comm_sz*MPI_MAX_PROCESSOR_NAME);
+      all_t = malloc(comm_sz*sizeof(int));
+      if (names == NULL || all_t == NULL) Record_error(ERR_ALLOC_TEMP);
+   }
+   Check_errors(comm);
+
+   MPI_Gather(name, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, names,
+         MPI_MAX_PROCESSOR_NAME, MPI_CHAR, 0, comm);
+   MPI_Gather(&num_t, 1, MPI_INT, all_t, 1, MPI_INT, 0, comm);
+   if (my_rank == 0) {
+      printf("%d processes\n", comm_sz);
+      for (q = 0; q < comm_sz; q++)
+         printf("Proc %d > node %s, %d thread(s)\n", q,
+               names + q*MPI_MAX_PROCESSOR_NAME, all_t[q]);
+   }
+   free(names);
+   free(all_t);
+}  /* Print_layout */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Record_error
+ * Purpose:   Note that the calling process has found an error.  The
+ *            error isn't acted on until the next Check_errors.
+ * In arg:    err:  one of the ERR_ bits
+ *
+ * Note:
+ *    Code that records an error has to leave the process in a state
+ *    where it can safely get to the next Check_errors (e.g., skip
+ *    touching a block that couldn't be allocated).
+ */
+static void Record_error(int err /* in */) {
+   local_errors |= err;
+}  /* Record_error */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Check_errors
+ * Purpose:   Check whether any process has recorded an error.  If so,
+ *            print a message for each kind of error and terminate all
+ *            processes.  Otherwise, continue execution.
+ * In arg:    comm:  communicator containing processes calling
+ *                   Check_errors:  should be MPI_COMM_WORLD.
+ *
+ * Note:
+ *    The error bits of all the processes are combined with one
+ *    MPI_Allreduce, so this should be called at the end of a phase
+ *    rather than after every step that can fail.
+ */
+static void Check_errors(MPI_Comm comm /* in */) {
+   struct {
+      int   err;
+      char* fname;
+      char* message;
+   } table[] = {
+      {ERR_ALLOC_VECTOR, "Allocate_vector", "Can't allocate local vector"},
+      {ERR_ALLOC_TEMP, "Generate_vector", "Can't allocate temporary vector"},
+      {ERR_ALLOC_BENCH, "Benchmark", "Can't allocate benchmark buffers"},
+      {ERR_FILE_READ, "Read_vector_file", "Can't read vector file"},
+      {ERR_FILE_WRITE, "Write_vector_file", "Can't write vector file"},
+      {ERR_SERIAL, "Serial_reference", "Can't run the serial program"}
+   };
+   int errors, my_rank, i;
+
+   MPI_Allreduce(&local_errors, &errors, 1, MPI_INT, MPI_BOR, comm);
+   if (errors != 0) {
+      MPI_Comm_rank(comm, &my_rank);
+      if (my_rank == 0) {
+         for (i = 0; i < (int) (sizeof(table)/sizeof(table[0])); i++)
+            if (errors & table[i].err)
+               fprintf(stderr, "Proc %d > In %s, %s\n", my_rank,
+                     table[i].fname, table[i].message);
+         fflush(stderr);
+      }
+      MPI_Finalize();
+      exit(-1);
+   }
+}  /* Check_errors */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Default_params
+ * Purpose:   Set every parameter to its default value
+ * Out arg:   params:  the parameters
+ */
+static void Default_params(Params_t* params /* out */) {
+   memset(params, 0, sizeof(Params_t));
+   params->ops = OP_ALL;
+   params->gen = GEN_LOCAL;
+   params->chunk = PIPE_CHUNK;
+   params->batch = 1;
+   params->warmup = 1;
+   params->format = FORMAT_TEXT;
+   params->margin = 10.0;
+   strcpy(params->serial, "./vector_add2");
+}  /* Default_params */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Set_param
+ * Purpose:   Set one parameter from a key and a string value.  The
+ *            config file, the environment and the command line all go
+ *            through here.
+ * In args:   key:     name of the parameter (e.g., "n" or "ops")
+ *            value:   its value
+ * In/out:    params:  the parameters
+ * Ret val:   1 if the parameter was set, 0 if the key or the value is
+ *            bad (params->error then says why)
+ */
+static int Set_param(
+      Params_t*  params  /* in/out */,
+      char       key[]   /* in     */,
+      char       value[] /* in     */) {
+   char* end = NULL;
+   char* tok;
+   char list[128];
+
+   if (strcmp(key, "unfused") == 0 || strcmp(key, "help") == 0
+         || strcmp(key, "hier") == 0 || strcmp(key, "shm") == 0
+         || strcmp(key, "offload") == 0) {
+      int on = value == NULL || strcmp(value, "0") != 0;
+      if (key[0] == 'u') params->unfused = on;
+      else if (key[0] == 's') params->shm = on;
+      else if (key[0] == 'o') params->offload = on;
+      else if (key[1] == 'i') params->hier = on;
+      else params->help = on;
+      return 1;
+   }
+   if (value == NULL || value[0] == '\0') {
+      snprintf(params->error, sizeof(params->error),
+            "missing value for %s", key);
+      return 0;
+   }
+   if (strcmp(key, "n") == 0) {
+      params->n = strtoll(value, &end, 10);
+      params->have |= HAVE_N;
+   } else if (strcmp(key, "randmax") == 0) {
+      params->randmax = strtol(value, &end, 10);
+      params->have |= HAVE_RANDMAX;
+   } else if (strcmp(key, "scalar") == 0) {
+      params->scalar = strtol(value, &end, 10);
+      params->have |= HAVE_SCALAR;
+   } else if (strcmp(key, "seed") == 0) {
+      params->seed = strtoull(value, &end, 10);
+      params->have |= HAVE_SEED;
+   } else if (strcmp(key, "threads") == 0) {
+      params->threads = strtol(value, &end, 10);
+   } else if (strcmp(key, "xin") == 0 || strcmp(key, "yin") == 0
+         || strcmp(key, "xout") == 0 || strcmp(key, "yout") == 0) {
+      char* path;
+
+      if (key[0] == 'x') path = key[1] == 'i' ? params->xin : params->xout;
+      else path = key[1] == 'i' ? params->yin : params->yout;
+
+      if (strlen(value) >= sizeof(params->xin)) end = value;
+      else strcpy(path, value);
+   } else if (strcmp(key, "expr") == 0) {
+      if (strlen(value) >= sizeof(params->expr)) end = value;
+      else strcpy(params->expr, value);
+   } else if (strcmp(key, "trace") == 0) {
+      if (strlen(value) >= sizeof(params->trace)) end = value;
+      else strcpy(params->trace, value);
+   } else if (strcmp(key, "regress") == 0) {
+      if (strlen(value) >= sizeof(params->regress)) end = value;
+      else strcpy(params->regress, value);
+   } else if (strcmp(key, "checkpoint") == 0
+         || strcmp(key, "restart") == 0) {
+      char* path = key[0] == 'c' ? params->checkpoint : params->restart;
+
+      if (strlen(value) >= sizeof(params->checkpoint)) end = value;
+      else strcpy(path, value);
+   } else if (strcmp(key, "margin") == 0) {
+      params->margin = strtod(value, &end);
+   } else if (strcmp(key, "serial") == 0) {
+      if (strlen(value) >= sizeof(params->serial) || strchr(value, '\''))
+         end = value;
+      else strcpy(params->serial, value);
+   } else if (strcmp(key, "batch") == 0) {
+      params->batch = strtoll(value, &end, 10);
+   } else if (strcmp(key, "tile") == 0) {
+      params->tile = strtoll(value, &end, 10);
+   } else if (strcmp(key, "chunk") == 0) {
+      params->chunk = strtoll(value, &end, 10);
+   } else if (strcmp(key, "bench") == 0) {
+      params->reps = strtol(value, &end, 10);
+   } else if (strcmp(key, "warmup") == 0) {
+      params->warmup = strtol(value, &end, 10);
+   } else if (strcmp(key, "format") == 0) {
+      if (strcmp(value, "text") == 0) params->format = FORMAT_TEXT;
+      else if (strcmp(value, "csv") == 0) params->format = FORMAT_CSV;
+      else if (strcmp(value, "json") == 0) params->format = FORMAT_JSON;
+      else end = value;
+   } else if (strcmp(key, "rng") == 0) {
+      if (Rng_engine(value) >= 0) params->rng = Rng_engine(value);
+      else end = value;
+   } else if (strcmp(key, "sum") == 0) {
+      if (strcmp(value, "naive") == 0) params->sum = SUM_NAIVE;
+      else if (strcmp(value, "comp") == 0) params->sum = SUM_COMP;
+      else if (strcmp(value, "pairwise") == 0) params->sum = SUM_PAIRWISE;
+      else if (strcmp(value, "binned") == 0) params->sum = SUM_BINNED;
+      else end = value;
+   } else if (strcmp(key, "reduce") == 0) {
+      if (strcmp(value, "reduce") == 0) params->reduce = REDUCE_ROOT;
+      else if (strcmp(value, "allreduce") == 0) params->reduce = REDUCE_ALL;
+      else if (strcmp(value, "iallreduce") == 0)
+         params->reduce = REDUCE_IALL;
+      else end = value;
+   } else if (strcmp(key, "sweep") == 0) {
+      if (strcmp(value, "strong") == 0) params->sweep = SWEEP_STRONG;
+      else if (strcmp(value, "weak") == 0) params->sweep = SWEEP_WEAK;
+      else end = value;
+   } else if (strcmp(key, "sizes") == 0 || strcmp(key, "procs") == 0) {
+      int is_sizes = key[0] == 's', count = 0;
+
+      snprintf(list, sizeof(list), "%s", value);
+      for (tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ",")) {
+         if (count == MAX_SWEEP) {
+            end = value;
+            break;
+         }
+         if (is_sizes) params->sizes[count++] = strtoll(tok, &end, 10);
+         else params->procs[count++] = strtol(tok, &end, 10);
+         if (*end != '\0') {
+            end = value;
+            break;
+         }
+      }
+      if (is_sizes) {
+         params->num_sizes = count;
+         params->have |= HAVE_N;
+      } else {
+         params->num_procs = count;
+      }
+   } else if (strcmp(key, "gen") == 0) {
+      if (strcmp(value, "local") == 0) params->gen = GEN_LOCAL;
+      else if (strcmp(value, "scatter") == 0) params->gen = GEN_SCATTER;
+      else if (strcmp(value, "pipeline") == 0) params->gen = GEN_PIPELINE;
+      else end = value;
+   } else if (strcmp(key, "ops") == 0) {
+      params->ops = 0;
+      snprintf(list, sizeof(list), "%s", value);
+      for (tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ",")) {
+         if (strcmp(tok, "print") == 0) params->ops |= OP_PRINT;
+         else if (strcmp(tok, "scale") == 0) params->ops |= OP_SCALE;
+         else if (strcmp(tok, "dot") == 0) params->ops |= OP_DOT;
+         else if (strcmp(tok, "all") == 0) params->ops |= OP_ALL;
+         else if (strcmp(tok, "add") == 0) params->ops |= OP_ADD;
+         else if (strcmp(tok, "axpy") == 0) params->ops |= OP_AXPY;
+         else if (strcmp(tok, "mul") == 0) params->ops |= OP_MUL;
+         else if (strcmp(tok, "norm") == 0) params->ops |= OP_NORM;
+         else if (strcmp(tok, "max") == 0) params->ops |= OP_MAX;
+         else end = value;
+      }
+   } else {
+      snprintf(params->error, sizeof(params->error),
+            "unknown option %s", key);
+      return 0;
+   }
+   if (end != NULL && *end != '\0') {
+      snprintf(params->error, sizeof(params->error),
+            "bad value %s for %s", value, key);
+      return 0;
+   }
+   return 1;
+}  /* Set_param */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Read_config_file
+ * Purpose:   Read "key = value" lines from a file.  Blank lines and
+ *            lines starting with # are skipped.
+ * In arg:    path:    name of the file
+ * In/out:    params:  the parameters
+ */
+static void Read_config_file(
+      Params_t*  params  /* in/out */,
+      char       path[]  /* in     */) {
+   FILE* fp = fopen(path, "r");
+   char line[256];
+   char *key, *value, *eq;
+
+   if (fp == NULL) {
+      snprintf(params->error, sizeof(params->error),
+            "can't open config file %s", path);
+      return;
+   }
+   while (params->error[0] == '\0' && fgets(line, sizeof(line), fp)) {
+      key = strtok(line, " \t\r\n");
+      if (key == NULL || key[0] == '#') continue;
+      eq = strchr(key, '=');
+      if (eq != NULL) {
+         *eq = '\0';
+         value = eq[1] != '\0' ? eq + 1 : strtok(NULL, " \t\r\n");
+      } else {
+         value = strtok(NULL, " \t\r\n");
+         if (value != NULL && strcmp(value, "=") == 0)
+            value = strtok(NULL, " \t\r\n");
+         else if (value != NULL && value[0] == '=')
+            value++;
+      }
+      Set_param(params, key, value);
+   }
+   fclose(fp);
+}  /* Read_config_file */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Read_env_params
+ * Purpose:   Read VEC_<KEY> environment variables
+ * In/out:    params:  the parameters
+ */
+static void Read_env_params(Params_t* params /* in/out */) {
+   char* keys[] = {"n", "randmax", "scalar", "seed", "rng", "ops",
+      "threads", "gen", "chunk", "expr", "batch", "tile", "xin", "yin", "xout", "yout",
+      "unfused", "sum", "reduce", "hier", "shm", "offload", "trace",
+      "bench", "warmup", "format", "sweep", "sizes", "procs", "regress",
+      "margin", "serial", "checkpoint", "restart"};
+   char name[32];
+   char* value;
+   int i, j;
+
+   for (i = 0; i < (int) (sizeof(keys)/sizeof(keys[0])); i++) {
+      snprintf(name, sizeof(name), "VEC_%s", keys[i]);
+      for (j = 4; name[j] != '\0'; j++)
+         if (name[j] >= 'a' && name[j] <= 'z') name[j] += 'A' - 'a';
+      value = getenv(name);
+      if (value != NULL && !Set_param(params, keys[i], value)) return;
+   }
+}  /* Read_env_params */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Read_args
+ * Purpose:   Read options from the command line
+ * In args:   argc, argv:  command line
+ * In/out:    params:      the parameters
+ *
+ * Note:
+ *    --config is handled by Read_params, so it's skipped here.
+ */
+static void Read_args(
+      Params_t*  params  /* in/out */,
+      int        argc    /* in     */,
+      char*      argv[]  /* in     */) {
+   char key[32];
+   char* value;
+   char* eq;
+   int i;
+
+   for (i = 1; i < argc && params->error[0] == '\0'; i++) {
+      char* arg = argv[i];
+
+      if (arg[0] != '-') {
+         snprintf(params->error, sizeof(params->error),
+               "unexpected argument %s", arg);
+         return;
+      }
+      if (arg[1] == '-') {
+         snprintf(key, sizeof(key), "%s", arg + 2);
+      } else {
+         switch (arg[1]) {
+            case 'n': strcpy(key, "n"); break;
+            case 'r': strcpy(key, "randmax"); break;
+            case 's': strcpy(key, "scalar"); break;
+            case 't': strcpy(key, "threads"); break;
+            case 'h': strcpy(key, "help"); break;
+            default: snprintf(key, sizeof(key), "%s", arg + 1);
+         }
+      }
+      value = NULL;
+      eq = strchr(key, '=');
+      if (eq != NULL) {
+         *eq = '\0';
+         value = strchr(arg, '=') + 1;
+      } else if (strcmp(key, "unfused") != 0 && strcmp(key, "help") != 0
+            && strcmp(key, "hier") != 0 && strcmp(key, "shm") != 0
+            && strcmp(key, "offload") != 0
+            && i + 1 < argc) {
+         value = argv[++i];
+      }
+      if (strcmp(key, "config") == 0) continue;
+      Set_param(params, key, value);
+   }
+}  /* Read_args */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Prompt_missing
+ * Purpose:   Ask on stdin for n, randmax and the scalar if they
+ *            weren't given, and pick a seed from the clock
+ * In/out:    params:  the parameters
+ */
+static void Prompt_missing(Params_t* params /* in/out */) {
+   if (!(params->have & HAVE_N)) {
+      printf("What's the order of the vectors?\n");
+      if (scanf("%lld", &params->n) != 1) params->n = -1;
+   }
+   if (!(params->have & HAVE_RANDMAX)) {
+      printf("What's the max number for random?\n");
+      if (scanf("%d", &params->randmax) != 1) params->randmax = -1;
+   }
+   if (!(params->have & HAVE_SCALAR) && ((params->ops & (OP_SCALE|OP_AXPY))
+            || ((params->ops & OP_EXPR) && params->prog.scalar))) {
+      printf("\nWhat's the number for the scalar?\n");
+      if (scanf("%d", &params->scalar) != 1) params->scalar = 0;
+   }
+   if (!(params->have & HAVE_SEED))
+      params->seed = (uint64_t) time(NULL);
+}  /* Prompt_missing */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Read_input_sizes
+ * Purpose:   Take n from the headers of the --xin and --yin files.  If
+ *            both vectors are read, randmax isn't needed.
+ * In/out:    params:  the parameters; params->error is set if a file
+ *                     can't be read, the files' sizes differ, or n was
+ *                     given (-n, the environment or a config file) and
+ *                     isn't the files' size
+ */
+static void Read_input_sizes(Params_t* params /* in/out */) {
+   long long n_x, n_y;
+   int given_n = (params->have & HAVE_N) && params->num_sizes == 0;
+
+   if (params->xin[0] != '\0') {
+      if (!Read_vec_header(params->xin, &n_x, params->error)) return;
+      if (given_n && params->n != n_x) {
+         strcpy(params->error, "n doesn't match xin");
+         return;
+      }
+      params->n = n_x;
+      params->have |= HAVE_N;
+   }
+   if (params->yin[0] != '\0') {
+      if (!Read_vec_header(params->yin, &n_y, params->error)) return;
+      if (params->xin[0] != '\0' && n_y != n_x) {
+         strcpy(params->error, "xin and yin have different sizes");
+         return;
+      }
+      if (given_n && params->n != n_y) {
+         strcpy(params->error, "n doesn't match yin");
+         return;
+      }
+      params->n = n_y;
+      params->have |= HAVE_N;
+   }
+   if (params->xin[0] != '\0' && params->yin[0] != '\0'
+         && !(params->have & HAVE_RANDMAX)) {
+      params->randmax = 1;
+      params->have |= HAVE_RANDMAX;
+   }
+}  /* Read_input_sizes */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Read_params
+ * Purpose:   Get the run parameters on process 0 and broadcast them
+ *            to the other processes with one MPI_Bcast
+ * In args:   argc, argv:  command line
+ *            my_rank:     process rank in communicator
+ *            comm:        communicator containing all the processes
+ * Out arg:   params:      the parameters
+ *
+ * Errors:    bad options or values, n < 0, randmax <= 0 or scaling
+ *            study process counts outside 1..comm_sz.  Since every
+ *            process checks the same broadcast values, no extra
+ *            communication is needed to agree on quitting.
+ *
+ * Note:
+ *    Params_t is broadcast as MPI_BYTEs, which assumes all the nodes
+ *    have the same data representation.
+ */
+static void Read_params(
+      Params_t*  params   /* out */,
+      int        argc     /* in  */,
+      char*      argv[]   /* in  */,
+      int        my_rank  /* in  */,
+      MPI_Comm   comm     /* in  */) {
+   char* config;
+   int comm_sz, i;
+
+   MPI_Comm_size(comm, &comm_sz);
+   if (my_rank == 0) {
+      Default_params(params);
+      config = getenv("VEC_CONFIG");
+      for (i = 1; i < argc; i++)
+         if (strcmp(argv[i], "--config") == 0 && i + 1 < argc)
+            config = argv[i+1];
+         else if (strncmp(argv[i], "--config=", 9) == 0)
+            config = argv[i] + 9;
+      if (config != NULL) Read_config_file(params, config);
+      if (params->error[0] == '\0') Read_env_params(params);
+      if (params->error[0] == '\0') Read_args(params, argc, argv);
+      if (params->error[0] == '\0' && params->help) Usage(argv[0]);
+      if (params->error[0] == '\0' && !params->help) Read_input_sizes(params);
+      if (params->error[0] == '\0' && !params->help
+            && params->restart[0] != '\0')
+         Read_checkpoint(params);
+      if (params->error[0] == '\0' && !params->help && params->expr[0] != '\0'
+            && Expr_compile(params->expr, &params->prog, params->error))
+         params->ops = (params->ops & OP_PRINT) | OP_EXPR;
+      if (params->error[0] == '\0' && !params->help) {
+         Prompt_missing(params);
+         if (params->n < 0)
+            strcpy(params->error, "n should be >= 0");
+         else if (params->randmax <= 0)
+            strcpy(params->error, "randmax should be > 0");
+         else if (params->threads < 0)
+            strcpy(params->error, "threads should be >= 0");
+         else if (params->chunk <= 0)
+            strcpy(params->error, "chunk should be > 0");
+         else if (params->tile < 0)
+            strcpy(params->error, "tile should be >= 0");
+         else if (params->batch <= 0 || params->batch > INT_MAX)
+            strcpy(params->error, "batch should be > 0");
+         else if (params->margin < 0 || params->margin >= 100)
+            strcpy(params->error, "margin should be in [0, 100)");
+         else if (params->reps < 0 || params->warmup < 0)
+            strcpy(params->error, "bench and warmup should be >= 0");
+         else
+            Check_conflicts(params);
+         for (i = 0; i < params->num_sizes; i++)
+            if (params->sizes[i] < 0)
+               strcpy(params->error, "sizes should be >= 0");
+         for (i = 0; i < params->num_procs; i++)
+            if (params->procs[i] < 1 || params->procs[i] > comm_sz)
+               strcpy(params->error, "procs should be in 1..comm_sz");
+         if (params->sweep != SWEEP_NONE || params->regress[0]) {
+            if (params->num_sizes == 0) {
+               params->sizes[0] = params->n;
+               params->num_sizes = 1;
+            }
+            if (params->reps == 0) params->reps = params->regress[0] ? 5 : 1;
+         }
+      }
+   }
+   MPI_Bcast(params, sizeof(Params_t), MPI_BYTE, 0, comm);
+
+   if (params->error[0] != '\0' || params->help) {
+      if (my_rank == 0 && params->error[0] != '\0') {
+         fprintf(stderr, "Proc %d > In Read_params, %s\n", my_rank,
+               params->error);
+         fflush(stderr);
+      }
+      MPI_Finalize();
+      exit(params->help ? 0 : -1);
+   }
+}  /* Read_params */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Use_bits
+ * Purpose:   Find the options and modes a run has
+ * In arg:    params:  the run parameters
+ * Ret val:   their USE_ bits
+ */
+static int Use_bits(Params_t* params /* in */) {
+   int use = 0;
+
+   if (params->reps > 0) use |= USE_BENCH;
+   if (params->sweep != SWEEP_NONE) use |= USE_SWEEP;
+   if (params->gen != GEN_LOCAL) use |= USE_GEN;
+   if (params->gen == GEN_PIPELINE) use |= USE_PIPELINE;
+   if (params->tile > 0) use |= USE_TILE;
+   if (params->batch > 1) use |= USE_BATCH;
+   if (params->xin[0] || params->yin[0] || params->xout[0]
+         || params->yout[0])
+      use |= USE_FILES;
+   if (params->xin[0] || params->yin[0]) use |= USE_XYIN;
+   if (params->ops & OP_BLAS) use |= USE_BLAS;
+   if (params->ops & (OP_NORM | OP_MAX)) use |= USE_NORM_MAX;
+   if (params->ops & OP_EXPR) use |= USE_EXPR;
+   if (params->hier) use |= USE_HIER;
+   if (params->reduce == REDUCE_IALL) use |= USE_IALL;
+   if (params->shm) use |= USE_SHM;
+   if (params->offload) use |= USE_OFFLOAD;
+#  ifndef _OPENMP
+   use |= USE_NO_OPENMP;
+#  endif
+   if (params->sum != SUM_NAIVE) use |= USE_SUM;
+   if (params->rng != RNG_SPLITMIX) use |= USE_RNG;
+   if (params->regress[0]) use |= USE_REGRESS;
+   if (params->checkpoint[0] || params->restart[0]) use |= USE_CKPT;
+   if (params->restart[0]) use |= USE_RESTART;
+   return use;
+}  /* Use_bits */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Check_conflicts
+ * Purpose:   Refuse a run with options that can't be used together
+ * In/out:    params:  the run parameters; error gets the message of
+ *                     the first row of conflicts that matches
+ */
+static void Check_conflicts(Params_t* params /* in/out */) {
+   int use = Use_bits(params);
+   size_t i;
+
+   for (i = 0; i < sizeof(conflicts)/sizeof(conflicts[0]); i++)
+      if ((use & conflicts[i].option) && (use & conflicts[i].conflicts)) {
+         strcpy(params->error, conflicts[i].message);
+         return;
+      }
+}  /* Check_conflicts */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Usage
+ * Purpose:   Print the command line options
+ * In arg:    prog_name:  name of the executable
+ */
+static void Usage(char prog_name[] /* in */) {
+   fprintf(stderr, "usage: mpiexec -n <comm_sz> %s [options]\n",
+         prog_name);
+   fprintf(stderr, "   -n, --n N            order of the vectors\n");
+   fprintf(stderr, "   -r, --randmax R      random numbers are in [0, R)\n");
+   fprintf(stderr, "   -s, --scalar S       scalar for x and y\n");
+   fprintf(stderr, "   --seed SEED          seed for the generator\n");
+   fprintf(stderr, "   --rng splitmix|philox|xoshiro  random number engine\n");
+   fprintf(stderr, "   --ops LIST           print,scale,dot (default all),\n");
+   fprintf(stderr, "                        add,axpy,mul,norm,max\n");
+   fprintf(stderr, "   -t, --threads T      OpenMP threads per process\n");
+   fprintf(stderr, "   --gen local|scatter|pipeline  how x and y are generated\n");
+   fprintf(stderr, "   --chunk C            elements per pipelined message\n");
+   fprintf(stderr, "   --xin, --yin FILE    read x or y from a vector file\n");
+   fprintf(stderr, "   --xout, --yout FILE  write x or y to a vector file\n");
+   fprintf(stderr, "   --expr PROG          fused program, e.g. \"dot(s*x, s*y)\"\n");
+   fprintf(stderr, "   --batch K            K vector pairs, one reduction\n");
+   fprintf(stderr, "   --tile T             stream x and y in tiles of T\n");
+   fprintf(stderr, "   --unfused            don't fuse scaling and dot\n");
+   fprintf(stderr, "   --sum naive|comp|pairwise|binned  dot accumulation\n");
+   fprintf(stderr, "   --reduce reduce|allreduce|iallreduce  dot reduction\n");
+   fprintf(stderr, "   --hier               reduce in each node, then across\n");
+   fprintf(stderr, "   --shm                vectors in node shared memory\n");
+   fprintf(stderr, "   --offload            x and y on an OpenMP device\n");
+   fprintf(stderr, "   --trace FILE         Chrome trace of phases and MPI\n");
+   fprintf(stderr, "   --config FILE        read key = value lines\n");
+   fprintf(stderr, "   --bench R            time each phase R times\n");
+   fprintf(stderr, "   --warmup W           untimed runs first (default 1)\n");
+   fprintf(stderr, "   --format text|csv|json  benchmark report format\n");
+   fprintf(stderr, "   --sweep strong|weak  scaling study\n");
+   fprintf(stderr, "   --sizes LIST         n (strong) or n per process (weak)\n");
+   fprintf(stderr, "   --procs LIST         process counts (default 1,2,4,...)\n");
+   fprintf(stderr, "   --regress FILE       check against the serial result and\n");
+   fprintf(stderr, "                        the GB/s and speedup baseline FILE\n");
+   fprintf(stderr, "   --margin PCT         slowdown allowed by --regress (10)\n");
+   fprintf(stderr, "   --serial PATH        serial program of --regress\n");
+   fprintf(stderr, "                        (./vector_add2)\n");
+   fprintf(stderr, "   --checkpoint PREFIX  save x and y after each stage\n");
+   fprintf(stderr, "   --restart PREFIX     resume from the last checkpoint\n");
+   fprintf(stderr, "Keys can also be set with VEC_<KEY> variables, and VEC_CONFIG\n");
+   fprintf(stderr, "names a config file; options override the environment,\n");
+   fprintf(stderr, "which overrides the config file.\n");
+}  /* Usage */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Allocate_vector
+ * Purpose:   Allocate storage for the local block of one vector
+ * In arg:    local_n:  the size of the local vector
+ * Out arg:   local_a_pp:  pointer to memory block to be allocated for
+ *               the local vector
+ *
+ * Errors:    If the allocation fails, ERR_ALLOC_VECTOR is recorded
+ *            and *local_a_pp is NULL
+ *
+ * Notes:
+ * 1. Vectors are allocated one at a time, so a run only pays for the
+ *    vectors its operations use.
+ * 2. The block is aligned to VEC_ALIGN bytes.  mmap only promises page
+ *    alignment, so with -DHUGE_PAGES VEC_ALIGN more bytes are mapped
+ *    and the unaligned head and the rest of the tail are unmapped.
+ *    Each thread then writes one element of every page in its
+ *    Thread_block, so with first-touch placement the pages end up on
+ *    the NUMA node of the thread that will compute on them, instead
+ *    of wherever the first write happens to come from.
+ * 3. Free the block with Free_vector.
+ */
+static void Allocate_vector(
+      elem_t**   local_a_pp  /* out */,
+      size_t     local_n     /* in  */) {
+   size_t bytes = local_n*sizeof(elem_t);
+
+   *local_a_pp = NULL;
+   if (local_n > 0) {
+#     if defined(HUGE_PAGES) && defined(__linux__)
+      size_t len = (bytes + VEC_ALIGN - 1)/VEC_ALIGN*VEC_ALIGN, head;
+      char* a = mmap(NULL, len + VEC_ALIGN, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (a != MAP_FAILED) {
+         head = (VEC_ALIGN - (uintptr_t) a % VEC_ALIGN) % VEC_ALIGN;
+         if (head > 0) munmap(a, head);
+         munmap(a + head + len, VEC_ALIGN - head);
+         madvise(a + head, len, MADV_HUGEPAGE);
+         *local_a_pp = (elem_t*) (a + head);
+      }
+#     else
+      void* a;
+      if (posix_memalign(&a, VEC_ALIGN, bytes) == 0)
+         *local_a_pp = a;
+#     endif
+      if (*local_a_pp == NULL) {
+         Record_error(ERR_ALLOC_VECTOR);
+         return;
+      }
+   }
+#  ifdef BIND_MEMORY
+   Bind_to_local_node(*local_a_pp, bytes);
+#  endif
+   First_touch(*local_a_pp, local_n);
+}  /* Allocate_vector */
+
+
+/*-------------------------------------------------------------------
+ * Function:  First_touch
+ * Purpose:   Write one element of every page of a new block from the
+ *            thread that will compute on it (see Allocate_vector)
+ * In args:   local_n:  the size of the block
+ * Out arg:   local_a:  the block
+ */
+static void First_touch(
+      elem_t  local_a[]  /* out */,
+      size_t  local_n    /* in  */) {
+#  ifdef _OPENMP
+#  pragma omp parallel
+#  endif
+   {
+      size_t first, count, local_i;
+
+      Thread_block(local_n, &first, &count);
+      for (local_i = first; local_i < first + count;
+            local_i += PAGE_ELEMS)
+         local_a[local_i] = 0.0;
+      if (count > 0) local_a[first + count - 1] = 0.0;
+   }
+}  /* First_touch */
+
+
+#ifdef BIND_MEMORY
+/*-------------------------------------------------------------------
+ * Function:  Bind_to_local_node
+ * Purpose:   Bind a memory block that hasn't been touched yet to the
+ *            NUMA node the calling process is running on
+ * In args:   a:      start of the block
+ *            bytes:  size of the block
+ *
+ * Notes:
+ * 1. mbind only takes whole pages, so the block is widened to the
+ *    pages it overlaps.  A block of Allocate_vector shares its first
+ *    and last pages with nothing that matters more, and the blocks of
+ *    Allocate_shared_vector start on pages of their own.
+ * 2. Binding is best effort:  if the node can't be found or the kernel
+ *    rejects the policy, the block keeps the default first-touch
+ *    placement (with -DDEBUG, the first failure is reported).
+ *    Processes should be pinned (e.g., mpirun --bind-to socket) so
+ *    they stay on the node.
+ */
+static void Bind_to_local_node(
+      void*   a      /* in */,
+      size_t  bytes  /* in */) {
+#  if defined(__linux__) && defined(SYS_mbind) && defined(SYS_getcpu)
+   unsigned cpu, node;
+   unsigned long mask[16];
+   unsigned long bits = 8*sizeof(unsigned long);
+   uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE), first, last;
+#  ifdef DEBUG
+   static int warned = 0;
+#  endif
+
+   if (a == NULL || bytes == 0) return;
+   if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0 || node >= 16*bits)
+      return;
+   memset(mask, 0, sizeof(mask));
+   mask[node/bits] = 1UL << (node % bits);
+   first = (uintptr_t) a/page*page;
+   last = ((uintptr_t) a + bytes + page - 1)/page*page;
+   if (syscall(SYS_mbind, (void*) first, last - first, MPOL_BIND, mask,
+            16*bits, 0) != 0) {
+#     ifdef DEBUG
+      if (!warned)
+         fprintf(stderr, "Can't bind memory to node %u: %s\n", node,
+               strerror(errno));
+      warned = 1;
+#     endif
+   }
+#  endif
+}  /* Bind_to_local_node */
+#endif
+
+
+/*-------------------------------------------------------------------
+ * Function:  Free_vector
+ * Purpose:   Free a block allocated by Allocate_vector or
+ *            Allocate_shared_vector
+ * In args:   local_a:  the block
+ *            local_n:  the size of the local vector (only needed to
+ *                      unmap the huge pages of -DHUGE_PAGES, which
+ *                      Allocate_vector trimmed to a whole number of
+ *                      VEC_ALIGN bytes)
+ */
+static void Free_vector(
+      elem_t*  local_a  /* in */,
+      size_t   local_n  /* in */) {
+   int v;
+
+   if (local_a == NULL) return;
+   if ((v = Shm_find(local_a, shm.comm)) >= 0) {
+      // Collective over the node, like Allocate_shared_vector
+      MPI_Win_unlock_all(shm.win[v]);
+      MPI_Win_free(&shm.win[v]);
+      shm.num_vecs--;
+      shm.vec[v] = shm.vec[shm.num_vecs];
+      shm.win[v] = shm.win[shm.num_vecs];
+      return;
+   }
+#  if defined(HUGE_PAGES) && defined(__linux__)
+   munmap(local_a, (local_n*sizeof(elem_t) + VEC_ALIGN - 1)/VEC_ALIGN
+         *VEC_ALIGN);
+#  else
+   (void) local_n;
+   free(local_a);
+#  endif
+}  /* Free_vector */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Shm_init
+ * Purpose:   Find the processes of comm that share a node, for the
+ *            windows of Allocate_shared_vector
+ * In arg:    comm:  communicator of the calling processes
+ * Out arg:   s:     the shared vectors' state
+ *
+ * Note:      Collective over comm.  Errors of the node communicator
+ *            are returned, so a window that can't be allocated is
+ *            recorded like a failed malloc.
+ */
+static void Shm_init(
+      Shm_t*    s     /* out */,
+      MPI_Comm  comm  /* in  */) {
+   MPI_Group group, node_group;
+   int comm_sz, my_rank, q;
+   int* ranks;
+
+   MPI_Comm_size(comm, &comm_sz);
+   MPI_Comm_rank(comm, &my_rank);
+   s->comm = comm;
+   MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, my_rank, MPI_INFO_NULL,
+         &s->node);
+   MPI_Comm_set_errhandler(s->node, MPI_ERRORS_RETURN);
+   s->node_of = malloc(2*comm_sz*sizeof(int));
+   if (s->node_of == NULL) Record_error(ERR_ALLOC_TEMP);
+   Check_errors(comm);
+
+   ranks = s->node_of + comm_sz;
+   for (q = 0; q < comm_sz; q++)
+      ranks[q] = q;
+   MPI_Comm_group(comm, &group);
+   MPI_Comm_group(s->node, &node_group);
+   MPI_Group_translate_ranks(group, comm_sz, ranks, node_group, s->node_of);
+   MPI_Group_free(&node_group);
+   MPI_Group_free(&group);
+   s->num_vecs = 0;
+   s->active = 1;
+}  /* Shm_init */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Shm_free
+ * Purpose:   Free what Shm_init allocated, after the vectors have been
+ *            freed; does nothing if Shm_init wasn't called
+ * In/out:    s:  the shared vectors' state
+ */
+static void Shm_free(Shm_t* s /* in/out */) {
+   if (!s->active) return;
+   free(s->node_of);
+   MPI_Comm_free(&s->node);
+   s->active = 0;
+}  /* Shm_free */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Allocate_shared_vector
+ * Purpose:   Allocate the local block of one vector in a window
+ *            shared by the processes of the node
+ * In arg:    local_n:  the size of the local vector
+ * Out arg:   local_a_pp:  the block
+ *
+ * Errors:    If the window can't be allocated, ERR_ALLOC_VECTOR is
+ *            recorded and *local_a_pp is NULL
+ *
+ * Notes:
+ * 1. Collective over the node, so every process has to allocate the
+ *    same vectors in the same order.  Free the block with Free_vector.
+ * 2. The window is allocated with alloc_shared_noncontig, so each
+ *    process' block can start on a page of its own, and the pages are
+ *    first touched by the process' threads, as in Allocate_vector.
+ * 3. Processes with no elements get one, so every block has an
+ *    address Shm_find can look up.
+ */
+static void Allocate_shared_vector(
+      elem_t**  local_a_pp  /* out */,
+      size_t    local_n     /* in  */) {
+   MPI_Info info;
+   MPI_Aint bytes = (local_n > 0 ? local_n : 1)*sizeof(elem_t);
+   int ok;
+
+   *local_a_pp = NULL;
+   if (shm.num_vecs == SHM_VECS) {
+      Record_error(ERR_ALLOC_VECTOR);
+      return;
+   }
+   MPI_Info_create(&info);
+   MPI_Info_set(info, "alloc_shared_noncontig", "true");
+   ok = MPI_Win_allocate_shared(bytes, sizeof(elem_t), info, shm.node,
+         local_a_pp, &shm.win[shm.num_vecs]) == MPI_SUCCESS;
+   MPI_Info_free(&info);
+   if (!ok) {
+      *local_a_pp = NULL;
+      Record_error(ERR_ALLOC_VECTOR);
+      return;
+   }
+   MPI_Win_lock_all(MPI_MODE_NOCHECK, shm.win[shm.num_vecs]);
+   shm.vec[shm.num_vecs++] = *local_a_pp;
+#  ifdef BIND_MEMORY
+   Bind_to_local_node(*local_a_pp, bytes);
+#  endif
+   First_touch(*local_a_pp, local_n);
+}  /* Allocate_shared_vector */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Shm_find
+ * Purpose:   Find the shared window of a local block
+ * In args:   local_a:  the block
+ *            comm:     communicator the block is distributed over
+ * Ret val:   the index of the window in shm, or -1 if local_a wasn't
+ *            allocated by Allocate_shared_vector or comm isn't the
+ *            communicator of shm
+ */
+static int Shm_find(
+      elem_t    local_a[]  /* in */,
+      MPI_Comm  comm       /* in */) {
+   int v;
+
+   if (!shm.active || comm != shm.comm) return -1;
+   for (v = 0; v < shm.num_vecs; v++)
+      if (shm.vec[v] == local_a) return v;
+   return -1;
+}  /* Shm_find */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Shm_peer
+ * Purpose:   Get the address of another process' block of a shared
+ *            vector
+ * In args:   v:  index of the window (from Shm_find)
+ *            q:  rank of the process in shm.comm
+ * Ret val:   q's block, or NULL if q is on another node
+ */
+static elem_t* Shm_peer(
+      int  v  /* in */,
+      int  q  /* in */) {
+   MPI_Aint bytes;
+   int disp;
+   elem_t* peer;
+
+   if (shm.node_of[q] == MPI_UNDEFINED) return NULL;
+   MPI_Win_shared_query(shm.win[v], shm.node_of[q], &bytes, &disp, &peer);
+   return peer;
+}  /* Shm_peer */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Shm_sync
+ * Purpose:   Make the writes of every process of the node to a shared
+ *            vector visible to the others
+ * In arg:    v:  index of the window (from Shm_find)
+ *
+ * Note:      Collective over the node:  a memory barrier on each side
+ *            of a barrier of the node.
+ */
+static void Shm_sync(int v /* in */) {
+   MPI_Win_sync(shm.win[v]);
+   MPI_Barrier(shm.node);
+   MPI_Win_sync(shm.win[v]);
+}  /* Shm_sync */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Scatter_init
+ * Purpose:   Allocate the counts and displacements of Scatter_remote
+ *            on process 0
+ * In args:   my_rank:  calling process' rank in comm
+ *            comm:     communicator containing the calling processes
+ * Out arg:   s:        the counts and displacements
+ *
+ * Note:      A failed allocation is recorded, and caught by the
+ *            caller's Check_errors.
+ */
+static void Scatter_init(
+      Scatter_t*  s        /* out */,
+      int         my_rank  /* in  */,
+      MPI_Comm    comm     /* in  */) {
+   int comm_sz;
+
+   s->counts = NULL;
+   s->displs = NULL;
+   if (my_rank != 0) return;
+   MPI_Comm_size(comm, &comm_sz);
+   s->counts = malloc(comm_sz*sizeof(*s->counts));
+   s->displs = malloc(comm_sz*sizeof(*s->displs));
+   if (s->counts == NULL || s->displs == NULL) Record_error(ERR_ALLOC_TEMP);
+}  /* Scatter_init */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Scatter_free
+ * Purpose:   Free what Scatter_init allocated
+ * In/out:    s:  the counts and displacements
+ */
+static void Scatter_free(Scatter_t* s /* in/out */) {
+   free(s->counts);
+   free(s->displs);
+   s->counts = NULL;
+   s->displs = NULL;
+}  /* Scatter_free */
+
+
+/*-------------------------------------------------------------------
+ * Function:   Scatter_blocks
+ * Purpose:    Distribute a vector stored on process 0 using the block
+ *             distribution of Block_range.
+ * In args:    a:        the global vector (only used on process 0)
+ *             n:        size of global vector
+ *             local_n:  size of local vector
+ *             my_rank:  calling process' rank in comm
+ *             comm:     communicator containing calling processes
+ * Out arg:    local_a:  local block of the vector
+ *
+ * Notes:
+ * 1. Process 0 copies its own block, and the other blocks go out with
+ *    a single MPI_Scatterv (see Scatter_remote).
+ * 2. If local_a is a shared vector (--shm), process 0 copies the
+ *    blocks of the processes on its node straight into their part of
+ *    the window, and only the other nodes get messages.
+ */
+static void Scatter_blocks(
+      elem_t    a[]        /* in  */,
+      size_t    n          /* in  */,
+      elem_t    local_a[]  /* out */,
+      size_t    local_n    /* in  */,
+      int       my_rank    /* in  */,
+      MPI_Comm  comm       /* in  */) {
+   int comm_sz, q, v = Shm_find(local_a, comm);
+   size_t first, count;
+   elem_t* peer;
+
+   MPI_Comm_size(comm, &comm_sz);
+   if (my_rank == 0)
+      for (q = 0; q < comm_sz; q++) {
+         peer = q == 0 ? local_a : v >= 0 ? Shm_peer(v, q) : NULL;
+         if (peer == NULL) continue;
+         Block_range(n, comm_sz, q, &first, &count);
+         memcpy(peer, a + first, count*sizeof(elem_t));
+      }
+   Scatter_remote(a, n, local_a, local_n, my_rank, v, comm);
+   if (v >= 0 && Shm_peer(v, 0) != NULL) Shm_sync(v);
+}  /* Scatter_blocks */
+
+
+/*-------------------------------------------------------------------
+ * Function:   Scatter_remote
+ * Purpose:    Send the blocks of a vector on process 0 to the
+ *             processes that can't share its memory
+ * In args:    a:        the global vector (only used on process 0)
+ *             n:        size of global vector
+ *             local_n:  size of local vector
+ *             my_rank:  calling process' rank in comm
+ *             v:        index of local_a's window in shm, or -1 if
+ *                       it isn't shared, and then every process but
+ *                       0 gets its block
+ *             comm:     communicator containing calling processes
+ * Out arg:    local_a:  local block of the vector, on the processes
+ *                       that get a message
+ *
+ * Notes:
+ * 1. The blocks go out with MPI_Scatterv, using the counts and
+ *    displacements that Scatter_init allocated.  Process 0 and the
+ *    processes that share its memory get a count of 0.
+ * 2. The counts and displacements are ints, so if n is bigger than
+ *    MAX_COUNT, process 0 sends each block with point-to-point
+ *    messages of at most MAX_COUNT elements instead.
+ */
+static void Scatter_remote(
+      elem_t    a[]        /* in  */,
+      size_t    n          /* in  */,
+      elem_t    local_a[]  /* out */,
+      size_t    local_n    /* in  */,
+      int       my_rank    /* in  */,
+      int       v          /* in  */,
+      MPI_Comm  comm       /* in  */) {
+   int comm_sz, q, shared;
+   size_t first, count, recv_n, done;
+
+   MPI_Comm_size(comm, &comm_sz);
+   recv_n = my_rank == 0 || (v >= 0 && shm.node_of[0] != MPI_UNDEFINED)
+      ? 0 : local_n;
+   if (n <= MAX_COUNT) {
+      if (my_rank == 0)
+         for (q = 0; q < comm_sz; q++) {
+            Block_range(n, comm_sz, q, &first, &count);
+            shared = q == 0 || (v >= 0 && shm.node_of[q] != MPI_UNDEFINED);
+            scatter.counts[q] = shared ? 0 : (int) count;
+            scatter.displs[q] = (int) first;
+         }
+      MPI_Scatterv(a, scatter.counts, scatter.displs, MPI_ELEM,
+            my_rank == 0 ? MPI_IN_PLACE : local_a, (int) recv_n, MPI_ELEM,
+            0, comm);
+      return;
+   }
+   if (my_rank == 0) {
+      for (q = 1; q < comm_sz; q++) {
+         if (v >= 0 && shm.node_of[q] != MPI_UNDEFINED) continue;
+         Block_range(n, comm_sz, q, &first, &count);
+         for (done = 0; done < count; done += MAX_COUNT)
+            MPI_Send(a + first + done,
+                  count - done < MAX_COUNT ? count - done : MAX_COUNT,
+                  MPI_ELEM, q, SCATTER_TAG, comm);
+      }
+   } else {
+      for (done = 0; done < recv_n; done += MAX_COUNT)
+         MPI_Recv(local_a + done,
+               recv_n - done < MAX_COUNT ? recv_n - done : MAX_COUNT,
+               MPI_ELEM, 0, SCATTER_TAG, comm, MPI_STATUS_IGNORE);
+   }
+}  /* Scatter_remote */
+
+
+/*-------------------------------------------------------------------
+ * Function:   Pipeline_scatter
+ * Purpose:    Distribute x and y from process 0 in chunks, scaling
+ *             and summing the dot product of each chunk while the next
+ *             one is in flight
+ * In args:    params:   the run parameters (scalar, ops and chunk)
+ *             ax, ay:   the global vectors (only used on process 0)
+ *             n:        size of the global vectors
+ *             local_n:  size of the local blocks
+ *             my_rank:  calling process' rank in comm
+ *             comm:     communicator containing calling processes
+ * Out args:   local_x, local_y:  local blocks of the vectors, scaled if
+ *                       params->ops has scale
+ *             part:     if params->ops has dot, the local part of the
+ *                       dot product for Reduce_dot_parts
+ *
+ * Notes:
+ * 1. Chunk k of every block is sent in round k.  Process 0 posts the
+ *    Isends of round k, keeping at most PIPE_DEPTH in flight, and then
+ *    works on its own chunk k.  The other processes post the Irecvs of
+ *    chunk k+1 before they work on chunk k.
+ * 2. The chunks are received straight into local_x and local_y, so no
+ *    buffers are needed beyond the ones for the requests.
+ */
+static void Pipeline_scatter(
+      Params_t*  params     /* in  */,
+      elem_t     ax[]       /* in  */,
+      elem_t     ay[]       /* in  */,
+      size_t     n          /* in  */,
+      elem_t     local_x[]  /* out */,
+      elem_t     local_y[]  /* out */,
+      size_t     local_n    /* in  */,
+      int        my_rank    /* in  */,
+      double     part[]     /* out */,
+      MPI_Comm   comm       /* in  */) {
+   size_t chunk = (size_t) params->chunk < MAX_COUNT
+         ? (size_t) params->chunk : MAX_COUNT;
+   elem_t* src[2];
+   MPI_Request reqs[PIPE_DEPTH];
+   size_t first, count, c, len;
+   int comm_sz, q, v, r, next = 0;
+
+   MPI_Comm_size(comm, &comm_sz);
+   Init_dot_parts(params->sum, part);
+   for (r = 0; r < PIPE_DEPTH; r++)
+      reqs[r] = MPI_REQUEST_NULL;
+   if (my_rank == 0) {
+      src[0] = ax;
+      src[1] = ay;
+      // Process 0's block is the biggest, so it sets the number of rounds
+      for (c = 0; c < local_n; c += chunk) {
+         for (q = 1; q < comm_sz; q++) {
+            Block_range(n, comm_sz, q, &first, &count);
+            if (count <= c) break;
+            len = count - c < chunk ? count - c : chunk;
+            for (v = 0; v < 2; v++) {
+               MPI_Wait(&reqs[next], MPI_STATUS_IGNORE);
+               MPI_Isend(src[v] + first + c, len, MPI_ELEM, q, PIPE_TAG,
+                     comm, &reqs[next]);
+               next = (next + 1) % PIPE_DEPTH;
+            }
+         }
+         len = local_n - c < chunk ? local_n - c : chunk;
+         memcpy(local_x + c, ax + c, len*sizeof(elem_t));
+         memcpy(local_y + c, ay + c, len*sizeof(elem_t));
+         Pipeline_chunk(params, local_x + c, local_y + c, len, part);
+      }
+      MPI_Waitall(PIPE_DEPTH, reqs, MPI_STATUSES_IGNORE);
+   } else {
+      // reqs[0..1] and reqs[2..3] hold the Irecvs of alternate chunks
+      for (c = 0, r = 0; c < local_n; c += chunk, r = 2 - r) {
+         if (c == 0) {
+            len = local_n < chunk ? local_n : chunk;
+            MPI_Irecv(local_x, len, MPI_ELEM, 0, PIPE_TAG, comm, &reqs[0]);
+            MPI_Irecv(local_y, len, MPI_ELEM, 0, PIPE_TAG, comm, &reqs[1]);
+         }
+         if (c + chunk < local_n) {
+            len = local_n - c - chunk < chunk ? local_n - c - chunk : chunk;
+            MPI_Irecv(local_x + c + chunk, len, MPI_ELEM, 0, PIPE_TAG,
+                  comm, &reqs[2 - r]);
+            MPI_Irecv(local_y + c + chunk, len, MPI_ELEM, 0, PIPE_TAG,
+                  comm, &reqs[3 - r]);
+         }
+         MPI_Waitall(2, reqs + r, MPI_STATUSES_IGNORE);
+         len = local_n - c < chunk ? local_n - c : chunk;
+         Pipeline_chunk(params, local_x + c, local_y + c, len, part);
+      }
+   }
+}  /* Pipeline_scatter */
+
+
+/*-------------------------------------------------------------------
+ * Function:   Pipeline_chunk
+ * Purpose:    Scale one chunk of x and y, and add its dot product to
+ *             part, as params->ops says
+ * In args:    params:   the run parameters
+ *             len:      the number of elements in the chunk
+ * In/out:     x, y:     the chunk
+ *             part:     the local part of the dot product
+ */
+static void Pipeline_chunk(
+      Params_t*  params   /* in     */,
+      elem_t     x[]      /* in/out */,
+      elem_t     y[]      /* in/out */,
+      size_t     len      /* in     */,
+      double     part[]   /* in/out */) {
+   double chunk_part[BIN_PARTS];
+   int scale = params->ops & OP_SCALE;
+
+   if (params->ops & OP_DOT) {
+      Local_dot_parts(params->sum, scale ? params->scalar : 1, x, y, len, scale,
+            chunk_part);
+      Add_dot_parts(params->sum, part, chunk_part);
+   } else if (scale) {
+      Parallel_vector_scalar(params->scalar, x, len);
+      Parallel_vector_scalar(params->scalar, y, len);
+   }
+}  /* Pipeline_chunk */
+
+
+/*-------------------------------------------------------------------
+ * Function:   Generate_vector
+ * Purpose:    Generate a vector on process 0 and distribute among
+ *             the processes using a block distribution.
+ * In args:    local_n:  size of local vectors
+ *             n:        size of global vector
+ *             stream:   vector being generated (0 for x, 1 for y)
+ *             my_rank:  calling process' rank in comm
+ *             comm:     communicator containing calling processes
+ *             randmax: global variable for random limit
+ *             seed:     global seed
+ * Scratch:    a:        storage for the n elements of the global
+ *                       vector, only used on process 0
+ * Out arg:    local_a:  local vector read
+ *
+ * Notes:
+ * 1. This function uses the block distribution of Block_range.  The
+ *    caller allocates a, so that a failed allocation is caught with
+ *    the other allocations of the run.
+ * 2. If local_a is a shared vector (--shm), process 0 generates the
+ *    blocks of the processes on its node in place, and only the blocks
+ *    of the other nodes go through a.
+ */
+static void Generate_vector(
+      elem_t    local_a[]   /* out */,
+      size_t    local_n     /* in  */,
+      size_t    n           /* in  */,
+      elem_t    a[]         /* scratch */,
+      uint64_t  stream      /* in  */,
+      int       my_rank     /* in  */,
+      MPI_Comm  comm        /* in  */,
+      int       randmax     /* in  */,
+      uint64_t  seed        /* in  */) {
+   int comm_sz, q, v = Shm_find(local_a, comm);
+   size_t first, count;
+   elem_t* peer;
+
+   // The same elements as Generate_local_vector, all on process 0
+   if (v < 0) {
+      if (my_rank == 0)
+         Generate_local_vector(rng_engine, a, n, 0, stream, randmax, seed);
+      Scatter_blocks(a, n, local_a, local_n, my_rank, comm);
+      return;
+   }
+   MPI_Comm_size(comm, &comm_sz);
+   if (my_rank == 0)
+      for (q = 0; q < comm_sz; q++) {
+         Block_range(n, comm_sz, q, &first, &count);
+         peer = Shm_peer(v, q);
+         Generate_local_vector(rng_engine, peer != NULL ? peer : a + first,
+               count, first, stream, randmax, seed);
+      }
+   Scatter_remote(a, n, local_a, local_n, my_rank, v, comm);
+   if (Shm_peer(v, 0) != NULL) Shm_sync(v);
+}  /* Generate_vector */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Read_vec_header
+ * Purpose:   Read and check the header of a vector file
+ * In arg:    fname:  name of the file
+ * Out args:  n_p:    the order of the vector in the file
+ *            error:  why the header is bad, if it is (128 chars)
+ * Ret val:   1 if the header is good, 0 otherwise
+ *
+ * Note:
+ *    Only process 0 reads the header, before the parameters are
+ *    broadcast, so this uses stdio rather than MPI-IO.
+ */
+static int Read_vec_header(
+      char        fname[]  /* in  */,
+      long long*  n_p      /* out */,
+      char        error[]  /* out */) {
+   Vec_header_t header;
+   FILE* fp = fopen(fname, "rb");
+   long long size;
+
+   if (fp == NULL) {
+      snprintf(error, 128, "can't open %s: %s", fname, strerror(errno));
+      return 0;
+   }
+   if (fread(&header, sizeof(header), 1, fp) != 1
+         || header.magic != VEC_MAGIC) {
+      snprintf(error, 128, "%s isn't a vector file", fname);
+      fclose(fp);
+      return 0;
+   }
+   fseeko(fp, 0, SEEK_END);
+   size = ftello(fp);
+   fclose(fp);
+   if (header.dtype != ELEM_DTYPE) {
+      snprintf(error, 128, "%s doesn't hold %s elements", fname, ELEM_NAME);
+      return 0;
+   }
+   if (header.n > (uint64_t) (size - VEC_HEADER)/sizeof(elem_t)) {
+      snprintf(error, 128, "%s is too short for n = %llu", fname,
+            (unsigned long long) header.n);
+      return 0;
+   }
+   *n_p = (long long) header.n;
+   return 1;
+}  /* Read_vec_header */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Read_vector_file
+ * Purpose:   Read each process' block of a vector from a vector file
+ * In args:   fname:        name of the file (checked by
+ *                          Read_vec_header)
+ *            local_n:      size of the local block
+ *            local_first:  global index of its first element
+ *            n:            order of the vector
+ *            comm:         communicator containing all the processes
+ * Out arg:   local_a:      the local block
+ *
+ * Errors:    Failures are recorded with ERR_FILE_READ; the caller
+ *            calls Check_errors.
+ *
+ * Note:
+ *    The reads are collective, so the MPI library can merge them, and
+ *    every process calls MPI_File_read_at_all the same number of times
+ *    even when local blocks need different numbers of MAX_COUNT pieces.
+ */
+static void Read_vector_file(
+      char      fname[]      /* in  */,
+      elem_t    local_a[]    /* out */,
+      size_t    local_n      /* in  */,
+      size_t    local_first  /* in  */,
+      size_t    n            /* in  */,
+      MPI_Comm  comm         /* in  */) {
+   MPI_File fh;
+   size_t first, max_n, done, count;
+   int comm_sz;
+
+   MPI_Comm_size(comm, &comm_sz);
+   // Process 0 has the biggest block
+   Block_range(n, comm_sz, 0, &first, &max_n);
+   if (MPI_File_open(comm, fname, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh)
+         != MPI_SUCCESS) {
+      Record_error(ERR_FILE_READ);
+      return;
+   }
+   for (done = 0; done < max_n; done += MAX_COUNT) {
+      count = done >= local_n ? 0 : local_n - done < MAX_COUNT ?
+            local_n - done : MAX_COUNT;
+      if (MPI_File_read_at_all(fh,
+               VEC_HEADER + (MPI_Offset) ((local_first + done)*sizeof(elem_t)),
+               local_a + (count > 0 ? done : 0), count, MPI_ELEM,
+               MPI_STATUS_IGNORE) != MPI_SUCCESS)
+         Record_error(ERR_FILE_READ);
+   }
+   MPI_File_close(&fh);
+}  /* Read_vector_file */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Write_vector_file
+ * Purpose:   Write a vector with a block distribution to a vector
+ *            file, each process writing its own block
+ * In args:   fname:        name of the file
+ *            local_a:      the local block
+ *            local_n:      size of the local block
+ *            local_first:  global index of its first element
+ *            n:            order of the vector
+ *            comm:         communicator containing all the processes
+ *
+ * Errors:    Failures are recorded with ERR_FILE_WRITE; the caller
+ *            calls Check_errors.
+ */
+static void Write_vector_file(
+      char      fname[]      /* in */,
+      elem_t    local_a[]    /* in */,
+      size_t    local_n      /* in */,
+      size_t    local_first  /* in */,
+      size_t    n            /* in */,
+      MPI_Comm  comm         /* in */) {
+   MPI_File fh;
+   size_t first, max_n, done, count;
+   int comm_sz;
+
+   MPI_Comm_size(comm, &comm_sz);
+   Block_range(n, comm_sz, 0, &first, &max_n);
+   if (!Create_vector_file(fname, n, &fh, comm)) return;
+   for (done = 0; done < max_n; done += MAX_COUNT) {
+      count = done >= local_n ? 0 : local_n - done < MAX_COUNT ?
+            local_n - done : MAX_COUNT;
+      if (MPI_File_write_at_all(fh,
+               VEC_HEADER + (MPI_Offset) ((local_first + done)*sizeof(elem_t)),
+               local_a + (count > 0 ? done : 0), count, MPI_ELEM,
+               MPI_STATUS_IGNORE) != MPI_SUCCESS)
+         Record_error(ERR_FILE_WRITE);
+   }
+   MPI_File_close(&fh);
+}  /* Write_vector_file */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Create_vector_file
+ * Purpose:   Open a vector file for writing a vector of order n, and
+ *            write its header
+ * In args:   fname:  name of the file
+ *            n:      order of the vector
+ *            comm:   communicator containing all the processes
+ * Out arg:   fh_p:   the open file
+ * Ret val:   1 if the file was opened, 0 if it wasn't
+ *
+ * Errors:    Failures are recorded with ERR_FILE_WRITE.
+ */
+static int Create_vector_file(
+      char       fname[]  /* in  */,
+      size_t     n        /* in  */,
+      MPI_File*  fh_p     /* out */,
+      MPI_Comm   comm     /* in  */) {
+   Vec_header_t header = {VEC_MAGIC, ELEM_DTYPE, n};
+   int my_rank;
+
+   MPI_Comm_rank(comm, &my_rank);
+   if (MPI_File_open(comm, fname, MPI_MODE_WRONLY | MPI_MODE_CREATE,
+            MPI_INFO_NULL, fh_p) != MPI_SUCCESS) {
+      Record_error(ERR_FILE_WRITE);
+      return 0;
+   }
+   // Drop whatever an older, longer file had past the end
+   if (MPI_File_set_size(*fh_p,
+            VEC_HEADER + (MPI_Offset) (n*sizeof(elem_t))) != MPI_SUCCESS)
+      Record_error(ERR_FILE_WRITE);
+   if (my_rank == 0 && MPI_File_write_at(*fh_p, 0, &header, sizeof(header),
+            MPI_BYTE, MPI_STATUS_IGNORE) != MPI_SUCCESS)
+      Record_error(ERR_FILE_WRITE);
+   return 1;
+}  /* Create_vector_file */
+
+/*-------------------------------------------------------------------
+ * Function:  Ckpt_init
+ * Purpose:   Get ready to checkpoint x and y (--checkpoint)
+ * In args:   params:       the run parameters
+ *            local_n:      size of the local blocks
+ *            local_first:  global index of the first local element
+ *            n:            order of the global vectors
+ *            comm:         communicator containing all the processes
+ * Out arg:   ck:           the checkpoint state
+ * Errors:    If the copies of x and y can't be allocated
+ *            ERR_ALLOC_TEMP is recorded; the caller calls
+ *            Check_errors.
+ *
+ * Note:
+ *    A restarted run keeps checkpointing after the slot it was
+ *    restarted from, so that one stays good until the next is done.
+ */
+static void Ckpt_init(
+      Ckpt_t*    ck           /* out */,
+      Params_t*  params       /* in  */,
+      size_t     local_n      /* in  */,
+      size_t     local_first  /* in  */,
+      size_t     n            /* in  */,
+      MPI_Comm   comm         /* in  */) {
+   memset(ck, 0, sizeof(Ckpt_t));
+   ck->active = params->checkpoint[0] != '\0';
+   if (!ck->active) return;
+   ck->prefix = params->checkpoint;
+   ck->slot = params->restart[0] != '\0' ? params->ckpt_slot : 1;
+   ck->local_n = local_n;
+   ck->local_first = local_first;
+   ck->n = n;
+   ck->comm = comm;
+   ck->num_reqs = 2*((local_n + MAX_COUNT - 1)/MAX_COUNT);
+   ck->buf = malloc((2*local_n > 0 ? 2*local_n : 1)*sizeof(elem_t));
+   ck->reqs = malloc((ck->num_reqs > 0 ? ck->num_reqs : 1)
+         *sizeof(MPI_Request));
+   if (ck->buf == NULL || ck->reqs == NULL) Record_error(ERR_ALLOC_TEMP);
+}  /* Ckpt_init */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Ckpt_save
+ * Purpose:   Start writing a checkpoint of x and y after a stage
+ * In args:   params:   the run parameters
+ *            stage:    the stage that was completed (CKPT_GENERATED,
+ *                      CKPT_SCALED or CKPT_DOT)
+ *            local_x, local_y:  local blocks of the vectors
+ *            result:   the dot product, if stage is CKPT_DOT
+ * In/out:    ck:       the checkpoint state
+ *
+ * Note:
+ *    The blocks are copied, so the next stage can change x and y
+ *    while the copies are written with MPI_File_iwrite_at into the
+ *    vector files PREFIX.<slot>.x and PREFIX.<slot>.y of the other
+ *    slot.  The stage file only names the slot in Ckpt_wait, once
+ *    every process' writes are done, so a run that dies while writing
+ *    still has the last complete checkpoint.
+ */
+static void Ckpt_save(
+      Ckpt_t*    ck         /* in/out */,
+      Params_t*  params     /* in     */,
+      int        stage      /* in     */,
+      elem_t     local_x[]  /* in     */,
+      elem_t     local_y[]  /* in     */,
+      double     result     /* in     */) {
+   char fname[CKPT_NAME];
+   size_t done, count;
+   int v, r = 0;
+
+   if (!ck->active) return;
+   Ckpt_wait(ck, params);
+   memcpy(ck->buf, local_x, ck->local_n*sizeof(elem_t));
+   memcpy(ck->buf + ck->local_n, local_y, ck->local_n*sizeof(elem_t));
+   ck->slot = 1 - ck->slot;
+   for (v = 0; v < 2; v++) {
+      snprintf(fname, CKPT_NAME, "%s.%d.%c", ck->prefix, ck->slot, "xy"[v]);
+      if (!Create_vector_file(fname, ck->n, &ck->fh[v], ck->comm)) {
+         ck->fh[v] = MPI_FILE_NULL;
+         continue;
+      }
+      for (done = 0; done < ck->local_n; done += count) {
+         count = ck->local_n - done < MAX_COUNT ? ck->local_n - done
+               : MAX_COUNT;
+         if (MPI_File_iwrite_at(ck->fh[v], VEC_HEADER + (MPI_Offset)
+                  ((ck->local_first + done)*sizeof(elem_t)),
+                  ck->buf + v*ck->local_n + done, count, MPI_ELEM,
+                  &ck->reqs[r++]) != MPI_SUCCESS)
+            Record_error(ERR_FILE_WRITE);
+      }
+   }
+   ck->used_reqs = r;
+   ck->stage = stage;
+   ck->result = result;
+   ck->pending = 1;
+}  /* Ckpt_save */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Ckpt_wait
+ * Purpose:   Finish the checkpoint that Ckpt_save started, if any, and
+ *            then record it in the stage file PREFIX.stage
+ * In arg:    params:  the run parameters
+ * In/out:    ck:      the checkpoint state
+ * Errors:    Failed writes abort the run through Check_errors, before
+ *            the stage file would name the slot.
+ *
+ * Note:
+ *    Process 0 writes the stage file to PREFIX.stage.tmp and renames
+ *    it, so the stage file is always complete.
+ */
+static void Ckpt_wait(
+      Ckpt_t*    ck      /* in/out */,
+      Params_t*  params  /* in     */) {
+   char fname[CKPT_NAME], tmp[CKPT_NAME];
+   FILE* fp;
+   int my_rank, v;
+
+   if (!ck->active || !ck->pending) return;
+   if (MPI_Waitall(ck->used_reqs, ck->reqs, MPI_STATUSES_IGNORE)
+         != MPI_SUCCESS)
+      Record_error(ERR_FILE_WRITE);
+   for (v = 0; v < 2; v++)
+      if (ck->fh[v] != MPI_FILE_NULL) MPI_File_close(&ck->fh[v]);
+   ck->pending = 0;
+   Check_errors(ck->comm);
+
+   MPI_Comm_rank(ck->comm, &my_rank);
+   if (my_rank == 0) {
+      snprintf(fname, CKPT_NAME, "%s.stage", ck->prefix);
+      snprintf(tmp, CKPT_NAME, "%s.stage.tmp", ck->prefix);
+      fp = fopen(tmp, "w");
+      if (fp == NULL) {
+         Record_error(ERR_FILE_WRITE);
+      } else {
+         fprintf(fp, "%s\nstage %d\nslot %d\nn %zu\nrandmax %d\n"
+               "scalar %d\nseed %llu\nrng %d\nops %d\nresult %.17g\n",
+               CKPT_MAGIC, ck->stage, ck->slot, ck->n, params->randmax,
+               params->scalar, (unsigned long long) params->seed,
+               params->rng, params->ops & (OP_SCALE | OP_DOT), ck->result);
+         if (fclose(fp) != 0 || rename(tmp, fname) != 0)
+            Record_error(ERR_FILE_WRITE);
+      }
+   }
+   Check_errors(ck->comm);
+}  /* Ckpt_wait */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Ckpt_free
+ * Purpose:   Finish the last checkpoint and free the copies
+ * In arg:    params:  the run parameters
+ * In/out:    ck:      the checkpoint state
+ */
+static void Ckpt_free(
+      Ckpt_t*    ck      /* in/out */,
+      Params_t*  params  /* in     */) {
+   if (!ck->active) return;
+   Ckpt_wait(ck, params);
+   free(ck->buf);
+   free(ck->reqs);
+   ck->active = 0;
+}  /* Ckpt_free */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Read_checkpoint
+ * Purpose:   Take the stage, the slot and the parameters that define
+ *            x and y from the stage file of a --restart, and check
+ *            the slot's vector files
+ * In/out:    params:  the parameters; params->error is set if the
+ *                     checkpoint can't be used
+ *
+ * Note:
+ *    Only process 0 reads the stage file, before the parameters are
+ *    broadcast.
+ */
+static void Read_checkpoint(Params_t* params /* in/out */) {
+   char fname[CKPT_NAME], magic[16];
+   unsigned long long seed;
+   long long n, n_v;
+   int ops, v;
+   FILE* fp;
+
+   snprintf(fname, CKPT_NAME, "%s.stage", params->restart);
+   fp = fopen(fname, "r");
+   if (fp == NULL) {
+      snprintf(params->error, sizeof(params->error), "can't open %.64s: %s",
+            fname, strerror(errno));
+      return;
+   }
+   if (fscanf(fp, "%15s stage %d slot %d n %lld randmax %d scalar %d "
+            "seed %llu rng %d ops %d result %lf", magic, &params->ckpt_stage,
+            &params->ckpt_slot, &n, &params->randmax, &params->scalar,
+            &seed, &params->rng, &ops, &params->ckpt_result) != 10
+         || strcmp(magic, CKPT_MAGIC) != 0
+         || params->ckpt_slot < 0 || params->ckpt_slot > 1) {
+      snprintf(params->error, sizeof(params->error),
+            "%.64s isn't a checkpoint stage file", fname);
+      fclose(fp);
+      return;
+   }
+   fclose(fp);
+   params->n = n;
+   params->seed = seed;
+   params->have |= HAVE_N | HAVE_RANDMAX | HAVE_SCALAR | HAVE_SEED;
+   if ((params->ops & (OP_SCALE | OP_DOT)) != ops) {
+      strcpy(params->error, "--restart needs the scale and dot --ops of "
+            "the checkpoint");
+      return;
+   }
+   for (v = 0; v < 2; v++) {
+      snprintf(fname, CKPT_NAME, "%s.%d.%c", params->restart,
+            params->ckpt_slot, "xy"[v]);
+      if (!Read_vec_header(fname, &n_v, params->error)) return;
+      if (n_v != n) {
+         snprintf(params->error, sizeof(params->error),
+               "%.64s doesn't have n = %lld", fname, n);
+         return;
+      }
+   }
+}  /* Read_checkpoint */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Restore_checkpoint
+ * Purpose:   Read the blocks of x and y of the current distribution
+ *            from the checkpoint of a --restart
+ * In args:   params:       the run parameters
+ *            local_n:      size of the local blocks
+ *            local_first:  global index of the first local element
+ *            n:            order of the global vectors
+ *            comm:         communicator containing all the processes
+ * Out args:  local_x, local_y:  local blocks of the vectors
+ *
+ * Note:
+ *    The vector files are indexed by global element, so comm_sz can
+ *    differ from the run that wrote them:  each process just reads
+ *    its new block.
+ */
+static void Restore_checkpoint(
+      Params_t*  params       /* in  */,
+      elem_t     local_x[]    /* out */,
+      elem_t     local_y[]    /* out */,
+      size_t     local_n      /* in  */,
+      size_t     local_first  /* in  */,
+      size_t     n            /* in  */,
+      MPI_Comm   comm         /* in  */) {
+   char fname[CKPT_NAME];
+
+   snprintf(fname, CKPT_NAME, "%s.%d.x", params->restart, params->ckpt_slot);
+   Read_vector_file(fname, local_x, local_n, local_first, n, comm);
+   snprintf(fname, CKPT_NAME, "%s.%d.y", params->restart, params->ckpt_slot);
+   Read_vector_file(fname, local_y, local_n, local_first, n, comm);
+   Check_errors(comm);
+}  /* Restore_checkpoint */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Batch_operations
+ * Purpose:   Generate params->batch pairs of vectors and run the
+ *            operations selected with --ops on all of them, with one
+ *            reduction for all the dot products
+ * In args:   params:       the run parameters
+ *            h:            hierarchical reduction of comm (--hier),
+ *                          or NULL
+ *            n:            order of each vector
+ *            local_n:      size of the local block of each vector
+ *            local_first:  global index of the first local element
+ *            my_rank:      calling process' rank in comm
+ *            comm:         communicator containing all the processes
+ * Out args:  local_x, local_y:  the local blocks of the pairs, block k
+ *                          at k*local_n
+ *            local_z:      the local blocks of z_k, at k*local_n, if
+ *                          add, axpy or mul is selected
+ *
+ * Notes:
+ * 1. x_k and y_k are generated as streams 2k and 2k+1, so pair 0 is
+ *    the x and y of an unbatched run with the same seed.
+ * 2. The blocks of the pairs are contiguous, so the scalings and each
+ *    of add, axpy and mul are one pass over all the pairs, and the K
+ *    dot products are one reduction.
+ */
+static void Batch_operations(
+      Params_t*  params       /* in  */,
+      Hier_t*    h            /* in  */,
+      elem_t     local_x[]    /* out */,
+      elem_t     local_y[]    /* out */,
+      elem_t     local_z[]    /* out */,
+      size_t     n            /* in  */,
+      size_t     local_n      /* in  */,
+      size_t     local_first  /* in  */,
+      int        my_rank      /* in  */,
+      MPI_Comm   comm         /* in  */) {
+   int batch = params->batch;
+   int scale = params->ops & OP_SCALE, dot = params->ops & OP_DOT;
+   int fused = scale && dot && !params->unfused;
+   double *parts, *results;
+   char title[64];
+   size_t off;
+   int k, zop;
+
+   parts = malloc((BIN_PARTS + 1)*batch*sizeof(double));
+   if (parts == NULL) Record_error(ERR_ALLOC_TEMP);
+   Check_errors(comm);
+   results = parts + BIN_PARTS*batch;
+
+   for (k = 0; k < batch; k++) {
+      off = k*local_n;
+      Generate_local_vector(rng_engine, local_x + off, local_n, local_first,
+            2*k, params->randmax, params->seed);
+      Generate_local_vector(rng_engine, local_y + off, local_n, local_first,
+            2*k + 1, params->randmax, params->seed);
+   }
+   if (params->ops & OP_PRINT)
+      for (k = 0; k < batch; k++) {
+         sprintf(title, "Vector x_%d", k);
+         PrintTopDown_vector(local_x + k*local_n, n, title,
+               my_rank, comm);
+         sprintf(title, "Vector y_%d", k);
+         PrintTopDown_vector(local_y + k*local_n, n, title,
+               my_rank, comm);
+      }
+
+   // The blocks of the pairs are contiguous, so one pass scales them all
+   if (scale && !fused) {
+      Parallel_vector_scalar(params->scalar, local_x, batch*local_n);
+      Parallel_vector_scalar(params->scalar, local_y, batch*local_n);
+   }
+   if (dot)
+      for (k = 0; k < batch; k++)
+         Local_dot_parts(params->sum, params->scalar, local_x + k*local_n,
+               local_y + k*local_n, local_n, fused, parts + k*BIN_PARTS);
+   if ((params->ops & OP_PRINT) && scale)
+      for (k = 0; k < batch; k++) {
+         sprintf(title, "Vector x_%d by scalar", k);
+         PrintTopDown_vector(local_x + k*local_n, n, title,
+               my_rank, comm);
+         sprintf(title, "Vector y_%d by scalar", k);
+         PrintTopDown_vector(local_y + k*local_n, n, title,
+               my_rank, comm);
+      }
+
+   if (dot) {
+      Reduce_dot_batch(params->sum, params->reduce, h, parts, results, batch,
+            comm);
+      if (my_rank == 0) {
+         printf("\nResults of the dot products:\n");
+         for (k = 0; k < batch; k++)
+            printf("%d: %lf\n", k, results[k]);
+      }
+   }
+
+   for (zop = OP_ADD; zop <= OP_MUL; zop <<= 1) {
+      if (!(params->ops & zop)) continue;
+      Local_z(zop, params->scalar, local_x, local_y, local_z,
+            batch*local_n);
+      if (params->ops & OP_PRINT)
+         for (k = 0; k < batch; k++) {
+            sprintf(title, "Vector z_%d = %s", k, Z_expr(zop));
+            PrintTopDown_vector(local_z + k*local_n, n, title,
+                  my_rank, comm);
+         }
+   }
+   free(parts);
+}  /* Batch_operations */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Stream_operations
+ * Purpose:   Run the operations selected with --ops on x and y one
+ *            tile at a time, reading, generating and writing the tiles
+ *            while the previous tile is worked on
+ * In args:   params:       the run parameters
+ *            h:            hierarchical reduction of comm (--hier),
+ *                          or NULL
+ *            n:            order of the global vectors
+ *            local_n:      size of the local blocks
+ *            local_first:  global index of the first local element
+ *            my_rank:      calling process' rank in comm
+ *            comm:         communicator containing all the processes
+ * Scratch:   local_x, local_y:  two tiles each (or the whole block if
+ *                          it's smaller than a tile)
+ *
+ * Notes:
+ * 1. In round k, the writes of tile k-1 are waited for, so its
+ *    buffers can take tile k+1, whose reads are then started.  Tile
+ *    k is scaled and summed by Pipeline_chunk, as in --gen pipeline,
+ *    and its writes are started.
+ * 2. Only process 0 prints.  The previews are read from the files (or
+ *    generated) on process 0, and the scaled ones are multiplied by
+ *    the scalar the way kernels.scale does it.
+ */
+static void Stream_operations(
+      Params_t*  params       /* in  */,
+      Hier_t*    h            /* in  */,
+      elem_t     local_x[]    /* scratch */,
+      elem_t     local_y[]    /* scratch */,
+      size_t     n            /* in  */,
+      size_t     local_n      /* in  */,
+      size_t     local_first  /* in  */,
+      int        my_rank      /* in  */,
+      MPI_Comm   comm         /* in  */) {
+   size_t tile = (size_t) params->tile < MAX_COUNT
+         ? (size_t) params->tile : MAX_COUNT;
+   char* in[2] = {params->xin, params->yin};
+   char* out[2] = {params->xout, params->yout};
+   char* names[2] = {"Vector x", "Vector y"};
+   char* scaled_names[2] = {"Vector x by scalar", "Vector y by scalar"};
+   MPI_File in_fh[2], out_fh[2];
+   MPI_Request reads[2][2], writes[2][2];
+   elem_t* buf[2][2];
+   double sample[2][PREVIEW_MAX];
+   double part[BIN_PARTS], result;
+   size_t c, len;
+   int b, v, j, k = 0;
+
+   if (tile > local_n) tile = local_n;
+   for (b = 0; b < 2; b++) {
+      buf[b][0] = local_x + b*tile;
+      buf[b][1] = local_y + b*tile;
+      for (v = 0; v < 2; v++)
+         reads[b][v] = writes[b][v] = MPI_REQUEST_NULL;
+   }
+   for (v = 0; v < 2; v++) {
+      in_fh[v] = out_fh[v] = MPI_FILE_NULL;
+      if (in[v][0] != '\0' && MPI_File_open(comm, in[v], MPI_MODE_RDONLY,
+               MPI_INFO_NULL, &in_fh[v]) != MPI_SUCCESS) {
+         Record_error(ERR_FILE_READ);
+         in_fh[v] = MPI_FILE_NULL;
+      }
+      if (out[v][0] != '\0' && !Create_vector_file(out[v], n, &out_fh[v],
+               comm))
+         out_fh[v] = MPI_FILE_NULL;
+   }
+   Check_errors(comm);
+
+   if ((params->ops & OP_PRINT) && my_rank == 0)
+      for (v = 0; v < 2; v++) {
+         k = Stream_sample(params, in_fh[v], v, n, sample[v]);
+         Print_sample(sample[v], n, names[v]);
+      }
+   Check_errors(comm);
+
+   Init_dot_parts(params->sum, part);
+   if (local_n > 0)
+      Stream_read(params, in_fh, buf[0], local_first, tile, reads[0]);
+   for (c = 0, b = 0; c < local_n; c += tile, b = 1 - b) {
+      len = local_n - c < tile ? local_n - c : tile;
+      if (c + tile < local_n) {
+         if (MPI_Waitall(2, writes[1-b], MPI_STATUSES_IGNORE) != MPI_SUCCESS)
+            Record_error(ERR_FILE_WRITE);
+         Stream_read(params, in_fh, buf[1-b], local_first + c + tile,
+               local_n - c - tile < tile ? local_n - c - tile : tile,
+               reads[1-b]);
+      }
+      if (MPI_Waitall(2, reads[b], MPI_STATUSES_IGNORE) != MPI_SUCCESS)
+         Record_error(ERR_FILE_READ);
+      Pipeline_chunk(params, buf[b][0], buf[b][1], len, part);
+      for (v = 0; v < 2; v++)
+         if (out_fh[v] != MPI_FILE_NULL && MPI_File_iwrite_at(out_fh[v],
+                  VEC_HEADER + (MPI_Offset) ((local_first + c)*sizeof(elem_t)),
+                  buf[b][v], len, MPI_ELEM, &writes[b][v]) != MPI_SUCCESS)
+            Record_error(ERR_FILE_WRITE);
+   }
+   for (b = 0; b < 2; b++)
+      if (MPI_Waitall(2, writes[b], MPI_STATUSES_IGNORE) != MPI_SUCCESS)
+         Record_error(ERR_FILE_WRITE);
+   for (v = 0; v < 2; v++) {
+      if (in_fh[v] != MPI_FILE_NULL) MPI_File_close(&in_fh[v]);
+      if (out_fh[v] != MPI_FILE_NULL) MPI_File_close(&out_fh[v]);
+   }
+   Check_errors(comm);
+
+   if ((params->ops & OP_PRINT) && (params->ops & OP_SCALE) && my_rank == 0)
+      for (v = 0; v < 2; v++) {
+         for (j = 0; j < k; j++)
+            sample[v][j] = (double) ((elem_t) sample[v][j]
+                  * (elem_t) params->scalar);
+         Print_sample(sample[v], n, scaled_names[v]);
+      }
+   if (params->ops & OP_DOT) {
+      Reduce_dot_parts(params->sum, params->reduce, h, part, &result, comm);
+      Display_dot_result(my_rank, result);
+   }
+}  /* Stream_operations */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Stream_read
+ * Purpose:   Start reading one tile of x and y from their files, or
+ *            generate the tiles of the vectors that have no file
+ * In args:   params:  the run parameters
+ *            fh:      the open --xin and --yin files (MPI_FILE_NULL
+ *                     for a generated vector)
+ *            first:   global index of the first element of the tile
+ *            len:     number of elements in the tile
+ * Out args:  buf:     buf[0] and buf[1] get the tiles of x and y once
+ *                     reqs complete
+ *            reqs:    the reads started (MPI_REQUEST_NULL if none)
+ */
+static void Stream_read(
+      Params_t*    params  /* in  */,
+      MPI_File     fh[]    /* in  */,
+      elem_t*      buf[]   /* out */,
+      size_t       first   /* in  */,
+      size_t       len     /* in  */,
+      MPI_Request  reqs[]  /* out */) {
+   int v;
+
+   for (v = 0; v < 2; v++) {
+      reqs[v] = MPI_REQUEST_NULL;
+      if (fh[v] == MPI_FILE_NULL)
+         Generate_local_vector(rng_engine, buf[v], len, first, v,
+               params->randmax, params->seed);
+      else if (MPI_File_iread_at(fh[v],
+               VEC_HEADER + (MPI_Offset) (first*sizeof(elem_t)), buf[v],
+               len, MPI_ELEM, &reqs[v]) != MPI_SUCCESS)
+         Record_error(ERR_FILE_READ);
+   }
+}  /* Stream_read */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Stream_sample
+ * Purpose:   Get the elements of x or y that the previews print,
+ *            without the rest of the vector
+ * In args:   params:  the run parameters
+ *            fh:      the open vector file, or MPI_FILE_NULL if the
+ *                     vector is generated
+ *            v:       vector (0 for x, 1 for y)
+ *            n:       order of the vector
+ * Out arg:   sample:  the elements at the indices of Preview_indices
+ * Ret val:   number of elements in sample
+ *
+ * Note:
+ *    Only called by process 0.  The head and the tail of the preview
+ *    are contiguous, so they take one read (or one generation) each.
+ */
+static int Stream_sample(
+      Params_t*  params    /* in  */,
+      MPI_File   fh        /* in  */,
+      int        v         /* in  */,
+      size_t     n         /* in  */,
+      double     sample[]  /* out */) {
+   size_t idx[PREVIEW_MAX];
+   elem_t elems[PREVIEW_MAX];
+   int k = Preview_indices(n, idx);
+   int j, j_end;
+
+   for (j = 0; j < k; j = j_end) {
+      for (j_end = j + 1; j_end < k; j_end++)
+         if (idx[j_end] != idx[j_end-1] + 1) break;
+      if (fh == MPI_FILE_NULL)
+         Generate_local_vector(rng_engine, elems + j, j_end - j, idx[j], v,
+               params->randmax, params->seed);
+      else if (MPI_File_read_at(fh,
+               VEC_HEADER + (MPI_Offset) (idx[j]*sizeof(elem_t)),
+               elems + j, j_end - j, MPI_ELEM, MPI_STATUS_IGNORE)
+            != MPI_SUCCESS)
+         Record_error(ERR_FILE_READ);
+   }
+   for (j = 0; j < k; j++)
+      sample[j] = (double) elems[j];
+   return k;
+}  /* Stream_sample */
+
+/*-------------------------------------------------------------------
+ * Function:  Offload_operations
+ * Purpose:   Run scale and dot with x and y resident on an OpenMP
+ *            target device (--offload):  the vectors are generated
+ *            there, and only the dot product's part and the elements
+ *            of the previews come back to the host before MPI
+ * In args:   params:       the run parameters
+ *            h:            hierarchical reduction of comm (--hier),
+ *                          or NULL
+ *            n:            order of the global vectors
+ *            local_n:      size of the local blocks
+ *            local_first:  global index of the first local element
+ *            my_rank:      calling process' rank in comm
+ *            comm:         communicator containing all the processes
+ * Out args:  local_x, local_y:  host copies of the local blocks (only
+ *                          the previewed elements, unless a vector is
+ *                          written with --xout or --yout)
+ *
+ * Note:
+ *    The host copies are the storage the device copies are mapped
+ *    from, so with no device (or a build without an offload target)
+ *    the target regions run on the host and everything still works.
+ */
+static void Offload_operations(
+      Params_t*  params       /* in  */,
+      Hier_t*    h            /* in  */,
+      elem_t     local_x[]    /* out */,
+      elem_t     local_y[]    /* out */,
+      size_t     n            /* in  */,
+      size_t     local_n      /* in  */,
+      size_t     local_first  /* in  */,
+      int        my_rank      /* in  */,
+      MPI_Comm   comm         /* in  */) {
+   double result, part[BIN_PARTS];
+   int ops = params->ops;
+
+   Select_device(my_rank, comm);
+#  ifdef _OPENMP
+#  pragma omp target enter data map(alloc: local_x[0:local_n], \
+         local_y[0:local_n])
+#  endif
+   if (params->xin[0] != '\0')
+      Read_vector_file(params->xin, local_x, local_n, local_first, n, comm);
+   if (params->yin[0] != '\0')
+      Read_vector_file(params->yin, local_y, local_n, local_first, n, comm);
+   Check_errors(comm);
+
+   if (params->xin[0] == '\0')
+      Device_generate(local_x, local_n, local_first, 0, params->randmax,
+            params->seed);
+   else {
+#     ifdef _OPENMP
+#     pragma omp target update to(local_x[0:local_n])
+#     endif
+   }
+   if (ops & OP_PRINT)
+      Device_preview(local_x, local_n, n, local_first, "Vector x", my_rank,
+            comm);
+   if (params->yin[0] == '\0')
+      Device_generate(local_y, local_n, local_first, 1, params->randmax,
+            params->seed);
+   else {
+#     ifdef _OPENMP
+#     pragma omp target update to(local_y[0:local_n])
+#     endif
+   }
+   if (ops & OP_PRINT)
+      Device_preview(local_y, local_n, n, local_first, "Vector y", my_rank,
+            comm);
+
+   Init_dot_parts(params->sum, part);
+   if ((ops & OP_SCALE) && (ops & OP_DOT) && !params->unfused) {
+      // scale x and y and compute the dot product in one kernel
+      part[0] = Device_dot(params->scalar, local_x, local_y, local_n, 1);
+   } else if (ops & OP_SCALE) {
+      Device_scale(params->scalar, local_x, local_n);
+      Device_scale(params->scalar, local_y, local_n);
+   }
+   if ((ops & OP_PRINT) && (ops & OP_SCALE)) {
+      Device_preview(local_x, local_n, n, local_first, "Vector x by scalar",
+            my_rank, comm);
+      Device_preview(local_y, local_n, n, local_first, "Vector y by scalar",
+            my_rank, comm);
+   }
+   if (ops & OP_DOT) {
+      if (!(ops & OP_SCALE) || params->unfused)
+         part[0] = Device_dot(0, local_x, local_y, local_n, 0);
+      Reduce_dot_parts(params->sum, params->reduce, h, part, &result, comm);
+      Display_dot_result(my_rank, result);
+   }
+
+   if (params->xout[0] != '\0') {
+#     ifdef _OPENMP
+#     pragma omp target update from(local_x[0:local_n])
+#     endif
+      Write_vector_file(params->xout, local_x, local_n, local_first, n,
+            comm);
+   }
+   if (params->yout[0] != '\0') {
+#     ifdef _OPENMP
+#     pragma omp target update from(local_y[0:local_n])
+#     endif
+      Write_vector_file(params->yout, local_y, local_n, local_first, n,
+            comm);
+   }
+#  ifdef _OPENMP
+#  pragma omp target exit data map(delete: local_x[0:local_n], \
+         local_y[0:local_n])
+#  endif
+   Check_errors(comm);
+}  /* Offload_operations */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Select_device
+ * Purpose:   Make the calling process' default target device one of
+ *            its node's, so the processes of a node share the devices
+ *            round robin
+ * In args:   my_rank:  calling process' rank in comm (only printed
+ *                      with -DDEBUG)
+ *            comm:     communicator containing all the processes
+ *
+ * Note:      Without -fopenmp there's no device to pick
+ */
+static void Select_device(
+      int       my_rank  /* in */,
+      MPI_Comm  comm     /* in */) {
+#  ifdef _OPENMP
+   int dev;
+   MPI_Comm node;
+   int node_rank, num_devs = omp_get_num_devices();
+
+   MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL,
+         &node);
+   MPI_Comm_rank(node, &node_rank);
+   MPI_Comm_free(&node);
+   dev = num_devs > 0 ? node_rank % num_devs : omp_get_initial_device();
+   omp_set_default_device(dev);
+#  ifdef DEBUG
+   printf("Proc %d > target device %d of %d\n", my_rank, dev, num_devs);
+#  else
+   (void) my_rank;
+#  endif
+#  else
+   (void) my_rank;
+   (void) comm;
+#  endif
+}  /* Select_device */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Device_generate
+ * Purpose:   Generate_local_vector on the device copy of local_a, with
+ *            one element per device thread
+ * In args:   as in Generate_local_vector
+ * Out arg:   local_a:  device copy of the local block
+ *
+ * Note:
+ *    Only the splitmix engine is used (--offload needs --rng
+ *    splitmix):  it's a function of the element's index alone, so the
+ *    vector is the same as on the host, for every comm_sz.
+ */
+static void Device_generate(
+      elem_t    local_a[]   /* out */,
+      size_t    local_n     /* in  */,
+      size_t    local_first /* in  */,
+      uint64_t  stream      /* in  */,
+      int       randmax     /* in  */,
+      uint64_t  seed        /* in  */) {
+   uint64_t range = randmax;
+   uint64_t threshold = (0 - range) % range;
+   size_t i;
+
+#  ifdef _OPENMP
+#  pragma omp target teams distribute parallel for \
+         map(alloc: local_a[0:local_n])
+#  endif
+   for (i = 0; i < local_n; i++) {
+      uint64_t r = Counter_rand(seed, stream, local_first + i), lo;
+
+      local_a[i] = Mul_hi(r, range, &lo);
+      if (lo < threshold)
+         local_a[i] = Rand_range(seed, stream, local_first + i, r, range,
+               threshold);
+   }
+}  /* Device_generate */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Device_scale
+ * Purpose:   Multiply the device copy of local_a by scalar
+ * In args:   scalar:   the scalar
+ *            local_n:  size of the local block
+ * In/out:    local_a:  device copy of the local block
+ */
+static void Device_scale(
+      int     scalar     /* in     */,
+      elem_t  local_a[]  /* in/out */,
+      size_t  local_n    /* in     */) {
+   elem_t e = (elem_t) scalar;
+   size_t i;
+
+#  ifdef _OPENMP
+#  pragma omp target teams distribute parallel for \
+         map(alloc: local_a[0:local_n])
+#  endif
+   for (i = 0; i < local_n; i++)
+      local_a[i] = local_a[i]*e;
+}  /* Device_scale */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Device_dot
+ * Purpose:   Dot product of the device copies of local_x and local_y,
+ *            reduced on the device
+ * In args:   scalar:   number to multiply the vectors with if scale
+ *                      is nonzero
+ *            local_n:  size of the local blocks
+ *            scale:    if nonzero, local_x and local_y are first
+ *                      overwritten with scalar*x and scalar*y in the
+ *                      same kernel
+ * In/out:    local_x, local_y:  device copies of the local blocks
+ * Ret val:   the dot product of the local blocks
+ */
+static double Device_dot(
+      int     scalar     /* in     */,
+      elem_t  local_x[]  /* in/out */,
+      elem_t  local_y[]  /* in/out */,
+      size_t  local_n    /* in     */,
+      int     scale      /* in     */) {
+   elem_t e = (elem_t) scalar;
+   acc_t dot = 0;
+   size_t i;
+
+#  ifdef _OPENMP
+#  pragma omp target teams distribute parallel for reduction(+: dot) \
+         map(alloc: local_x[0:local_n], local_y[0:local_n]) \
+         map(tofrom: dot)
+#  endif
+   for (i = 0; i < local_n; i++) {
+      if (scale) {
+         local_x[i] = local_x[i]*e;
+         local_y[i] = local_y[i]*e;
+      }
+      dot += (acc_t) local_x[i]*local_y[i];
+   }
+   return (double) dot;
+}  /* Device_dot */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Device_preview
+ * Purpose:   Copy the calling process' elements of the preview back
+ *            from the device and print the preview
+ * In args:   local_n:      size of the local block
+ *            n:            order of the global vector
+ *            local_first:  global index of the first local element
+ *            title:        title of the preview
+ *            my_rank:      calling process' rank in comm
+ *            comm:         communicator containing all the processes
+ * In/out:    local_a:      host copy of the local block
+ */
+static void Device_preview(
+      elem_t    local_a[]    /* in/out */,
+      size_t    local_n      /* in     */,
+      size_t    n            /* in     */,
+      size_t    local_first  /* in     */,
+      char      title[]      /* in     */,
+      int       my_rank      /* in     */,
+      MPI_Comm  comm         /* in     */) {
+   size_t idx[PREVIEW_MAX];
+   int k = Preview_indices(n, idx), j;
+
+   for (j = 0; j < k; j++)
+      if (idx[j] >= local_first && idx[j] < local_first + local_n) {
+#        ifdef _OPENMP
+#        pragma omp target update from(local_a[idx[j] - local_first:1])
+#        endif
+      }
+   PrintTopDown_vector(local_a, n, title, my_rank, comm);
+}  /* Device_preview */
+
+
+/*-------------------------------------------------------------------
+ * Function:    Generate_local_vector
+ * Purpose:     Fill the local block of a vector with random numbers
+ *              in [0, randmax) without any communication.
+ * In args:     engine:       RNG_ engine of vec_rng.h (from --rng)
+ *              local_n:      size of local vectors
+ *              local_first:  global index of the first local element
+ *              stream:       vector being generated (0 for x, 1 for y)
+ *              randmax:      global variable for random limit
+ *              seed:     global seed (same on every process)
+ * Out arg:     local_a:  local block of the vector
+ *
+ * Note:
+ *    Element i of the global vector only depends on seed, stream, i
+ *    and the engine, so the vector is the same for every value
+ *    of comm_sz.  Each thread fills its block RNG_BATCH elements at a
+ *    time, in runs that start at multiples of RNG_BATCH, with
+ *    Rng_uniform (vec_rng.h):  there's no modulo bias and only one
+ *    division per vector.
+ */
+static void Generate_local_vector(
+      int       engine      /* in  */,
+      elem_t    local_a[]   /* out */,
+      size_t    local_n     /* in  */,
+      size_t    local_first /* in  */,
+      uint64_t  stream      /* in  */,
+      int       randmax     /* in  */,
+      uint64_t  seed        /* in  */) {
+   uint64_t range = randmax;
+   uint64_t threshold = (0 - range) % range;
+
+#  ifdef _OPENMP
+#  pragma omp parallel
+#  endif
+   {
+      uint64_t r[RNG_BATCH], i;
+      size_t first, count, local_i, len, j;
+
+      Thread_block(local_n, &first, &count);
+      for (local_i = first; local_i < first + count; local_i += len) {
+         i = local_first + local_i;
+         len = RNG_BATCH - i % RNG_BATCH;
+         if (len > first + count - local_i) len = first + count - local_i;
+         Rng_uniform(engine, seed, stream, i, len, range, threshold, r);
+         for (j = 0; j < len; j++)
+            local_a[local_i + j] = r[j];
+      }
+   }
+}  /* Generate_local_vector */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Gather_sample
+ * Purpose:   Gather a few elements of a vector that has a block
+ *            distribution onto process 0.  Each process owning some of
+ *            the requested indices sends them to process 0 in one
+ *            message, and the other processes don't communicate at
+ *            all, so the cost depends on k and not on n or comm_sz.
+ * In args:   local_b:  local storage for the vector
+ *            n:        order of global vector
+ *            idx:      global indices to gather, in nondecreasing
+ *                      order (the same list on every process)
+ *            k:        number of indices in idx, <= PREVIEW_MAX
+ *            my_rank:  calling process' rank in comm
+ *            comm:     communicator containing the calling processes
+ * Out arg:   sample:   on process 0, sample[j] = b[idx[j]]
+ *
+ * Note:      If local_b is a shared vector (--shm), process 0 reads
+ *            the elements of the processes on its node directly, between
+ *            two Shm_syncs of the node.
+ */
+static void Gather_sample(
+      elem_t    local_b[]  /* in  */,
+      size_t    n          /* in  */,
+      size_t    idx[]      /* in  */,
+      int       k          /* in  */,
+      double    sample[]   /* out */,
+      int       my_rank    /* in  */,
+      MPI_Comm  comm       /* in  */) {
+   double send[PREVIEW_MAX];
+   int comm_sz, j, j_end, owner, send_count;
+   int v = Shm_find(local_b, comm);
+   size_t first, count, owner_first;
+   elem_t* peer;
+
+   MPI_Comm_size(comm, &comm_sz);
+   Block_range(n, comm_sz, my_rank, &first, &count);
+   if (v >= 0 && Shm_peer(v, 0) == NULL) v = -1;
+   if (v >= 0) Shm_sync(v);
+   // idx is sorted, so the indices owned by a process are contiguous
+   for (j = 0; j < k; j = j_end) {
+      owner = Block_owner(n, comm_sz, idx[j]);
+      for (j_end = j + 1; j_end < k; j_end++)
+         if (Block_owner(n, comm_sz, idx[j_end]) != owner) break;
+      if (owner == my_rank) {
+         for (send_count = 0; send_count < j_end - j; send_count++)
+            send[send_count] = local_b[idx[j + send_count] - first];
+         if (my_rank == 0)
+            memcpy(sample + j, send, send_count*sizeof(double));
+         else if (v < 0)
+            MPI_Send(send, send_count, MPI_DOUBLE, 0, SAMPLE_TAG, comm);
+      } else if (my_rank == 0) {
+         peer = v >= 0 ? Shm_peer(v, owner) : NULL;
+         if (peer != NULL) {
+            Block_range(n, comm_sz, owner, &owner_first, &count);
+            for (; j < j_end; j++)
+               sample[j] = peer[idx[j] - owner_first];
+         } else {
+            MPI_Recv(sample + j, j_end - j, MPI_DOUBLE, owner, SAMPLE_TAG,
+                  comm, MPI_STATUS_IGNORE);
+         }
+      }
+   }
+   // Don't let the owners change their blocks before process 0 is done
+   if (v >= 0) Shm_sync(v);
+}  /* Gather_sample */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Preview_indices
+ * Purpose:   List the global indices of the first and last PREVIEW_LEN
+ *            elements of a vector, as PrintTopDown_vector prints them
+ * In arg:    n:    order of the vector
+ * Out arg:   idx:  the indices, in increasing order
+ * Ret val:   number of indices in idx
+ *
+ * Note:
+ *    When n < 2*PREVIEW_LEN the last range starts after the first,
+ *    so each element is listed once and idx stays increasing.
+ */
+static int Preview_indices(
+      size_t  n      /* in  */,
+      size_t  idx[]  /* out */) {
+   size_t head = n < PREVIEW_LEN ? n : PREVIEW_LEN;
+   size_t start = n - head > head ? n - head : head;
+   size_t i;
+   int k = 0;
+
+   for (i = 0; i < head; i++)
+      idx[k++] = i;
+   for (i = start; i < n; i++)
+      idx[k++] = i;
+   return k;
+}  /* Preview_indices */
+
+
+/*-------------------------------------------------------------------
+ * Function:  PrintTopDown_vector
+ * Purpose:   Print the first and last PREVIEW_LEN elements of a vector
+ *            that has a block distribution to stdout
+ * In args:   local_b:  local storage for vector to be printed
+ *            n:        order of global vector
+ *            title:    title to precede print out
+ *            comm:     communicator containing processes calling
+ *                      PrintTopDown_vector
+ *
+ * Note:
+ *    Only the 2*PREVIEW_LEN printed elements are gathered.
+ */
+static void PrintTopDown_vector(
+      elem_t    local_b[]  /* in */,
+      size_t    n          /* in */,
+      char      title[]    /* in */,
+      int       my_rank    /* in */,
+      MPI_Comm  comm       /* in */) {
+   size_t idx[PREVIEW_MAX];
+   double sample[PREVIEW_MAX];
+   int k;
+
+   if (n == 0) return;
+   k = Preview_indices(n, idx);
+   Gather_sample(local_b, n, idx, k, sample, my_rank, comm);
+   if (my_rank == 0) Print_sample(sample, n, title);
+}  /* PrintTopDown_vector */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Print_sample
+ * Purpose:   Print the preview of a vector from the elements at the
+ *            indices of Preview_indices
+ * In args:   sample:  the elements
+ *            n:       order of the vector
+ *            title:   title to precede print out
+ *
+ * Note:
+ *    When n < 2*PREVIEW_LEN the tail line starts after the head, so
+ *    no element is printed twice, and when n <= PREVIEW_LEN there's
+ *    no tail line.
+ */
+static void Print_sample(
+      double  sample[]  /* in */,
+      size_t  n         /* in */,
+      char    title[]   /* in */) {
+   size_t head = n < PREVIEW_LEN ? n : PREVIEW_LEN;
+   // First index of the tail, as in Preview_indices
+   size_t start = n - head > head ? n - head : head;
+   size_t i;
+
+   if (n == 0) return;
+   printf("%s\n", title);
+   printf("0 - %zu: [", head);
+   for (i = 0; i < head-1; i++)
+      printf("%lf,", sample[i]);
+   printf("%lf]\n", sample[head-1]);
+   if (start >= n) return;
+   printf("%zu - %zu: [",start,n);
+   for (i = start; i < n; i++)
+      printf(i < n-1 ? "%lf," : "%lf]\n", sample[head + i - start]);
+}  /* Print_sample */
+
+/*-------------------------------------------------------------------
+ * Function:  Parallel_vector_scalar
+ * Purpose:   Multiply a vector by a scalar that's been distributed among the processes
+ * In args:   local_n:  the number of components in local_arr
+ *            scalar: Scalar number to multiply vectors with
+ * Out arg:   local_arr:  local storage of the vector multiplied by the scalar
+ */
+static void Parallel_vector_scalar(
+      int     scalar,
+      elem_t  local_arr[]  /* out */,
+      size_t  local_n    /* in  */) {
+   double s = scalar;
+
+#  ifdef _OPENMP
+#  pragma omp parallel
+#  endif
+   {
+      size_t first, count;
+
+      Thread_block(local_n, &first, &count);
+      kernels.scale(s, local_arr + first, count);
+   }
+}  /* Parallel_vector_scalar */
+
+/*-------------------------------------------------------------------
+ * Function:  Parallel_vector_dot
+ * Purpose:   Compute the dot product of two vectors that have been
+ *            distributed among the processes
+ * In args:   sum:      SUM_ accumulation mode
+ *            reduce:   REDUCE_ mode of the reduction
+ *            h:        hierarchical reduction of comm, or NULL
+ *            local_x:  local storage of one of the vectors
+ *            local_y:  local storage for the second vector
+ *            local_n:  the number of components in local_x and local_y
+ *            comm:     communicator containing the calling processes
+ * Out arg:   result:  the dot product of the two vectors, on the
+ *            processes Reduce_dot_parts gives it to
+ */
+static void Parallel_vector_dot(
+      int       sum         /* in  */,
+      int       reduce      /* in  */,
+      Hier_t*   h           /* in  */,
+      elem_t    local_x[]   /* in  */,
+      elem_t    local_y[]   /* in  */,
+      size_t    local_n     /* in  */,
+      double*   result      /* out */,
+      MPI_Comm  comm        /* in  */) {
+
+   double part[BIN_PARTS];
+
+   Local_dot_parts(sum, 1, local_x, local_y, local_n, 0, part);
+   //Reduce los resultados de cada proceso hacia el proceso 0
+   Reduce_dot_parts(sum, reduce, h, part, result, comm);
+
+}  /* Parallel_vector_dot */
+
+/*-------------------------------------------------------------------
+ * Function:  Parallel_vector_scalar_dot
+ * Purpose:   Compute the dot product of scalar*x and scalar*y in a
+ *            single pass over the local blocks
+ * In args:   sum:          SUM_ accumulation mode
+ *            reduce:       REDUCE_ mode of the reduction
+ *            h:            hierarchical reduction of comm, or NULL
+ *            scalar:       number to multiply the vectors with
+ *            local_n:      the number of components in local_x and
+ *                          local_y
+ *            keep_scaled:  if nonzero, local_x and local_y are
+ *                          overwritten with the scaled vectors;
+ *                          otherwise they're left unchanged and the
+ *                          result is scalar^2 * (x . y)
+ *            my_rank:      calling process' rank in comm
+ *            comm:         communicator containing the calling
+ *                          processes
+ * In/out:    local_x, local_y:  local storage of the vectors
+ * Out arg:   result:       the dot product of the scaled vectors,
+ *                          on the processes Reduce_dot_parts gives
+ *                          it to
+ */
+static void Parallel_vector_scalar_dot(
+      int       sum          /* in     */,
+      int       reduce       /* in     */,
+      Hier_t*   h            /* in     */,
+      int       scalar       /* in     */,
+      elem_t    local_x[]    /* in/out */,
+      elem_t    local_y[]    /* in/out */,
+      size_t    local_n      /* in     */,
+      int       keep_scaled  /* in     */,
+      int       my_rank      /* in     */,
+      double*   result       /* out    */,
+      MPI_Comm  comm         /* in     */) {
+   double part[BIN_PARTS];
+   double s = scalar;
+
+   Local_dot_parts(sum, scalar, local_x, local_y, local_n, keep_scaled,
+         part);
+   Reduce_dot_parts(sum, reduce, h, part, result, comm);
+   if (!keep_scaled && (my_rank == 0 || reduce != REDUCE_ROOT))
+      *result *= s*s;
+}  /* Parallel_vector_scalar_dot */
+
+/*-------------------------------------------------------------------
+ * Function:  Local_vector_dot
+ * Purpose:   Compute the dot product of the local blocks of x and y
+ * In args:   local_x, local_y:  local blocks of the vectors
+ *            local_n:           the number of components in each
+ * Ret val:   the local dot product
+ *
+ * Note:
+ *    The partial sums of the threads are combined here, so the caller
+ *    only has to reduce one value per process.
+ */
+static double Local_vector_dot(
+      elem_t  local_x[]  /* in */,
+      elem_t  local_y[]  /* in */,
+      size_t  local_n    /* in */) {
+   double local_dot = 0.0;
+
+#  ifdef _OPENMP
+#  pragma omp parallel reduction(+: local_dot)
+#  endif
+   {
+      size_t first, count;
+
+      Thread_block(local_n, &first, &count);
+      local_dot += kernels.dot(local_x + first, local_y + first, count);
+   }
+   return local_dot;
+}  /* Local_vector_dot */
+
+/*-------------------------------------------------------------------
+ * Function:  Local_vector_scalar_dot
+ * Purpose:   Compute the dot product of the local blocks of scalar*x
+ *            and scalar*y in a single pass
+ * In args:   scalar:       number to multiply the vectors with
+ *            local_n:      the number of components in local_x and
+ *                          local_y
+ *            keep_scaled:  as in Parallel_vector_scalar_dot
+ * In/out:    local_x, local_y:  local blocks of the vectors
+ * Ret val:   the local dot product of the scaled blocks
+ */
+static double Local_vector_scalar_dot(
+      int     scalar       /* in     */,
+      elem_t  local_x[]    /* in/out */,
+      elem_t  local_y[]    /* in/out */,
+      size_t  local_n      /* in     */,
+      int     keep_scaled  /* in     */) {
+   double s = scalar;
+   double local_dot = 0.0;
+
+#  ifdef _OPENMP
+#  pragma omp parallel reduction(+: local_dot)
+#  endif
+   {
+      size_t first, count;
+
+      Thread_block(local_n, &first, &count);
+      if (keep_scaled)
+         local_dot += kernels.scale_dot(s, local_x + first,
+               local_y + first, count);
+      else
+         local_dot += kernels.dot(local_x + first, local_y + first, count);
+   }
+   if (!keep_scaled) local_dot *= s*s;
+   return local_dot;
+}  /* Local_vector_scalar_dot */
+
+/*-------------------------------------------------------------------
+ * Function:  Local_dot_parts
+ * Purpose:   Compute the local part of a dot product in accumulation
+ *            mode sum, ready for Reduce_dot_parts
+ * In args:   sum:      SUM_ mode (from --sum)
+ *            scalar:   number to multiply the vectors with if scale
+ *                      is nonzero
+ *            local_n:  the number of components in local_x and local_y
+ *            scale:    if nonzero, local_x and local_y are overwritten
+ *                      with scalar*x and scalar*y, and the dot product
+ *                      is that of the scaled vectors
+ * In/out:    local_x, local_y:  local blocks of the vectors
+ * Out arg:   part:     the local partial result (BIN_PARTS doubles):
+ *                      the sum for naive and pairwise, the sum and its
+ *                      error for comp, and a binned sum for binned
+ *
+ * Note:
+ *    pairwise and binned work through each thread's block SUM_BLOCK
+ *    or BIN_BLOCK elements at a time.  The kernels scale the elements
+ *    (if scale is set) as they load them, so x and y are read once.
+ *    The threads' parts are added in whatever order they finish, which
+ *    for binned gives the same bits.
+ */
+static void Local_dot_parts(
+      int       sum        /* in     */,
+      int       scalar     /* in     */,
+      elem_t    local_x[]  /* in/out */,
+      elem_t    local_y[]  /* in/out */,
+      size_t    local_n    /* in     */,
+      int       scale      /* in     */,
+      double    part[]     /* out    */) {
+   double s = scalar;
+
+   Init_dot_parts(sum, part);
+   if (sum == SUM_NAIVE) {
+      if (scale)
+         part[0] = Local_vector_scalar_dot(scalar, local_x, local_y,
+               local_n, 1);
+      else
+         part[0] = Local_vector_dot(local_x, local_y, local_n);
+      return;
+   }
+
+#  ifdef _OPENMP
+#  pragma omp parallel
+#  endif
+   {
+      double my_part[BIN_PARTS], level[64];
+      size_t first, count, b, len, blocks = 0;
+      size_t block = sum == SUM_BINNED ? BIN_BLOCK : SUM_BLOCK;
+
+      Init_dot_parts(sum, my_part);
+      Thread_block(local_n, &first, &count);
+      if (sum == SUM_COMP) {
+         kernels.dot_comp(s, local_x + first, local_y + first, count, scale,
+               my_part);
+      } else {
+         for (b = first; b < first + count; b += len) {
+            len = first + count - b < block ? first + count - b : block;
+            if (sum == SUM_PAIRWISE)
+               Pairwise_push(level, &blocks, scale
+                     ? kernels.scale_dot(s, local_x + b, local_y + b, len)
+                     : kernels.dot(local_x + b, local_y + b, len));
+            else
+               Bin_dot(s, local_x + b, local_y + b, len, scale, my_part);
+         }
+         if (sum == SUM_PAIRWISE) my_part[0] = Pairwise_total(level, blocks);
+      }
+
+#     ifdef _OPENMP
+#     pragma omp critical
+#     endif
+      Add_dot_parts(sum, part, my_part);
+   }
+}  /* Local_dot_parts */
+
+/*-------------------------------------------------------------------
+ * Function:  Init_dot_parts
+ * Purpose:   Make the part of an empty dot product
+ * In arg:    sum:   SUM_ mode of the part
+ * Out arg:   part:  the part (BIN_PARTS doubles)
+ */
+static void Init_dot_parts(
+      int     sum     /* in  */,
+      double  part[]  /* out */) {
+   memset(part, 0, BIN_PARTS*sizeof(double));
+   if (sum == SUM_BINNED) Bin_init(part);
+}  /* Init_dot_parts */
+
+/*-------------------------------------------------------------------
+ * Function:  Add_dot_parts
+ * Purpose:   Add one local part of a dot product to another in
+ *            accumulation mode sum
+ * In args:   sum:    SUM_ mode of the parts
+ *            other:  the part to add
+ * In/out:    part:   the sum; on return part += other
+ */
+static void Add_dot_parts(
+      int     sum      /* in     */,
+      double  part[]   /* in/out */,
+      double  other[]  /* in     */) {
+   if (sum == SUM_COMP) {
+      Two_sum_add(&part[0], &part[1], other[0]);
+      part[1] += other[1];
+   } else if (sum == SUM_BINNED) {
+      Bin_add(part, other);
+   } else {
+      part[0] += other[0];
+   }
+}  /* Add_dot_parts */
+
+/*-------------------------------------------------------------------
+ * Function:  Reduce_dot_parts
+ * Purpose:   Combine the parts from Local_dot_parts of all the
+ *            processes in reduction mode reduce
+ * In args:   sum:     SUM_ mode of the parts
+ *            reduce:  REDUCE_ mode (from --reduce)
+ *            h:       hierarchical reduction of comm (--hier), or NULL
+ *            part:    the calling process' part
+ *            comm:    communicator containing the calling processes
+ * Out arg:   result:  the dot product, on process 0 with reduce and on
+ *                     every process with allreduce and iallreduce
+ *
+ * Notes:
+ * 1. comp and binned parts are reduced with their own MPI_Ops.  Since
+ *    Bin_sum_op is exact, the order the MPI library picks for the
+ *    reduction doesn't change the bits of a binned result.
+ * 2. With h, the reduction goes through Hier_reduce.  h must have been
+ *    set up by Hier_init on comm, and can't be used with iallreduce.
+ */
+static void Reduce_dot_parts(
+      int       sum      /* in  */,
+      int       reduce   /* in  */,
+      Hier_t*   h        /* in  */,
+      double    part[]   /* in  */,
+      double*   result   /* out */,
+      MPI_Comm  comm     /* in  */) {
+   Dot_reduce_t dr;
+   int my_rank;
+
+   if (reduce == REDUCE_IALL) {
+      Start_dot_reduce(sum, part, &dr, comm);
+      Wait_dot_reduce(&dr, result);
+      return;
+   }
+   MPI_Comm_rank(comm, &my_rank);
+   Dot_reduce_ops(sum, &dr.type, &dr.op);
+   if (h != NULL)
+      Hier_reduce(h, part, dr.total, 1, sum == SUM_COMP ? 2
+            : sum == SUM_BINNED ? BIN_PARTS : 1, dr.type, dr.op,
+            reduce == REDUCE_ALL);
+   else if (reduce == REDUCE_ALL)
+      MPI_Allreduce(part, dr.total, 1, dr.type, dr.op, comm);
+   else
+      MPI_Reduce(part, dr.total, 1, dr.type, dr.op, 0, comm);
+   Free_dot_reduce_ops(sum, &dr.type, &dr.op);
+   if (my_rank == 0 || reduce == REDUCE_ALL)
+      *result = Dot_total(sum, dr.total);
+}  /* Reduce_dot_parts */
+
+/*-------------------------------------------------------------------
+ * Function:  Reduce_dot_batch
+ * Purpose:   Combine k dot product parts of all the processes with a
+ *            single collective in reduction mode reduce
+ * In args:   sum:      SUM_ mode of the parts
+ *            reduce:   REDUCE_ mode
+ *            h:        hierarchical reduction of comm, or NULL
+ *            parts:    the calling process' parts, part j at
+ *                      j*BIN_PARTS
+ *            k:        number of dot products
+ *            comm:     communicator containing the calling processes
+ * Out arg:   results:  the k dot products, where Reduce_dot_parts
+ *                      would put them
+ *
+ * Note:
+ *    The parts are packed to the width the sum mode actually uses,
+ *    so the message of naive and pairwise is k doubles.
+ */
+static void Reduce_dot_batch(
+      int       sum        /* in  */,
+      int       reduce     /* in  */,
+      Hier_t*   h          /* in  */,
+      double    parts[]    /* in  */,
+      double    results[]  /* out */,
+      int       k          /* in  */,
+      MPI_Comm  comm       /* in  */) {
+   int w = sum == SUM_COMP ? 2 : sum == SUM_BINNED ? BIN_PARTS : 1;
+   double total[BIN_PARTS];
+   double *send, *recv;
+   MPI_Datatype type;
+   MPI_Request req;
+   MPI_Op op;
+   int my_rank, j;
+
+   MPI_Comm_rank(comm, &my_rank);
+   send = malloc(2*(size_t) k*w*sizeof(double));
+   if (send == NULL) Record_error(ERR_ALLOC_TEMP);
+   Check_errors(comm);
+   recv = send + (size_t) k*w;
+   for (j = 0; j < k; j++)
+      memcpy(send + (size_t) j*w, parts + (size_t) j*BIN_PARTS,
+            w*sizeof(double));
+
+   Dot_reduce_ops(sum, &type, &op);
+   if (h != NULL) {
+      Hier_reduce(h, send, recv, k, w, type, op, reduce == REDUCE_ALL);
+   } else if (reduce == REDUCE_IALL) {
+      MPI_Iallreduce(send, recv, k, type, op, comm, &req);
+      MPI_Wait(&req, MPI_STATUS_IGNORE);
+   } else if (reduce == REDUCE_ALL) {
+      MPI_Allreduce(send, recv, k, type, op, comm);
+   } else {
+      MPI_Reduce(send, recv, k, type, op, 0, comm);
+   }
+   Free_dot_reduce_ops(sum, &type, &op);
+   if (my_rank == 0 || reduce != REDUCE_ROOT)
+      for (j = 0; j < k; j++) {
+         memcpy(total, recv + (size_t) j*w, w*sizeof(double));
+         results[j] = Dot_total(sum, total);
+      }
+   free(send);
+}  /* Reduce_dot_batch */
+
+/*-------------------------------------------------------------------
+ * Function:  Start_dot_reduce
+ * Purpose:   Start an MPI_Iallreduce of the parts from Local_dot_parts
+ * In args:   sum:   SUM_ mode of the parts
+ *            part:  the calling process' part; it mustn't change
+ *                   until Wait_dot_reduce
+ *            comm:  communicator containing the calling processes
+ * Out arg:   dr:    the reduction in progress
+ */
+static void Start_dot_reduce(
+      int            sum     /* in  */,
+      double         part[]  /* in  */,
+      Dot_reduce_t*  dr      /* out */,
+      MPI_Comm       comm    /* in  */) {
+   dr->sum = sum;
+   Dot_reduce_ops(sum, &dr->type, &dr->op);
+   MPI_Iallreduce(part, dr->total, 1, dr->type, dr->op, comm, &dr->req);
+}  /* Start_dot_reduce */
+
+/*-------------------------------------------------------------------
+ * Function:  Wait_dot_reduce
+ * Purpose:   Finish a reduction started with Start_dot_reduce
+ * In/out:    dr:      the reduction; its datatype and op are freed
+ * Out arg:   result:  the dot product, on every process
+ */
+static void Wait_dot_reduce(
+      Dot_reduce_t*  dr      /* in/out */,
+      double*        result  /* out    */) {
+   MPI_Wait(&dr->req, MPI_STATUS_IGNORE);
+   Free_dot_reduce_ops(dr->sum, &dr->type, &dr->op);
+   *result = Dot_total(dr->sum, dr->total);
+}  /* Wait_dot_reduce */
+
+/*-------------------------------------------------------------------
+ * Function:  Dot_reduce_ops
+ * Purpose:   Get the datatype and op that reduce the parts of
+ *            accumulation mode sum
+ * In arg:    sum:     SUM_ mode of the parts
+ * Out args:  type_p:  the datatype of one part
+ *            op_p:    the op
+ */
+static void Dot_reduce_ops(
+      int            sum     /* in  */,
+      MPI_Datatype*  type_p  /* out */,
+      MPI_Op*        op_p    /* out */) {
+   if (sum == SUM_NAIVE || sum == SUM_PAIRWISE) {
+      *type_p = MPI_DOUBLE;
+      *op_p = MPI_SUM;
+      return;
+   }
+   MPI_Type_contiguous(sum == SUM_COMP ? 2 : BIN_PARTS, MPI_DOUBLE,
+         type_p);
+   MPI_Type_commit(type_p);
+   MPI_Op_create(sum == SUM_COMP ? Comp_sum_op : Bin_sum_op, 1, op_p);
+}  /* Dot_reduce_ops */
+
+/*-------------------------------------------------------------------
+ * Function:  Free_dot_reduce_ops
+ * Purpose:   Free the datatype and op from Dot_reduce_ops
+ * In arg:    sum:           the SUM_ mode they were made for
+ * In/out:    type_p, op_p:  the datatype and op
+ */
+static void Free_dot_reduce_ops(
+      int            sum     /* in     */,
+      MPI_Datatype*  type_p  /* in/out */,
+      MPI_Op*        op_p    /* in/out */) {
+   if (sum == SUM_NAIVE || sum == SUM_PAIRWISE) return;
+   MPI_Op_free(op_p);
+   MPI_Type_free(type_p);
+}  /* Free_dot_reduce_ops */
+
+/*-------------------------------------------------------------------
+ * Function:  Hier_init
+ * Purpose:   Set up the node and leader communicators and the shared
+ *            window of a hierarchical reduction over comm
+ * In arg:    comm:  communicator of the calling processes
+ * Out arg:   h:     the hierarchical reduction
+ *
+ * Note:      Collective over comm.  The processes that can share
+ *            memory are found with MPI_Comm_split_type, and the node
+ *            leaders are the processes with node_rank 0; since both
+ *            splits keep the order of comm, process 0 of comm is
+ *            leader 0.
+ */
+static void Hier_init(
+      Hier_t*   h     /* out */,
+      MPI_Comm  comm  /* in  */) {
+   int my_rank;
+
+   MPI_Comm_rank(comm, &my_rank);
+   h->comm = comm;
+   MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, my_rank, MPI_INFO_NULL,
+         &h->node);
+   MPI_Comm_rank(h->node, &h->node_rank);
+   MPI_Comm_size(h->node, &h->node_sz);
+   MPI_Comm_split(comm, h->node_rank == 0 ? 0 : MPI_UNDEFINED, my_rank,
+         &h->leaders);
+   h->win = MPI_WIN_NULL;
+   h->base = NULL;
+   h->cap = 0;
+   h->parity = 0;
+   h->active = 1;
+   Hier_reserve(h, BIN_PARTS);
+}  /* Hier_init */
+
+/*-------------------------------------------------------------------
+ * Function:  Hier_free
+ * Purpose:   Free the communicators and window of a hierarchical
+ *            reduction; does nothing if Hier_init wasn't called
+ * In/out:    h:  the hierarchical reduction
+ */
+static void Hier_free(Hier_t* h /* in/out */) {
+   if (!h->active) return;
+   MPI_Win_unlock_all(h->win);
+   MPI_Win_free(&h->win);
+   if (h->leaders != MPI_COMM_NULL) MPI_Comm_free(&h->leaders);
+   MPI_Comm_free(&h->node);
+   h->active = 0;
+}  /* Hier_free */
+
+/*-------------------------------------------------------------------
+ * Function:  Hier_reserve
+ * Purpose:   Make the slots of the shared window hold at least cap
+ *            doubles
+ * In arg:    cap:  doubles needed in each slot
+ * In/out:    h:    the hierarchical reduction
+ *
+ * Note:      Collective over the node when the window has to grow,
+ *            so every process of the node has to ask for the same cap.
+ *            The window is allocated by the leader, next to the cores
+ *            that first touch it, and kept locked with lock_all.
+ */
+static void Hier_reserve(
+      Hier_t*  h    /* in/out */,
+      size_t   cap  /* in     */) {
+   MPI_Aint bytes;
+   int disp;
+
+   if (cap <= h->cap) return;
+   if (h->win != MPI_WIN_NULL) {
+      MPI_Win_unlock_all(h->win);
+      MPI_Win_free(&h->win);
+   }
+   bytes = h->node_rank == 0 ?
+      (MPI_Aint) (2*(h->node_sz + 1)*cap*sizeof(double)) : 0;
+   MPI_Win_allocate_shared(bytes, sizeof(double), MPI_INFO_NULL, h->node,
+         &h->base, &h->win);
+   MPI_Win_shared_query(h->win, 0, &bytes, &disp, &h->base);
+   MPI_Win_lock_all(MPI_MODE_NOCHECK, h->win);
+   h->cap = cap;
+}  /* Hier_reserve */
+
+/*-------------------------------------------------------------------
+ * Function:  Hier_reduce
+ * Purpose:   Reduce count elements of width doubles from every
+ *            process, first within each node through the shared
+ *            window and then across the node leaders
+ * In args:   send:   the calling process' elements
+ *            count:  the number of elements
+ *            width:  doubles in an element
+ *            type:   datatype of an element
+ *            op:     the op that combines elements
+ *            all:    nonzero to give the result to every process
+ * In/out:    h:      the hierarchical reduction
+ * Out arg:   recv:   the result, on process 0 of h->comm (on every
+ *                    process if all is set)
+ *
+ * Notes:
+ * 1. Each process copies its elements into its slot, and after a
+ *    barrier of the node the leader combines the slots in node_rank
+ *    order with MPI_Reduce_local, so only one message per node
+ *    crosses the network in the MPI_Reduce (or MPI_Allreduce) of the
+ *    leaders.  With all the leader puts the result in the result
+ *    slot, and a second barrier lets the others copy it.
+ * 2. The window has two sets of slots that are used in turn, so a
+ *    process can start the next reduction while its leader is still
+ *    reading this one:  it can't get past the next barrier until the
+ *    leader has finished.
+ */
+static void Hier_reduce(
+      Hier_t*       h       /* in/out */,
+      double        send[]  /* in     */,
+      double        recv[]  /* out    */,
+      int           count   /* in     */,
+      int           width   /* in     */,
+      MPI_Datatype  type    /* in     */,
+      MPI_Op        op      /* in     */,
+      int           all     /* in     */) {
+   size_t len = (size_t) count*width;
+   double *set, *out;
+   int q;
+
+   Hier_reserve(h, len);
+   set = h->base + h->parity*(h->node_sz + 1)*h->cap;
+   out = set + h->node_sz*h->cap;
+   h->parity ^= 1;
+
+   memcpy(set + h->node_rank*h->cap, send, len*sizeof(double));
+   MPI_Win_sync(h->win);
+   MPI_Barrier(h->node);
+   MPI_Win_sync(h->win);
+   if (h->node_rank == 0) {
+      for (q = 1; q < h->node_sz; q++)
+         MPI_Reduce_local(set + q*h->cap, set, count, type, op);
+      if (all)
+         MPI_Allreduce(set, out, count, type, op, h->leaders);
+      else
+         MPI_Reduce(set, recv, count, type, op, 0, h->leaders);
+   }
+   if (all) {
+      MPI_Win_sync(h->win);
+      MPI_Barrier(h->node);
+      MPI_Win_sync(h->win);
+      memcpy(recv, out, len*sizeof(double));
+   }
+}  /* Hier_reduce */
+
+/*-------------------------------------------------------------------
+ * Function:  Dot_total
+ * Purpose:   Turn the reduced parts into the dot product
+ * In arg:    sum:    SUM_ mode of the parts
+ * In/out:    total:  the reduced parts (normalized for binned)
+ * Ret val:   the dot product
+ */
+static double Dot_total(
+      int     sum      /* in     */,
+      double  total[]  /* in/out */) {
+   if (sum == SUM_COMP) return total[0] + total[1];
+   if (sum == SUM_BINNED) return Bin_total(total);
+   return total[0];
+}  /* Dot_total */
+
+/*-------------------------------------------------------------------
+ * Function:  Comp_sum_op
+ * Purpose:   MPI_Op for comp sums:  add (sum, error) pairs with the
+ *            error of the add carried into the error term
+ * In args:   in:     len pairs
+ *            len:    number of pairs
+ *            type:   the pair datatype (unused)
+ * In/out:    inout:  len pairs; on return inout[i] += in[i]
+ */
+static void Comp_sum_op(
+      void*          in     /* in     */,
+      void*          inout  /* in/out */,
+      int*           len    /* in     */,
+      MPI_Datatype*  type   /* in     */) {
+   double* a = in;
+   double* b = inout;
+   int i;
+
+   (void) type;  // Fixed by MPI_User_function
+   for (i = 0; i < *len; i++) {
+      Two_sum_add(&b[2*i], &b[2*i+1], a[2*i]);
+      b[2*i+1] += a[2*i+1];
+   }
+}  /* Comp_sum_op */
+
+/*-------------------------------------------------------------------
+ * Function:  Bin_sum_op
+ * Purpose:   MPI_Op for binned sums
+ * In args:   in:     len binned sums of BIN_PARTS doubles
+ *            len:    number of binned sums
+ *            type:   the binned sum datatype (unused)
+ * In/out:    inout:  len binned sums; on return inout[i] += in[i]
+ */
+static void Bin_sum_op(
+      void*          in     /* in     */,
+      void*          inout  /* in/out */,
+      int*           len    /* in     */,
+      MPI_Datatype*  type   /* in     */) {
+   double* a = in;
+   double* b = inout;
+   int i;
+
+   (void) type;  // Fixed by MPI_User_function
+   for (i = 0; i < *len; i++)
+      Bin_add(b + i*BIN_PARTS, a + i*BIN_PARTS);
+}  /* Bin_sum_op */
+
+/*-------------------------------------------------------------------
+ * Function:  Two_sum_add
+ * Purpose:   Add a to a compensated sum:  the rounded sum goes to
+ *            *sum_p and its rounding error (Knuth's TwoSum, which
+ *            needs no branch) is added to *comp_p
+ * In arg:    a:       the term
+ * In/out:    sum_p:   the sum
+ *            comp_p:  the accumulated error
+ */
+NO_CONTRACT void Two_sum_add(
+      double*  sum_p   /* in/out */,
+      double*  comp_p  /* in/out */,
+      double   a       /* in     */) {
+   double t = *sum_p + a;
+   double z = t - *sum_p;
+
+   *comp_p += (*sum_p - (t - z)) + (a - z);
+   *sum_p = t;
+}  /* Two_sum_add */
+
+/*-------------------------------------------------------------------
+ * Function:  Pairwise_push
+ * Purpose:   Add the sum of one more block to a pairwise sum.  level[k]
+ *            holds the sum of 2^k blocks, so blocks_p works like a
+ *            binary counter and a sum of N blocks has an error that
+ *            grows like log(N) instead of N.
+ * In arg:    block_sum:  sum of the next block
+ * In/out:    level:      partial sums, one per bit of *blocks_p
+ *            blocks_p:   number of blocks added so far
+ */
+static void Pairwise_push(
+      double   level[]    /* in/out */,
+      size_t*  blocks_p   /* in/out */,
+      double   block_sum  /* in     */) {
+   int k;
+
+   for (k = 0; (*blocks_p >> k) & 1; k++)
+      block_sum = level[k] + block_sum;
+   level[k] = block_sum;
+   (*blocks_p)++;
+}  /* Pairwise_push */
+
+/*-------------------------------------------------------------------
+ * Function:  Pairwise_total
+ * Purpose:   Finish a pairwise sum
+ * In args:   level:   partial sums from Pairwise_push
+ *            blocks:  number of blocks added
+ * Ret val:   the sum
+ */
+static double Pairwise_total(
+      double  level[]  /* in */,
+      size_t  blocks   /* in */) {
+   double total = 0.0;
+   int k;
+
+   for (k = 0; blocks >> k; k++)
+      if ((blocks >> k) & 1) total = level[k] + total;
+   return total;
+}  /* Pairwise_total */
+
+/*-------------------------------------------------------------------
+ * Binned sums
+ *
+ * A binned sum bin[] holds a top T (a multiple of BIN_WIDTH), and for
+ * each fold k = 0, ..., BIN_FOLDS-1 a sum A_k of multiples of
+ * u_k = 2^(T - (k+1)*BIN_WIDTH) and a count C_k of multiples of
+ * 2^BIN_WIDTH*u_k carried out of it:
+ *
+ *    bin[0] = T,  bin[1+k] = A_k,  bin[1+BIN_FOLDS+k] = C_k
+ *
+ * Each product p, with |p| < 2^(T-1), is split into a multiple of u_0,
+ * a multiple of u_1, ... and a remainder below u_(BIN_FOLDS-1)/2 that's
+ * dropped.  Adding and then subtracting 1.5*2^52*u rounds a value to a
+ * multiple of u, and every step of the split and of the sums is exact,
+ * so the pieces of a product don't depend on where, when or in what
+ * order it's added.  When a bigger product raises T by j*BIN_WIDTH the
+ * folds just move down j places and the lowest ones fall off, which is
+ * what splitting with the new T would have dropped.  So the value of a
+ * binned sum only depends on the products and the final T, i.e., on
+ * the largest product, and not on comm_sz or the number of threads.
+ *
+ * Products below 2^BIN_MIN_TOP or above 2^960 aren't split exactly.
+ *-------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------
+ * Function:  Bin_init
+ * Purpose:   Make an empty binned sum
+ * Out arg:   bin:  the binned sum (BIN_PARTS doubles)
+ */
+static void Bin_init(double bin[] /* out */) {
+   memset(bin, 0, BIN_PARTS*sizeof(double));
+   bin[0] = BIN_MIN_TOP;
+}  /* Bin_init */
+
+/*-------------------------------------------------------------------
+ * Function:  Bin_dot
+ * Purpose:   Add the products x[i]*y[i] of one block to a binned sum
+ * In args:   s:      number to multiply the blocks with if scale is
+ *                    nonzero
+ *            n:      the number of components in each, <= 2^20
+ *            scale:  if nonzero, x and y are overwritten with s*x and
+ *                    s*y, and their products are added
+ * In/out:    x, y:   the blocks
+ *            bin:    the binned sum, normalized on return
+ *
+ * Notes:
+ * 1. A fold stays exact as long as it gets fewer than
+ *    2^(52-BIN_WIDTH) pieces between normalizations.
+ * 2. The block is split with the current top, and the split also finds
+ *    the largest product.  Only if that raises the top is the block
+ *    split again, so most blocks are read once, and every product is
+ *    still split with a top that can take it.  The first split is the
+ *    one that scales the block.
+ */
+static void Bin_dot(
+      double  s      /* in     */,
+      elem_t  x[]    /* in/out */,
+      elem_t  y[]    /* in/out */,
+      size_t  n      /* in     */,
+      int     scale  /* in     */,
+      double  bin[]  /* in/out */) {
+   double m[BIN_FOLDS], sums[BIN_FOLDS];
+   int k, top;
+
+   do {
+      top = (int) bin[0];
+      m[0] = 0x1.8p52*ldexp(1.0, top - BIN_WIDTH);
+      for (k = 1; k < BIN_FOLDS; k++)
+         m[k] = m[k-1]*ldexp(1.0, -BIN_WIDTH);
+      Bin_raise_top(bin, kernels.bin_split(s, x, y, n, scale, m, sums));
+      scale = 0;
+   } while ((int) bin[0] != top);
+   for (k = 0; k < BIN_FOLDS; k++)
+      bin[1+k] += sums[k];
+   Bin_normalize(bin);
+}  /* Bin_dot */
+
+/*-------------------------------------------------------------------
+ * Function:  Bin_raise_top
+ * Purpose:   Raise the top of a binned sum, if needed, so that it can
+ *            take products up to max
+ * In arg:    max:  the largest |product| to be added
+ * In/out:    bin:  the binned sum
+ */
+static void Bin_raise_top(
+      double  bin[]  /* in/out */,
+      double  max    /* in     */) {
+   int e, top, shift, k;
+
+   if (max == 0.0) return;
+   frexp(max, &e);
+   // max < 2^e, and the top has to be at least e+1
+   top = e + 1 >= 0 ? (e + BIN_WIDTH)/BIN_WIDTH*BIN_WIDTH
+         : -((-(e + 1))/BIN_WIDTH*BIN_WIDTH);
+   if (top <= bin[0]) return;
+   shift = (top - (int) bin[0])/BIN_WIDTH;
+   for (k = BIN_FOLDS - 1; k >= 0; k--) {
+      bin[1+k] = k >= shift ? bin[1+k-shift] : 0.0;
+      bin[1+BIN_FOLDS+k] = k >= shift ? bin[1+BIN_FOLDS+k-shift] : 0.0;
+   }
+   bin[0] = top;
+}  /* Bin_raise_top */
+
+/*-------------------------------------------------------------------
+ * Function:  Bin_normalize
+ * Purpose:   Move the high part of each fold into its carry count, so
+ *            that A_k ends up in [0, 2^BIN_WIDTH*u_k)
+ * In/out:    bin:  the binned sum
+ *
+ * Note:
+ *    The carries are exact and round down, so a normalized binned sum
+ *    only depends on the exact value of each fold.
+ */
+static void Bin_normalize(double bin[] /* in/out */) {
+   double u, m, c;
+   int k;
+
+   for (k = 0; k < BIN_FOLDS; k++) {
+      u = ldexp(1.0, (int) bin[0] - k*BIN_WIDTH);
+      m = 0x1.8p52*u;
+      c = (m + bin[1+k]) - m;
+      if (c > bin[1+k]) c -= u;
+      bin[1+k] -= c;
+      bin[1+BIN_FOLDS+k] += c/u;
+   }
+}  /* Bin_normalize */
+
+/*-------------------------------------------------------------------
+ * Function:  Bin_add
+ * Purpose:   Add one binned sum to another
+ * In arg:    other:  the binned sum to add
+ * In/out:    bin:    the sum; on return bin += other, normalized
+ */
+static void Bin_add(
+      double  bin[]    /* in/out */,
+      double  other[]  /* in     */) {
+   double tmp[BIN_PARTS];
+   int k;
+
+   memcpy(tmp, other, sizeof(tmp));
+   if (tmp[0] > bin[0])
+      Bin_raise_top(bin, ldexp(1.0, (int) tmp[0] - 2));
+   else if (bin[0] > tmp[0])
+      Bin_raise_top(tmp, ldexp(1.0, (int) bin[0] - 2));
+   for (k = 1; k < BIN_PARTS; k++)
+      bin[k] += tmp[k];
+   Bin_normalize(bin);
+}  /* Bin_add */
+
+/*-------------------------------------------------------------------
+ * Function:  Bin_total
+ * Purpose:   Round a binned sum to a double
+ * In/out:    bin:  the binned sum; normalized on return
+ * Ret val:   the sum
+ *
+ * Note:
+ *    The folds and carries are added from the smallest up with a
+ *    compensated sum, so the result is within about an ulp of the
+ *    exact binned value.
+ */
+static double Bin_total(double bin[] /* in/out */) {
+   double sum = 0.0, comp = 0.0;
+   int k;
+
+   Bin_normalize(bin);
+   for (k = BIN_FOLDS - 1; k >= 0; k--) {
+      Two_sum_add(&sum, &comp, bin[1+k]);
+      Two_sum_add(&sum, &comp,
+            bin[1+BIN_FOLDS+k]*ldexp(1.0, (int) bin[0] - k*BIN_WIDTH));
+   }
+   return sum + comp;
+}  /* Bin_total */
+
+
+
+/*-------------------------------------------------------------------
+ * Function:  Local_triad
+ * Purpose:   STREAM triad on the local blocks:  local_z = local_x +
+ *            s*local_y.  It's the bandwidth the benchmark compares the
+ *            kernels with.
+ * In args:   s:                 the scalar
+ *            local_x, local_y:  local blocks of the vectors
+ *            local_n:           the number of components in each block
+ * Out arg:   local_z:           local block of the result
+ */
+static void Local_triad(
+      double  s          /* in  */,
+      elem_t  local_x[]  /* in  */,
+      elem_t  local_y[]  /* in  */,
+      elem_t  local_z[]  /* out */,
+      size_t  local_n    /* in  */) {
+#  ifdef _OPENMP
+#  pragma omp parallel
+#  endif
+   {
+      size_t first, count, i;
+
+      Thread_block(local_n, &first, &count);
+      for (i = first; i < first + count; i++)
+         local_z[i] = local_x[i] + s*local_y[i];
+   }
+}  /* Local_triad */
+
+/*-------------------------------------------------------------------
+ * Function:  Local_z
+ * Purpose:   Compute the local block of z for the add, axpy or mul in
+ *            ops, without any communication
+ * In args:   ops:               the --ops bits
+ *            s:                 the scalar of axpy
+ *            local_x, local_y:  local blocks of the vectors
+ *            local_n:           the number of components in each block
+ * Out arg:   local_z:           local block of z
+ */
+static void Local_z(
+      int     ops        /* in  */,
+      double  s          /* in  */,
+      elem_t  local_x[]  /* in  */,
+      elem_t  local_y[]  /* in  */,
+      elem_t  local_z[]  /* out */,
+      size_t  local_n    /* in  */) {
+#  ifdef _OPENMP
+#  pragma omp parallel
+#  endif
+   {
+      size_t first, count;
+
+      Thread_block(local_n, &first, &count);
+      if (ops & OP_ADD)
+         kernels.axpy(1.0, local_x + first, local_y + first,
+               local_z + first, count);
+      else if (ops & OP_AXPY)
+         kernels.axpy(s, local_x + first, local_y + first, local_z + first,
+               count);
+      else if (ops & OP_MUL)
+         kernels.mul(local_x + first, local_y + first, local_z + first,
+               count);
+   }
+}  /* Local_z */
+
+/*-------------------------------------------------------------------
+ * Function:  Z_expr
+ * Purpose:   Name the z operation in ops, for the previews
+ * In arg:    ops:  the --ops bits, with one of add, axpy and mul
+ * Ret val:   the right hand side of z = ...
+ */
+static const char* Z_expr(int ops /* in */) {
+   if (ops & OP_ADD) return "x + y";
+   if (ops & OP_AXPY) return "scalar*x + y";
+   return "x*y";
+}  /* Z_expr */
+
+/*-------------------------------------------------------------------
+ * Function:  Display_dot_result
+ * Purpose:   Add a vector that's been distributed among the processes
+ * In args:   local_x:  local storage of one of the vectors being added
+ *            local_y:  local storage for the second vector being added
+ *            local_n:  the number of components in local_x and local_y
+ *            my_rank: calling process' rank in comm
+ * Out arg:   result:  local storage for the dot product of the two vectors
+ */
+static void Display_dot_result(
+      int     my_rank    /* in  */,
+      double result      /* in  */) {
+   if(my_rank == 0) {
+      printf("\nResult of dot product: %lf\n",result);
+   }
+}  /* Display_dot_result */
+
+/*-------------------------------------------------------------------
+ * Function:  Parallel_blas1
+ * Purpose:   Run the BLAS-1 operations selected in ops in a single
+ *            pass over the local blocks:  z = x + y, z = scalar*x + y
+ *            or z = x*y, and the 2-norms (OP_NORM) and the largest and
+ *            smallest elements (OP_MAX) of x, y and, if it's computed,
+ *            z
+ * In args:   ops:          the --ops bits, with at most one of add,
+ *                          axpy and mul
+ *            reduce:       REDUCE_ mode of the sums
+ *            scalar:       the a of axpy
+ *            first_vec:    0 to reduce x, y and z, or 2 to reduce only
+ *                          z, when x's and y's results are already in
+ *                          res from an earlier call
+ *            local_x, local_y:  local blocks of the vectors
+ *            local_n:      the number of components in each block
+ *            local_first:  global index of the first local element
+ *            my_rank:      calling process' rank in comm
+ *            comm:         communicator containing the processes
+ * Out args:  local_z:      local block of z, if ops has add, axpy or
+ *                          mul
+ *            res:          the norms and extremes, on process 0 (on
+ *                          every process with REDUCE_ALL or
+ *                          REDUCE_IALL); only the entries of vectors
+ *                          first_vec and up are written
+ *
+ * Notes:
+ * 1. Each thread works through its block SUM_BLOCK elements at a time:
+ *    z is written with the axpy or mul kernel, and the norms and
+ *    extremes of the three blocks are taken while they're still in
+ *    cache, so x and y are only read from memory once.
+ * 2. The extremes are combined with one MPI_Allreduce of (value, rank)
+ *    pairs with MPI_MAXLOC (the smallest elements as the largest of
+ *    their negatives).  Ties go to the lowest rank, which owns the
+ *    lower global indices.  The index of MPI_DOUBLE_INT is an int, so
+ *    the winners' global indices are added, as doubles, into the
+ *    reduction of the sums of squares.
+ */
+static void Parallel_blas1(
+      int       ops          /* in  */,
+      int       reduce       /* in  */,
+      int       scalar       /* in  */,
+      int       first_vec    /* in  */,
+      elem_t    local_x[]    /* in  */,
+      elem_t    local_y[]    /* in  */,
+      elem_t    local_z[]    /* out */,
+      size_t    local_n      /* in  */,
+      size_t    local_first  /* in  */,
+      int       my_rank      /* in  */,
+      Blas1_t*  res          /* in/out */,
+      MPI_Comm  comm         /* in  */) {
+   struct { double val; int rank; } loc[6], all_loc[6];
+   double sums[9], all_sums[9];
+   double s = scalar;
+   int num_vecs = (ops & OP_Z) ? 3 : 2;
+   int v;
+
+   for (v = first_vec; v < 3; v++) {
+      res->nrm2[v] = 0.0;
+      res->max[v] = -HUGE_VAL;
+      res->min[v] = HUGE_VAL;
+      res->imax[v] = res->imin[v] = SIZE_MAX;
+   }
+
+#  ifdef _OPENMP
+#  pragma omp parallel private(v)
+#  endif
+   {
+      elem_t* vec[3];
+      Blas1_t my;
+      double max, min;
+      size_t first, count, b, len, imax, imin;
+
+      vec[0] = local_x;   vec[1] = local_y;   vec[2] = local_z;
+      for (v = 0; v < 3; v++) {
+         my.nrm2[v] = 0.0;
+         my.max[v] = -HUGE_VAL;
+         my.min[v] = HUGE_VAL;
+         my.imax[v] = my.imin[v] = SIZE_MAX;
+      }
+      Thread_block(local_n, &first, &count);
+      for (b = first; b < first + count; b += len) {
+         len = first + count - b < SUM_BLOCK ? first + count - b : SUM_BLOCK;
+         if (ops & OP_ADD)
+            kernels.axpy(1.0, local_x + b, local_y + b, local_z + b, len);
+         else if (ops & OP_AXPY)
+            kernels.axpy(s, local_x + b, local_y + b, local_z + b, len);
+         else if (ops & OP_MUL)
+            kernels.mul(local_x + b, local_y + b, local_z + b, len);
+         for (v = first_vec; v < num_vecs; v++) {
+            if (ops & OP_NORM)
+               my.nrm2[v] += kernels.dot(vec[v] + b, vec[v] + b, len);
+            if (ops & OP_MAX) {
+               Block_minmax(vec[v] + b, len, local_first + b, &max, &imax,
+                     &min, &imin);
+               if (max > my.max[v]) {
+                  my.max[v] = max;
+                  my.imax[v] = imax;
+               }
+               if (min < my.min[v]) {
+                  my.min[v] = min;
+                  my.imin[v] = imin;
+               }
+            }
+         }
+      }
+
+#     ifdef _OPENMP
+#     pragma omp critical
+#     endif
+      for (v = first_vec; v < num_vecs; v++) {
+         res->nrm2[v] += my.nrm2[v];
+         if (my.max[v] > res->max[v] ||
+               (my.max[v] == res->max[v] && my.imax[v] < res->imax[v])) {
+            res->max[v] = my.max[v];
+            res->imax[v] = my.imax[v];
+         }
+         if (my.min[v] < res->min[v] ||
+               (my.min[v] == res->min[v] && my.imin[v] < res->imin[v])) {
+            res->min[v] = my.min[v];
+            res->imin[v] = my.imin[v];
+         }
+      }
+   }
+
+   if (ops & OP_MAX) {
+      for (v = first_vec; v < num_vecs; v++) {
+         loc[2*v].val = res->max[v];
+         loc[2*v+1].val = -res->min[v];
+         loc[2*v].rank = loc[2*v+1].rank = my_rank;
+      }
+      MPI_Allreduce(loc + 2*first_vec, all_loc + 2*first_vec,
+            2*(num_vecs - first_vec), MPI_DOUBLE_INT, MPI_MAXLOC, comm);
+   }
+   for (v = 0; v < 3; v++) {
+      sums[v] = v >= first_vec ? res->nrm2[v] : 0.0;
+      sums[3+v] = sums[6+v] = 0.0;
+      if ((ops & OP_MAX) && v >= first_vec && v < num_vecs) {
+         if (all_loc[2*v].rank == my_rank) sums[3+v] = res->imax[v];
+         if (all_loc[2*v+1].rank == my_rank) sums[6+v] = res->imin[v];
+      }
+   }
+   if (reduce == REDUCE_ROOT)
+      MPI_Reduce(sums, all_sums, 9, MPI_DOUBLE, MPI_SUM, 0, comm);
+   else
+      MPI_Allreduce(sums, all_sums, 9, MPI_DOUBLE, MPI_SUM, comm);
+
+   if (my_rank == 0 || reduce != REDUCE_ROOT)
+      for (v = first_vec; v < num_vecs; v++) {
+         res->nrm2[v] = sqrt(all_sums[v]);
+         if (ops & OP_MAX) {
+            res->max[v] = all_loc[2*v].val;
+            res->min[v] = -all_loc[2*v+1].val;
+            res->imax[v] = (size_t) all_sums[3+v];
+            res->imin[v] = (size_t) all_sums[6+v];
+         }
+      }
+}  /* Parallel_blas1 */
+
+/*-------------------------------------------------------------------
+ * Function:  Block_minmax
+ * Purpose:   Find the largest and smallest elements of a block, and
+ *            the global indices of their first occurrences
+ * In args:   a:      the block
+ *            n:      the number of elements in a
+ *            first:  global index of a[0]
+ * Out args:  max_p, imax_p:  the largest element and its index
+ *            min_p, imin_p:  the smallest element and its index
+ *
+ * Note:      An empty block gives -HUGE_VAL and HUGE_VAL.
+ */
+static void Block_minmax(
+      elem_t   a[]     /* in  */,
+      size_t   n       /* in  */,
+      size_t   first   /* in  */,
+      double*  max_p   /* out */,
+      size_t*  imax_p  /* out */,
+      double*  min_p   /* out */,
+      size_t*  imin_p  /* out */) {
+   double max = -HUGE_VAL, min = HUGE_VAL, e;
+   size_t i, imax = 0, imin = 0;
+
+   for (i = 0; i < n; i++) {
+      e = (double) a[i];
+      if (e > max) {
+         max = e;
+         imax = i;
+      }
+      if (e < min) {
+         min = e;
+         imin = i;
+      }
+   }
+   *max_p = max;
+   *imax_p = first + imax;
+   *min_p = min;
+   *imin_p = first + imin;
+}  /* Block_minmax */
+
+/*-------------------------------------------------------------------
+ * Function:  Display_blas1
+ * Purpose:   Print the norms and extremes found by Parallel_blas1
+ * In args:   ops:        the --ops bits
+ *            first_vec:  0 to print x, y and z, or 2 to print only z
+ *            my_rank:    calling process' rank
+ *            res:        the results
+ *
+ * Note:      z is named by its operation, e.g. "z = x + y", since
+ *            several of add, axpy and mul can be printed in a run.
+ */
+static void Display_blas1(
+      int       ops        /* in */,
+      int       first_vec  /* in */,
+      int       my_rank    /* in */,
+      Blas1_t*  res        /* in */) {
+   char name[3][32];
+   int num_vecs = (ops & OP_Z) ? 3 : 2;
+   int v;
+
+   if (my_rank != 0) return;
+   strcpy(name[0], "x");
+   strcpy(name[1], "y");
+   if (ops & OP_Z) sprintf(name[2], "z = %s", Z_expr(ops));
+   if (ops & OP_NORM) {
+      printf("\n2-norms:\n");
+      for (v = first_vec; v < num_vecs; v++)
+         printf("||%s|| = %lf\n", name[v], res->nrm2[v]);
+   }
+   if ((ops & OP_MAX) && res->max[0] >= res->min[0]) {
+      printf("\nLargest and smallest elements:\n");
+      for (v = first_vec; v < num_vecs; v++)
+         printf("%s: max %lf at %zu, min %lf at %zu\n", name[v],
+               res->max[v], res->imax[v], res->min[v], res->imin[v]);
+   }
+}  /* Display_blas1 */
+
+/*-------------------------------------------------------------------
+ * Function:  Expr_compile
+ * Purpose:   Compile a --expr program
+ * In arg:    text:   the program:  statements separated by ';', each
+ *                    of them "v = e" with v one of x, y and z, or
+ *                    "dot(e, e)" or "sum(e)".  The expressions e are
+ *                    made of x, y, z, s (the --scalar), numbers, +, -,
+ *                    * and parentheses.
+ * Out args:  prog:   the compiled program
+ *            error:  a message if the program is wrong
+ * Ret val:   1 if the program compiled, 0 otherwise
+ *
+ * Note:      z can only be read after a statement has written it.
+ */
+static int Expr_compile(
+      char     text[]  /* in  */,
+      Expr_t*  prog    /* out */,
+      char     error[] /* out */) {
+   Expr_parser_t ps;
+
+   memset(prog, 0, sizeof(Expr_t));
+   ps.p = text;
+   ps.prog = prog;
+   ps.depth = 0;
+   ps.error = error;
+   error[0] = '\0';
+   while (error[0] == '\0') {
+      while (*ps.p == ' ' || *ps.p == ';') ps.p++;
+      if (*ps.p == '\0') break;
+      if (prog->num_stmts == EXPR_STMTS)
+         sprintf(error, "--expr has more than %d statements", EXPR_STMTS);
+      else
+         Expr_statement(&ps);
+   }
+   if (error[0] == '\0' && prog->num_stmts == 0)
+      strcpy(error, "--expr has no statements");
+   return error[0] == '\0';
+}  /* Expr_compile */
+
+/*-------------------------------------------------------------------
+ * Function:  Expr_statement
+ * Purpose:   Compile one statement of a --expr program, up to the ';'
+ *            or the end of the text after it
+ * In/out:    ps:  the parser
+ */
+static void Expr_statement(Expr_parser_t* ps /* in/out */) {
+   Expr_t* prog = ps->prog;
+   int k = prog->num_stmts;
+   char* start = ps->p;
+   char* end;
+   int v = -1, len;
+
+   if (*ps->p == 'x' || *ps->p == 'y' || *ps->p == 'z') {
+      for (end = ps->p + 1; *end == ' '; end++);
+      if (*end == '=') {
+         v = *ps->p - 'x';
+         ps->p = end + 1;
+      }
+   }
+   if (v >= 0) {
+      Expr_sum(ps);
+      Expr_emit(ps, EX_STORE, v, 0.0, -1);
+      prog->writes |= 1 << v;
+      prog->stmt_op[k] = EX_STORE;
+      prog->stmt_arg[k] = v;
+   } else if (strncmp(ps->p, "dot(", 4) == 0
+         || strncmp(ps->p, "sum(", 4) == 0) {
+      int op = ps->p[0] == 'd' ? EX_DOT : EX_SUM;
+
+      ps->p += 4;
+      Expr_sum(ps);
+      if (op == EX_DOT) {
+         if (*ps->p == ',') ps->p++;
+         else Expr_fail(ps, "','");
+         Expr_sum(ps);
+      }
+      if (*ps->p == ')') ps->p++;
+      else Expr_fail(ps, "')'");
+      Expr_emit(ps, op, prog->num_results, 0.0, op == EX_DOT ? -2 : -1);
+      prog->stmt_op[k] = op;
+      prog->stmt_arg[k] = prog->num_results++;
+   } else {
+      Expr_fail(ps, "x =, y =, z =, dot( or sum(");
+   }
+   while (*ps->p == ' ') ps->p++;
+   if (*ps->p != ';' && *ps->p != '\0') Expr_fail(ps, "';'");
+   if (ps->error[0] != '\0') return;
+
+   for (end = ps->p; end > start && end[-1] == ' '; end--);
+   len = end - start < EXPR_LABEL ? end - start : EXPR_LABEL - 1;
+   memcpy(prog->label[k], start, len);
+   prog->label[k][len] = '\0';
+   prog->num_stmts++;
+}  /* Expr_statement */
+
+/*-------------------------------------------------------------------
+ * Function:  Expr_sum
+ * Purpose:   Compile terms separated by + and -
+ * In/out:    ps:  the parser
+ */
+static void Expr_sum(Expr_parser_t* ps /* in/out */) {
+   int op;
+
+   Expr_term(ps);
+   while (ps->error[0] == '\0' && (*ps->p == '+' || *ps->p == '-')) {
+      op = *ps->p == '+' ? EX_ADD : EX_SUB;
+      ps->p++;
+      Expr_term(ps);
+      Expr_emit(ps, op, 0, 0.0, -1);
+   }
+}  /* Expr_sum */
+
+/*-------------------------------------------------------------------
+ * Function:  Expr_term
+ * Purpose:   Compile factors separated by *
+ * In/out:    ps:  the parser
+ */
+static void Expr_term(Expr_parser_t* ps /* in/out */) {
+   Expr_factor(ps);
+   while (ps->error[0] == '\0' && *ps->p == '*') {
+      ps->p++;
+      Expr_factor(ps);
+      Expr_emit(ps, EX_MUL, 0, 0.0, -1);
+   }
+}  /* Expr_term */
+
+/*-------------------------------------------------------------------
+ * Function:  Expr_factor
+ * Purpose:   Compile a vector, s, a number, a negated factor or an
+ *            expression in parentheses, and the spaces after it
+ * In/out:    ps:  the parser
+ */
+static void Expr_factor(Expr_parser_t* ps /* in/out */) {
+   char* end;
+   double value;
+   int v;
+
+   while (*ps->p == ' ') ps->p++;
+   if (*ps->p == '(') {
+      ps->p++;
+      Expr_sum(ps);
+      if (*ps->p == ')') ps->p++;
+      else Expr_fail(ps, "')'");
+   } else if (*ps->p == '-') {
+      ps->p++;
+      Expr_factor(ps);
+      Expr_emit(ps, EX_NEG, 0, 0.0, 0);
+   } else if (*ps->p == 'x' || *ps->p == 'y' || *ps->p == 'z') {
+      v = *ps->p++ - 'x';
+      if (v == 2 && !(ps->prog->writes & 4) && ps->error[0] == '\0')
+         strcpy(ps->error, "--expr reads z before writing it");
+      Expr_emit(ps, EX_VEC, v, 0.0, 1);
+      ps->prog->reads |= 1 << v;
+   } else if (*ps->p == 's') {
+      ps->p++;
+      Expr_emit(ps, EX_SCALAR, 0, 0.0, 1);
+      ps->prog->scalar = 1;
+   } else {
+      value = strtod(ps->p, &end);
+      if (end == ps->p) {
+         Expr_fail(ps, "a vector, s, a number or '('");
+         return;
+      }
+      ps->p = end;
+      Expr_emit(ps, EX_CONST, 0, value, 1);
+   }
+   while (*ps->p == ' ') ps->p++;
+}  /* Expr_factor */
+
+/*-------------------------------------------------------------------
+ * Function:  Expr_emit
+ * Purpose:   Append an operation to the code of a --expr program
+ * In args:   op, arg, value:  the operation
+ *            push:            how much it grows the stack (negative
+ *                             if it pops values)
+ * In/out:    ps:              the parser
+ */
+static void Expr_emit(
+      Expr_parser_t*  ps     /* in/out */,
+      int             op     /* in     */,
+      int             arg    /* in     */,
+      double          value  /* in     */,
+      int             push   /* in     */) {
+   Expr_t* prog = ps->prog;
+
+   if (ps->error[0] != '\0') return;
+   if (prog->len == EXPR_CODE) {
+      strcpy(ps->error, "--expr is too long");
+      return;
+   }
+   ps->depth += push;
+   if (ps->depth > EXPR_STACK) {
+      strcpy(ps->error, "--expr is nested too deeply");
+      return;
+   }
+   prog->code[prog->len].op = op;
+   prog->code[prog->len].arg = arg;
+   prog->code[prog->len].value = value;
+   prog->len++;
+}  /* Expr_emit */
+
+/*-------------------------------------------------------------------
+ * Function:  Expr_fail
+ * Purpose:   Record the first syntax error of a --expr program
+ * In args:   what:  what was expected
+ * In/out:    ps:    the parser
+ */
+static void Expr_fail(
+      Expr_parser_t*  ps      /* in/out */,
+      char            what[]  /* in     */) {
+   if (ps->error[0] == '\0')
+      sprintf(ps->error, "--expr: expected %.40s at \"%.20s\"", what, ps->p);
+}  /* Expr_fail */
+
+/*-------------------------------------------------------------------
+ * Function:  Run_expr
+ * Purpose:   Run the compiled --expr program on the local blocks and
+ *            print its results
+ * In args:   params:       the run parameters, with the program
+ *            n:            order of the global vectors
+ *            local_n:      size of the local blocks
+ *            my_rank:      calling process' rank in comm
+ *            comm:         communicator containing the processes
+ * In/out:    local_x, local_y, local_z:  local blocks of the vectors
+ *                          (local_z only if the program writes z)
+ *
+ * Notes:
+ * 1. Each thread runs the whole program on one EXPR_TILE-element tile
+ *    of its block before going on to the next one, so the
+ *    intermediate values stay in cache, and with several statements
+ *    (e.g., "x = s*x; y = s*y; dot(x, y)") x and y are still only
+ *    read from memory once.
+ * 2. The results of all the dot and sum statements are reduced with a
+ *    single MPI_Reduce (MPI_Allreduce with --reduce allreduce or
+ *    iallreduce).  They're plain sums of doubles, whatever --sum is.
+ */
+static void Run_expr(
+      Params_t*  params     /* in     */,
+      elem_t     local_x[]  /* in/out */,
+      elem_t     local_y[]  /* in/out */,
+      elem_t     local_z[]  /* in/out */,
+      size_t     n          /* in     */,
+      size_t     local_n    /* in     */,
+      int        my_rank    /* in     */,
+      MPI_Comm   comm       /* in     */) {
+   Expr_t* prog = &params->prog;
+   elem_t* vec[3];
+   double results[EXPR_STMTS] = {0.0}, totals[EXPR_STMTS];
+   double s = params->scalar;
+   char title[EXPR_LABEL + 8];
+   int k, j;
+
+   vec[0] = local_x;   vec[1] = local_y;   vec[2] = local_z;
+#  ifdef _OPENMP
+#  pragma omp parallel private(k)
+#  endif
+   {
+      double buf[EXPR_STACK][EXPR_TILE];
+      double my_results[EXPR_STMTS] = {0.0};
+      size_t first, count, b, len;
+
+      Thread_block(local_n, &first, &count);
+      for (b = first; b < first + count; b += len) {
+         len = first + count - b < EXPR_TILE ? first + count - b : EXPR_TILE;
+         Expr_tile(prog, vec, b, len, s, buf, my_results);
+      }
+
+#     ifdef _OPENMP
+#     pragma omp critical
+#     endif
+      for (k = 0; k < prog->num_results; k++)
+         results[k] += my_results[k];
+   }
+
+   if (prog->num_results > 0) {
+      if (params->reduce == REDUCE_ROOT)
+         MPI_Reduce(results, totals, prog->num_results, MPI_DOUBLE, MPI_SUM,
+               0, comm);
+      else
+         MPI_Allreduce(results, totals, prog->num_results, MPI_DOUBLE,
+               MPI_SUM, comm);
+   }
+
+   // Results in statement order, and each vector after its last store
+   for (k = 0; k < prog->num_stmts; k++) {
+      if (prog->stmt_op[k] != EX_STORE) {
+         if (my_rank == 0)
+            printf("\n%s = %lf\n", prog->label[k], totals[prog->stmt_arg[k]]);
+         continue;
+      }
+      for (j = k + 1; j < prog->num_stmts; j++)
+         if (prog->stmt_op[j] == EX_STORE
+               && prog->stmt_arg[j] == prog->stmt_arg[k]) break;
+      if (j == prog->num_stmts && (params->ops & OP_PRINT)) {
+         snprintf(title, sizeof(title), "Vector %s", prog->label[k]);
+         PrintTopDown_vector(vec[prog->stmt_arg[k]], n, title,
+               my_rank, comm);
+      }
+   }
+}  /* Run_expr */
+
+/*-------------------------------------------------------------------
+ * Function:  Expr_tile
+ * Purpose:   Run a compiled --expr program on one tile of the blocks
+ * In args:   prog:     the program
+ *            first:    local index of the first element of the tile
+ *            len:      the number of elements in the tile
+ *            s:        the --scalar
+ * In/out:    vec:      the local blocks of x, y and z
+ *            results:  the sums of the dot and sum statements
+ * Scratch:   buf:      a tile for each stack slot
+ *
+ * Note:      Numbers and s stay scalars on the stack, so s*x is one
+ *            multiplication per element.  With doubles the vectors
+ *            aren't copied either:  the stack points to the blocks.
+ */
+static void Expr_tile(
+      Expr_t*  prog               /* in      */,
+      elem_t*  vec[]              /* in/out  */,
+      size_t   first              /* in      */,
+      size_t   len                /* in      */,
+      double   s                  /* in      */,
+      double   buf[][EXPR_TILE]   /* scratch */,
+      double   results[]          /* in/out  */) {
+   Expr_val_t stack[EXPR_STACK];
+   Expr_code_t* c;
+   int sp = 0, k;
+   size_t i;
+
+   for (k = 0; k < prog->len; k++) {
+      c = &prog->code[k];
+      switch (c->op) {
+         case EX_VEC:
+#           ifdef ELEM_DOUBLE
+            stack[sp].t = vec[c->arg] + first;
+#           else
+            for (i = 0; i < len; i++)
+               buf[sp][i] = (double) vec[c->arg][first + i];
+            stack[sp].t = buf[sp];
+#           endif
+            sp++;
+            break;
+         case EX_CONST:
+         case EX_SCALAR:
+            stack[sp].t = NULL;
+            stack[sp].c = c->op == EX_CONST ? c->value : s;
+            sp++;
+            break;
+         case EX_ADD:
+         case EX_SUB:
+         case EX_MUL:
+            Expr_binary(c->op, &stack[sp-2], &stack[sp-1], buf[sp-2], len);
+            sp--;
+            break;
+         case EX_NEG:
+            if (stack[sp-1].t == NULL) {
+               stack[sp-1].c = -stack[sp-1].c;
+            } else {
+               for (i = 0; i < len; i++)
+                  buf[sp-1][i] = -stack[sp-1].t[i];
+               stack[sp-1].t = buf[sp-1];
+            }
+            break;
+         case EX_STORE:
+            sp--;
+            for (i = 0; i < len; i++)
+               vec[c->arg][first + i] = (elem_t)
+                  (stack[sp].t != NULL ? stack[sp].t[i] : stack[sp].c);
+            break;
+         case EX_DOT:
+            sp -= 2;
+            results[c->arg] += Expr_dot(&stack[sp], &stack[sp+1], len);
+            break;
+         case EX_SUM:
+            sp--;
+            stack[sp+1].t = NULL;
+            stack[sp+1].c = 1.0;
+            results[c->arg] += Expr_dot(&stack[sp], &stack[sp+1], len);
+            break;
+      }
+   }
+}  /* Expr_tile */
+
+/*-------------------------------------------------------------------
+ * Function:  Expr_binary
+ * Purpose:   Add, subtract or multiply two values of an Expr_tile
+ *            stack
+ * In args:   op:   EX_ADD, EX_SUB or EX_MUL
+ *            b:    the right operand
+ *            len:  the number of elements in a tile
+ * In/out:    a:    the left operand, replaced by the result
+ * Out arg:   out:  storage for the result if it's a tile (it can be
+ *                  a's tile)
+ */
+static void Expr_binary(
+      int          op     /* in     */,
+      Expr_val_t*  a      /* in/out */,
+      Expr_val_t*  b      /* in     */,
+      double       out[]  /* out    */,
+      size_t       len    /* in     */) {
+   size_t i;
+
+   // One loop for each operator and kind of operands, so the compiler
+   // can vectorize each of them
+#  define EXPR_LOOPS(OP) \
+   if (a->t == NULL && b->t == NULL) { \
+      a->c = a->c OP b->c; \
+      return; \
+   } else if (b->t == NULL) { \
+      for (i = 0; i < len; i++) out[i] = a->t[i] OP b->c; \
+   } else if (a->t == NULL) { \
+      for (i = 0; i < len; i++) out[i] = a->c OP b->t[i]; \
+   } else { \
+      for (i = 0; i < len; i++) out[i] = a->t[i] OP b->t[i]; \
+   }
+   if (op == EX_ADD) {
+      EXPR_LOOPS(+)
+   } else if (op == EX_SUB) {
+      EXPR_LOOPS(-)
+   } else {
+      EXPR_LOOPS(*)
+   }
+#  undef EXPR_LOOPS
+   a->t = out;
+}  /* Expr_binary */
+
+/*-------------------------------------------------------------------
+ * Function:  Expr_dot
+ * Purpose:   Compute the dot product of two values of an Expr_tile
+ *            stack
+ * In args:   a, b:  the values
+ *            len:   the number of elements in a tile
+ * Ret val:   the sum of a[i]*b[i] over the tile
+ */
+static double Expr_dot(
+      Expr_val_t*  a    /* in */,
+      Expr_val_t*  b    /* in */,
+      size_t       len  /* in */) {
+   double d0 = 0.0, d1 = 0.0, d2 = 0.0, d3 = 0.0, c = 1.0;
+   double* t = NULL;
+   size_t i;
+
+   if (a->t != NULL && b->t != NULL) {
+      for (i = 0; i + 4 <= len; i += 4) {
+         d0 += a->t[i]*b->t[i];
+         d1 += a->t[i+1]*b->t[i+1];
+         d2 += a->t[i+2]*b->t[i+2];
+         d3 += a->t[i+3]*b->t[i+3];
+      }
+      for (; i < len; i++)
+         d0 += a->t[i]*b->t[i];
+      return (d0 + d1) + (d2 + d3);
+   }
+
+   // c times the sum of the other operand
+   if (a->t == NULL) {
+      c = a->c;
+      t = b->t;
+      if (t == NULL) return c*b->c*len;
+   } else {
+      c = b->c;
+      t = a->t;
+   }
+   for (i = 0; i + 4 <= len; i += 4) {
+      d0 += t[i];
+      d1 += t[i+1];
+      d2 += t[i+2];
+      d3 += t[i+3];
+   }
+   for (; i < len; i++)
+      d0 += t[i];
+   return c*((d0 + d1) + (d2 + d3));
+}  /* Expr_dot */
+
+/*-------------------------------------------------------------------
+ * Function:  Vec_ctx_init
+ * Purpose:   Set up a library context on the processes of comm
+ * In args:   comm:    communicator of the calling processes
+ *            sum:     SUM_ accumulation mode of the dot products
+ *            reduce:  REDUCE_ mode of the dot products
+ *            rng:     RNG_ engine of Vec_ctx_generate
+ * Out arg:   ctx:     the context
+ * Ret val:   0, or ERR_ARG if a mode is out of range (and then ctx
+ *            isn't set up)
+ *
+ * Notes:
+ * 1. Collective over comm.  The context works on a duplicate of comm,
+ *    so its messages never match the caller's.
+ * 2. The modes are kept in the context, so contexts with different
+ *    modes can be used side by side, and the program's --sum, --reduce
+ *    and --rng aren't involved.
+ * 3. The reduction of Vec_ctx_dot is set up here once, as persistent
+ *    requests (see Ctx_tree_init), so each dot product only starts
+ *    and waits for them.
+ */
+int Vec_ctx_init(
+      Vec_ctx_t*  ctx     /* out */,
+      MPI_Comm    comm    /* in  */,
+      int         sum     /* in  */,
+      int         reduce  /* in  */,
+      int         rng     /* in  */) {
+   memset(ctx, 0, sizeof(*ctx));
+   if (sum < SUM_NAIVE || sum > SUM_BINNED || reduce < REDUCE_ROOT
+         || reduce > REDUCE_IALL || rng < RNG_SPLITMIX || rng > RNG_XOSHIRO)
+      return ERR_ARG;
+   ctx->sum = sum;
+   ctx->reduce = reduce;
+   ctx->rng = rng;
+   MPI_Comm_dup(comm, &ctx->comm);
+   MPI_Comm_rank(ctx->comm, &ctx->my_rank);
+   MPI_Comm_size(ctx->comm, &ctx->comm_sz);
+   if (kernels.name == NULL) Select_kernels();
+   Ctx_tree_init(ctx);
+   return 0;
+}  /* Vec_ctx_init */
+
+/*-------------------------------------------------------------------
+ * Function:  Vec_ctx_free
+ * Purpose:   Free a context and all the blocks in its pool
+ * In/out:    ctx:  the context
+ *
+ * Note:
+ *    Collective over the context's communicator.  Blocks from
+ *    Vec_ctx_alloc can't be used after this.
+ */
+void Vec_ctx_free(Vec_ctx_t* ctx /* in/out */) {
+   int i;
+
+   for (i = 0; i < POOL_SIZE; i++)
+      Free_vector(ctx->pool[i], ctx->pool_n[i]);
+   for (i = 0; i <= VEC_TREE; i++) {
+      if (ctx->up[i] != MPI_REQUEST_NULL) MPI_Request_free(&ctx->up[i]);
+      if (ctx->down[i] != MPI_REQUEST_NULL)
+         MPI_Request_free(&ctx->down[i]);
+   }
+   Free_dot_reduce_ops(ctx->sum, &ctx->type, &ctx->op);
+   MPI_Comm_free(&ctx->comm);
+}  /* Vec_ctx_free */
+
+/*-------------------------------------------------------------------
+ * Function:  Vec_ctx_errors
+ * Purpose:   Find out whether any process' Vec_ctx_* calls have failed
+ *            since the last Vec_ctx_errors
+ * In/out:    ctx:  the context; its errors are cleared
+ * Ret val:   the ERR_ bits of all the processes, or 0
+ *
+ * Note:
+ *    Collective over the context's communicator, with a single
+ *    MPI_Allreduce, like Check_errors, but the errors are returned to
+ *    the caller instead of ending the program.
+ */
+int Vec_ctx_errors(Vec_ctx_t* ctx /* in/out */) {
+   int errors;
+
+   MPI_Allreduce(&ctx->errors, &errors, 1, MPI_INT, MPI_BOR, ctx->comm);
+   ctx->errors = 0;
+   return errors;
+}  /* Vec_ctx_errors */
+
+/*-------------------------------------------------------------------
+ * Function:  Vec_ctx_block
+ * Purpose:   Get the calling process' block of a vector of order n
+ * In args:   ctx:        the context
+ *            n:          order of the vector
+ * Out args:  first_p:    global index of the first local element
+ *            local_n_p:  number of local elements
+ */
+void Vec_ctx_block(
+      Vec_ctx_t*  ctx        /* in  */,
+      size_t      n          /* in  */,
+      size_t*     first_p    /* out */,
+      size_t*     local_n_p  /* out */) {
+   Block_range(n, ctx->comm_sz, ctx->my_rank, first_p, local_n_p);
+}  /* Vec_ctx_block */
+
+/*-------------------------------------------------------------------
+ * Function:  Vec_ctx_alloc
+ * Purpose:   Get a block of local_n elements from the context's pool
+ * In arg:    local_n:  number of elements
+ * In/out:    ctx:      the context
+ * Ret val:   the block, or NULL if it can't be allocated
+ *
+ * Errors:    A failed allocation also sets ERR_ALLOC_VECTOR in the
+ *            context, so the processes can agree on it with
+ *            Vec_ctx_errors.
+ *
+ * Note:
+ *    The smallest free block that's big enough is reused.  Otherwise
+ *    a free slot gets a new block from Allocate_vector (after the
+ *    slot's old, too small, block is freed).  Blocks are only given
+ *    back to the system by Vec_ctx_free.
+ */
+elem_t* Vec_ctx_alloc(
+      Vec_ctx_t*  ctx      /* in/out */,
+      size_t      local_n  /* in     */) {
+   int i, best = -1;
+
+   for (i = 0; i < POOL_SIZE; i++)
+      if (!ctx->pool_busy[i] && ctx->pool[i] != NULL
+            && ctx->pool_n[i] >= local_n
+            && (best < 0 || ctx->pool_n[i] < ctx->pool_n[best]))
+         best = i;
+   if (best < 0) {
+      for (i = 0; i < POOL_SIZE; i++)
+         if (!ctx->pool_busy[i]
+               && (best < 0 || ctx->pool[best] != NULL))
+            best = i;
+      if (best < 0) {
+         ctx->errors |= ERR_ALLOC_VECTOR;
+         return NULL;
+      }
+      Free_vector(ctx->pool[best], ctx->pool_n[best]);
+      ctx->pool_n[best] = local_n > 0 ? local_n : 1;
+      Allocate_vector(&ctx->pool[best], ctx->pool_n[best]);
+      if (ctx->pool[best] == NULL) {
+         ctx->pool_n[best] = 0;
+         ctx->errors |= ERR_ALLOC_VECTOR;
+         return NULL;
+      }
+   }
+   ctx->pool_busy[best] = 1;
+   return ctx->pool[best];
+}  /* Vec_ctx_alloc */
+
+/*-------------------------------------------------------------------
+ * Function:  Vec_ctx_release
+ * Purpose:   Give a block from Vec_ctx_alloc back to the pool
+ * In arg:    local_a:  the block (NULL is ignored)
+ * In/out:    ctx:      the context
+ */
+void Vec_ctx_release(
+      Vec_ctx_t*  ctx        /* in/out */,
+      elem_t      local_a[]  /* in     */) {
+   int i;
+
+   for (i = 0; i < POOL_SIZE; i++)
+      if (ctx->pool[i] == local_a && local_a != NULL)
+         ctx->pool_busy[i] = 0;
+}  /* Vec_ctx_release */
+
+/*-------------------------------------------------------------------
+ * Function:  Vec_ctx_generate
+ * Purpose:   Generate the calling process' block of a vector of
+ *            order n, as Generate_local_vector does
+ * In args:   ctx:      the context
+ *            n:        order of the vector
+ *            stream:   which vector of the seed
+ *            randmax:  the elements are in [0, randmax)
+ *            seed:     the seed (the same on every process)
+ * Out arg:   local_a:  the block (from Vec_ctx_block)
+ * Ret val:   0, or ERR_ARG (also set in the context) if randmax <= 0
+ */
+int Vec_ctx_generate(
+      Vec_ctx_t*  ctx        /* in  */,
+      elem_t      local_a[]  /* out */,
+      size_t      n          /* in  */,
+      uint64_t    stream     /* in  */,
+      int         randmax    /* in  */,
+      uint64_t    seed       /* in  */) {
+   size_t first, local_n;
+
+   if (randmax <= 0) {
+      ctx->errors |= ERR_ARG;
+      return ERR_ARG;
+   }
+   Vec_ctx_block(ctx, n, &first, &local_n);
+   Generate_local_vector(ctx->rng, local_a, local_n, first, stream, randmax,
+         seed);
+   return 0;
+}  /* Vec_ctx_generate */
+
+/*-------------------------------------------------------------------
+ * Function:  Vec_ctx_scale
+ * Purpose:   Multiply the local block of a vector by a scalar
+ * In args:   scalar:   the scalar
+ *            local_n:  number of local elements
+ * In/out:    ctx:      the context
+ *            local_a:  the block
+ * Ret val:   0, or ERR_ARG (also set in the context) if local_a is
+ *            NULL, or ERR_ARG if ctx is
+ */
+int Vec_ctx_scale(
+      Vec_ctx_t*  ctx        /* in/out */,
+      int         scalar     /* in     */,
+      elem_t      local_a[]  /* in/out */,
+      size_t      local_n    /* in     */) {
+   if (ctx == NULL) return ERR_ARG;
+   if (local_a == NULL && local_n > 0) {
+      ctx->errors |= ERR_ARG;
+      return ERR_ARG;
+   }
+   Parallel_vector_scalar(scalar, local_a, local_n);
+   return 0;
+}  /* Vec_ctx_scale */
+
+/*-------------------------------------------------------------------
+ * Function:  Vec_ctx_dot
+ * Purpose:   Compute the dot product of two distributed vectors, or of
+ *            scalar*x and scalar*y if scale is nonzero
+ * In args:   ctx:      the context
+ *            scalar:   the scalar
+ *            local_n:  number of local elements
+ *            scale:    if nonzero, local_x and local_y are overwritten
+ *                      with the scaled vectors
+ * In/out:    local_x, local_y:  the local blocks
+ * Ret val:   the dot product, on process 0 with REDUCE_ROOT and on
+ *            every process otherwise, or 0 (and ERR_ARG is set in the
+ *            context) if a local block is NULL
+ *
+ * Note:
+ *    Collective over the context's communicator.  The parts go
+ *    through the context's persistent requests (Ctx_tree_reduce).  A
+ *    process with a NULL block still takes part in the reduction,
+ *    with an empty part, so the others don't hang.  A NULL ctx has no
+ *    communicator, so the call just returns 0.
+ */
+double Vec_ctx_dot(
+      Vec_ctx_t*  ctx        /* in/out */,
+      int         scalar     /* in     */,
+      elem_t      local_x[]  /* in/out */,
+      elem_t      local_y[]  /* in/out */,
+      size_t      local_n    /* in     */,
+      int         scale      /* in     */) {
+   if (ctx == NULL) return 0.0;
+   if (local_n > 0 && (local_x == NULL || local_y == NULL)) {
+      ctx->errors |= ERR_ARG;
+      Init_dot_parts(ctx->sum, ctx->part);
+      Ctx_tree_reduce(ctx);
+      return 0.0;
+   }
+   Local_dot_parts(ctx->sum, scalar, local_x, local_y, local_n, scale,
+         ctx->part);
+   return Ctx_tree_reduce(ctx);
+}  /* Vec_ctx_dot */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Ctx_tree_init
+ * Purpose:   Set up the persistent requests of a context's dot
+ *            product reduction
+ * In/out:    ctx:  the context, with its communicator and modes set
+ *
+ * Notes:
+ * 1. The processes form a binomial tree rooted at 0:  rank r's parent
+ *    is r with its lowest set bit cleared, and its children are
+ *    r + 1, r + 2, r + 4, ... below that bit.  up[0..num_children)
+ *    receive the children's parts into child[], and up[num_children]
+ *    sends the combined part to the parent.  down[0] receives the
+ *    total from the parent into part, and down[1..num_children]
+ *    send it to the children.  Unused requests are
+ *    MPI_REQUEST_NULL.
+ * 2. The messages are one part of the type from Dot_reduce_ops, on
+ *    the context's own communicator, so a tag per direction is
+ *    enough.
+ */
+static void Ctx_tree_init(Vec_ctx_t* ctx /* in/out */) {
+   int mask, c = 0, i;
+
+   for (i = 0; i <= VEC_TREE; i++)
+      ctx->up[i] = ctx->down[i] = MPI_REQUEST_NULL;
+   Dot_reduce_ops(ctx->sum, &ctx->type, &ctx->op);
+   for (mask = 1; mask < ctx->comm_sz && !(ctx->my_rank & mask);
+         mask <<= 1)
+      if (ctx->my_rank + mask < ctx->comm_sz) {
+         MPI_Recv_init(ctx->child[c], 1, ctx->type, ctx->my_rank + mask,
+               0, ctx->comm, &ctx->up[c]);
+         MPI_Send_init(ctx->part, 1, ctx->type, ctx->my_rank + mask, 1,
+               ctx->comm, &ctx->down[c + 1]);
+         c++;
+      }
+   ctx->num_children = c;
+   if (ctx->my_rank != 0) {
+      MPI_Send_init(ctx->part, 1, ctx->type, ctx->my_rank - mask, 0,
+            ctx->comm, &ctx->up[c]);
+      MPI_Recv_init(ctx->part, 1, ctx->type, ctx->my_rank - mask, 1,
+            ctx->comm, &ctx->down[0]);
+   }
+}  /* Ctx_tree_init */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Ctx_tree_reduce
+ * Purpose:   Reduce the processes' parts in ctx->part with the
+ *            context's persistent requests
+ * In/out:    ctx:  the context; ctx->part is the calling process'
+ *                  part on entry, and the reduced parts on process 0
+ *                  (on every process unless the mode is REDUCE_ROOT)
+ *                  on return
+ * Ret val:   the dot product where Reduce_dot_parts would put it, 0
+ *            elsewhere
+ *
+ * Note:
+ *    The children's parts are added in the order of the children, so
+ *    the result doesn't depend on the order the messages arrive in.
+ */
+static double Ctx_tree_reduce(Vec_ctx_t* ctx /* in/out */) {
+   int c = ctx->num_children, i;
+
+   MPI_Startall(c, ctx->up);
+   MPI_Waitall(c, ctx->up, MPI_STATUSES_IGNORE);
+   for (i = 0; i < c; i++)
+      MPI_Reduce_local(ctx->child[i], ctx->part, 1, ctx->type, ctx->op);
+   if (ctx->my_rank != 0) {
+      MPI_Start(&ctx->up[c]);
+      MPI_Wait(&ctx->up[c], MPI_STATUS_IGNORE);
+   }
+   if (ctx->reduce == REDUCE_ROOT)
+      return ctx->my_rank == 0 ? Dot_total(ctx->sum, ctx->part) : 0.0;
+
+   if (ctx->my_rank != 0) {
+      MPI_Start(&ctx->down[0]);
+      MPI_Wait(&ctx->down[0], MPI_STATUS_IGNORE);
+   }
+   MPI_Startall(c, ctx->down + 1);
+   MPI_Waitall(c, ctx->down + 1, MPI_STATUSES_IGNORE);
+   return Dot_total(ctx->sum, ctx->part);
+}  /* Ctx_tree_reduce */
+
+/*-------------------------------------------------------------------
+ * Tracing (--trace FILE)
+ *
+ * Every process records the phases of Run_operations and the MPI calls
+ * of the program in a ring buffer of TRACE_EVENTS events:  the start
+ * and length, the bytes moved and, where perf_event_open is allowed,
+ * the CPU cycles of the master thread.  The MPI calls are caught with
+ * the standard profiling interface:  the MPI_ functions below are
+ * found before the library's and call its PMPI_ version, so the call
+ * sites don't change.  When tracing is off each hook is one test of
+ * trace.on.  At the end Trace_finish gathers the buffers on process 0,
+ * which writes them as a Chrome trace (chrome://tracing or Perfetto,
+ * one row per process) and prints how unbalanced each phase was.
+ *-------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------
+ * Function:  Trace_init
+ * Purpose:   Start tracing on every process of comm
+ * In arg:    comm:  communicator containing all the processes
+ *
+ * Note:
+ *    The processes start their clocks together after a barrier, so the
+ *    rows of the trace line up to within the barrier's skew.
+ */
+static void Trace_init(
+      MPI_Comm  comm  /* in */) {
+#  if defined(__linux__) && defined(SYS_perf_event_open)
+   struct perf_event_attr attr;
+#  endif
+
+   trace.fd = -1;
+#  if defined(__linux__) && defined(SYS_perf_event_open)
+   memset(&attr, 0, sizeof(attr));
+   attr.type = PERF_TYPE_HARDWARE;
+   attr.size = sizeof(attr);
+   attr.config = PERF_COUNT_HW_CPU_CYCLES;
+   attr.exclude_kernel = 1;
+   attr.exclude_hv = 1;
+   trace.fd = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#  endif
+   trace.total = 0;
+   MPI_Barrier(comm);
+   trace.t0 = MPI_Wtime();
+   trace.on = 1;
+}  /* Trace_init */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Trace_cycles
+ * Purpose:   Read the cycle counter of the calling thread
+ * Ret val:   the cycles so far, or -1 if there's no counter
+ */
+static long long Trace_cycles(void) {
+   long long cycles = -1;
+
+#  ifdef __linux__
+   if (trace.fd >= 0 && read(trace.fd, &cycles, sizeof(cycles))
+         != sizeof(cycles))
+      cycles = -1;
+#  endif
+   return cycles;
+}  /* Trace_cycles */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Trace_begin
+ * Purpose:   Mark the start of an event
+ * Out arg:   m:  the time and cycle count at the start
+ */
+static void Trace_begin(
+      Trace_mark_t*  m  /* out */) {
+   if (!trace.on) return;
+   m->t = MPI_Wtime();
+   m->cycles = Trace_cycles();
+}  /* Trace_begin */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Trace_end
+ * Purpose:   Record an event that started at m in the ring buffer,
+ *            over the oldest event if the buffer is full
+ * In args:   name:   name of the phase or MPI call
+ *            cat:    TRACE_PHASE or TRACE_MPI
+ *            m:      the mark from Trace_begin
+ *            bytes:  bytes moved by the event
+ */
+static void Trace_end(
+      const char     name[]  /* in */,
+      int            cat     /* in */,
+      Trace_mark_t*  m       /* in */,
+      long long      bytes   /* in */) {
+   Trace_event_t* e;
+   long long cycles;
+
+   if (!trace.on) return;
+   e = &trace.events[trace.total % TRACE_EVENTS];
+   cycles = Trace_cycles();
+   strncpy(e->name, name, TRACE_NAME - 1);
+   e->name[TRACE_NAME - 1] = '\0';
+   e->cat = cat;
+   e->start = m->t - trace.t0;
+   e->dur = MPI_Wtime() - m->t;
+   e->bytes = bytes;
+   e->cycles = cycles >= 0 && m->cycles >= 0 ? cycles - m->cycles : -1;
+   trace.total++;
+}  /* Trace_end */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Trace_bytes
+ * Purpose:   Size of count elements of an MPI datatype
+ * In args:   count:  number of elements
+ *            type:   their datatype
+ * Ret val:   the size in bytes
+ */
+static long long Trace_bytes(
+      int           count  /* in */,
+      MPI_Datatype  type   /* in */) {
+   int size;
+
+   PMPI_Type_size(type, &size);
+   return (long long) count*size;
+}  /* Trace_bytes */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Trace_finish
+ * Purpose:   Stop tracing, write the events of all the processes to
+ *            fname as a Chrome trace and print the load imbalance of
+ *            each phase and MPI call
+ * In args:   fname:    name of the trace file
+ *            my_rank:  calling process' rank in comm
+ *            comm_sz:  number of processes in comm
+ *            comm:     communicator containing all the processes
+ * Errors:    Failures are recorded with ERR_ALLOC_TEMP or
+ *            ERR_FILE_WRITE.  ERR_ALLOC_TEMP is also recorded if the
+ *            processes have more than INT_MAX events in all, which
+ *            MPI_Gatherv can't place.
+ *
+ * Note:
+ *    The events are gathered as whole Trace_event_t's, with a
+ *    contiguous datatype, so the counts and displacements stay far
+ *    below INT_MAX for any number of processes with full buffers.
+ */
+static void Trace_finish(
+      char      fname[]  /* in */,
+      int       my_rank  /* in */,
+      int       comm_sz  /* in */,
+      MPI_Comm  comm     /* in */) {
+   Trace_event_t* all = NULL;
+   int *counts = NULL, *displs = NULL;
+   int count, q;
+   long long dropped, all_dropped, total = 0;
+   MPI_Datatype event_type;
+   FILE* fp;
+
+   trace.on = 0;
+#  ifdef __linux__
+   if (trace.fd >= 0) close(trace.fd);
+#  endif
+   // Send the events oldest first, so the buffer is in order
+   count = trace.total < TRACE_EVENTS ? (int) trace.total : TRACE_EVENTS;
+   dropped = trace.total - count;
+   if (trace.total > TRACE_EVENTS) {
+      Trace_event_t* tmp = malloc(TRACE_EVENTS*sizeof(Trace_event_t));
+      size_t head = trace.total % TRACE_EVENTS;
+
+      if (tmp == NULL) {
+         Record_error(ERR_ALLOC_TEMP);
+      } else {
+         memcpy(tmp, trace.events + head,
+               (TRACE_EVENTS - head)*sizeof(Trace_event_t));
+         memcpy(tmp + TRACE_EVENTS - head, trace.events,
+               head*sizeof(Trace_event_t));
+         memcpy(trace.events, tmp, TRACE_EVENTS*sizeof(Trace_event_t));
+         free(tmp);
+      }
+   }
+   MPI_Type_contiguous((int) sizeof(Trace_event_t), MPI_BYTE, &event_type);
+   MPI_Type_commit(&event_type);
+   if (my_rank == 0) {
+      counts = malloc(2*comm_sz*sizeof(int));
+      if (counts == NULL) Record_error(ERR_ALLOC_TEMP);
+   }
+   Check_errors(comm);
+   MPI_Gather(&count, 1, MPI_INT, counts, 1, MPI_INT, 0, comm);
+   MPI_Reduce(&dropped, &all_dropped, 1, MPI_LONG_LONG, MPI_SUM, 0, comm);
+   if (my_rank == 0) {
+      displs = counts + comm_sz;
+      for (q = 0; q < comm_sz; q++) {
+         displs[q] = total <= INT_MAX ? (int) total : 0;
+         total += counts[q];
+      }
+      if (total > INT_MAX)
+         Record_error(ERR_ALLOC_TEMP);
+      else if ((all = malloc((total > 0 ? total : 1)*sizeof(Trace_event_t)))
+            == NULL)
+         Record_error(ERR_ALLOC_TEMP);
+   }
+   Check_errors(comm);
+   MPI_Gatherv(trace.events, count, event_type, all, counts, displs,
+         event_type, 0, comm);
+   MPI_Type_free(&event_type);
+
+   if (my_rank == 0) {
+      fp = fopen(fname, "w");
+      if (fp == NULL) {
+         Record_error(ERR_FILE_WRITE);
+      } else {
+         Write_chrome_trace(fp, all, counts, displs, comm_sz);
+         if (fclose(fp) != 0) Record_error(ERR_FILE_WRITE);
+         printf("\nTrace of %lld events (%lld dropped) written to %s\n",
+               total, all_dropped, fname);
+         Print_imbalance(all, counts, displs, comm_sz);
+      }
+   }
+   free(all);
+   free(counts);
+   Check_errors(comm);
+}  /* Trace_finish */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Write_chrome_trace
+ * Purpose:   Write the gathered events in the Chrome trace event
+ *            format:  complete ("X") events in microseconds, with the
+ *            process as the thread of a single trace process
+ * In args:   fp:       the open trace file
+ *            all:      the events of all the processes
+ *            counts:   number of events of each process
+ *            displs:   index in all of each process' first event
+ *            comm_sz:  number of processes
+ */
+static void Write_chrome_trace(
+      FILE*           fp       /* in */,
+      Trace_event_t*  all      /* in */,
+      int             counts[] /* in */,
+      int             displs[] /* in */,
+      int             comm_sz  /* in */) {
+   Trace_event_t* e;
+   int q, j, first = 1;
+
+   fprintf(fp, "{\"traceEvents\": [\n");
+   for (q = 0; q < comm_sz; q++) {
+      fprintf(fp, "%s  {\"name\": \"thread_name\", \"ph\": \"M\", "
+            "\"pid\": 0, \"tid\": %d, \"args\": {\"name\": \"rank %d\"}}",
+            first ? "" : ",\n", q, q);
+      first = 0;
+   }
+   for (q = 0; q < comm_sz; q++) {
+      e = all + displs[q];
+      for (j = 0; j < counts[q]; j++, e++) {
+         fprintf(fp, ",\n  {\"name\": \"%s\", \"cat\": \"%s\", "
+               "\"ph\": \"X\", \"pid\": 0, \"tid\": %d, \"ts\": %.3f, "
+               "\"dur\": %.3f, \"args\": {\"bytes\": %lld", e->name,
+               e->cat == TRACE_MPI ? "mpi" : "phase", q, 1e6*e->start,
+               1e6*e->dur, e->bytes);
+         if (e->cycles >= 0) fprintf(fp, ", \"cycles\": %lld", e->cycles);
+         fprintf(fp, "}}");
+      }
+   }
+   fprintf(fp, "\n]}\n");
+}  /* Write_chrome_trace */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Print_imbalance
+ * Purpose:   Print, for each name in the trace, the min, mean and max
+ *            over the processes of their total time in it, and the
+ *            imbalance max/mean - 1
+ * In args:   as in Write_chrome_trace
+ *
+ * Note:
+ *    Time spent waiting in a collective is mostly the skew of the
+ *    processes before it, so a collective with a large max and a
+ *    small min points at imbalance in the phase before it.
+ */
+static void Print_imbalance(
+      Trace_event_t*  all      /* in */,
+      int             counts[] /* in */,
+      int             displs[] /* in */,
+      int             comm_sz  /* in */) {
+   char names[TRACE_NAMES][TRACE_NAME];
+   double* tot = calloc(TRACE_NAMES*comm_sz, sizeof(double));
+   double min, max, mean;
+   long long bytes[TRACE_NAMES] = {0};
+   Trace_event_t* e;
+   int num_names = 0, q, j, k;
+
+   if (tot == NULL) return;
+   for (q = 0; q < comm_sz; q++) {
+      e = all + displs[q];
+      for (j = 0; j < counts[q]; j++, e++) {
+         for (k = 0; k < num_names; k++)
+            if (strcmp(names[k], e->name) == 0) break;
+         if (k == num_names) {
+            if (num_names == TRACE_NAMES) continue;
+            strcpy(names[num_names++], e->name);
+         }
+         tot[k*comm_sz + q] += e->dur;
+         bytes[k] += e->bytes;
+      }
+   }
+
+   printf("%-16s %10s %10s %10s %9s %12s\n", "event", "min (s)",
+         "mean (s)", "max (s)", "imbalance", "bytes");
+   for (k = 0; k < num_names; k++) {
+      min = max = mean = tot[k*comm_sz];
+      for (q = 1; q < comm_sz; q++) {
+         if (tot[k*comm_sz + q] < min) min = tot[k*comm_sz + q];
+         if (tot[k*comm_sz + q] > max) max = tot[k*comm_sz + q];
+         mean += tot[k*comm_sz + q];
+      }
+      mean /= comm_sz;
+      printf("%-16s %10.6f %10.6f %10.6f %8.1f%% %12lld\n", names[k], min,
+            mean, max, mean > 0 ? 100*(max/mean - 1) : 0.0, bytes[k]);
+   }
+   free(tot);
+}  /* Print_imbalance */
+
+
+#ifndef VEC_LIBRARY
+/*-------------------------------------------------------------------
+ * Profiling hooks:  each records the call with Trace_end when tracing
+ * is on, and is otherwise just a call of the PMPI_ function.  The
+ * nonblocking calls record their post, with the bytes of the message;
+ * the time they take to complete shows up in MPI_Wait or MPI_Waitall.
+ *-------------------------------------------------------------------*/
+
+int MPI_Send(const void* buf, int count, MPI_Datatype type, int dest,
+      int tag, MPI_Comm comm) {
+   Trace_mark_t m;
+   int err;
+
+   if (!trace.on) return PMPI_Send(buf, count, type, dest, tag, comm);
+   Trace_begin(&m);
+   err = PMPI_Send(buf, count, type, dest, tag, comm);
+   Trace_end("MPI_Send", TRACE_MPI, &m, Trace_bytes(count, type));
+   return err;
+}  /* MPI_Send */
+
+int MPI_Recv(void* buf, int count, MPI_Datatype type, int source, int tag,
+      MPI_Comm comm, MPI_Status* status) {
+   Trace_mark_t m;
+   int err;
+
+   if (!trace.on)
+      return PMPI_Recv(buf, count, type, source, tag, comm, status);
+   Trace_begin(&m);
+   err = PMPI_Recv(buf, count, type, source, tag, comm, status);
+   Trace_end("MPI_Recv", TRACE_MPI, &m, Trace_bytes(count, type));
+   return err;
+}  /* MPI_Recv */
+
+int MPI_Isend(const void* buf, int count, MPI_Datatype type, int dest,
+      int tag, MPI_Comm comm, MPI_Request* request) {
+   Trace_mark_t m;
+   int err;
+
+   if (!trace.on)
+      return PMPI_Isend(buf, count, type, dest, tag, comm, request);
+   Trace_begin(&m);
+   err = PMPI_Isend(buf, count, type, dest, tag, comm, request);
+   Trace_end("MPI_Isend", TRACE_MPI, &m, Trace_bytes(count, type));
+   return err;
+}  /* MPI_Isend */
+
+int MPI_Irecv(void* buf, int count, MPI_Datatype type, int source, int tag,
+      MPI_Comm comm, MPI_Request* request) {
+   Trace_mark_t m;
+   int err;
+
+   if (!trace.on)
+      return PMPI_Irecv(buf, count, type, source, tag, comm, request);
+   Trace_begin(&m);
+   err = PMPI_Irecv(buf, count, type, source, tag, comm, request);
+   Trace_end("MPI_Irecv", TRACE_MPI, &m, Trace_bytes(count, type));
+   return err;
+}  /* MPI_Irecv */
+
+int MPI_Wait(MPI_Request* request, MPI_Status* status) {
+   Trace_mark_t m;
+   int err;
+
+   if (!trace.on) return PMPI_Wait(request, status);
+   Trace_begin(&m);
+   err = PMPI_Wait(request, status);
+   Trace_end("MPI_Wait", TRACE_MPI, &m, 0);
+   return err;
+}  /* MPI_Wait */
+
+int MPI_Waitall(int count, MPI_Request requests[], MPI_Status statuses[]) {
+   Trace_mark_t m;
+   int err;
+
+   if (!trace.on) return PMPI_Waitall(count, requests, statuses);
+   Trace_begin(&m);
+   err = PMPI_Waitall(count, requests, statuses);
+   Trace_end("MPI_Waitall", TRACE_MPI, &m, 0);
+   return err;
+}  /* MPI_Waitall */
+
+int MPI_Barrier(MPI_Comm comm) {
+   Trace_mark_t m;
+   int err;
+
+   if (!trace.on) return PMPI_Barrier(comm);
+   Trace_begin(&m);
+   err = PMPI_Barrier(comm);
+   Trace_end("MPI_Barrier", TRACE_MPI, &m, 0);
+   return err;
+}  /* MPI_Barrier */
+
+int MPI_Bcast(void* buf, int count, MPI_Datatype type, int root,
+      MPI_Comm comm) {
+   Trace_mark_t m;
+   int err;
+
+   if (!trace.on) return PMPI_Bcast(buf, count, type, root, comm);
+   Trace_begin(&m);
+   err = PMPI_Bcast(buf, count, type, root, comm);
+   Trace_end("MPI_Bcast", TRACE_MPI, &m, Trace_bytes(count, type));
+   return err;
+}  /* MPI_Bcast */
+
+int MPI_Reduce(const void* sendbuf, void* recvbuf, int count,
+      MPI_Datatype type, MPI_Op op, int root, MPI_Comm comm) {
+   Trace_mark_t m;
+   int err;
+
+   if (!trace.on)
+      return PMPI_Reduce(sendbuf, recvbuf, count, type, op, root, comm);
+   Trace_begin(&m);
+   err = PMPI_Reduce(sendbuf, recvbuf, count, type, op, root, comm);
+   Trace_end("MPI_Reduce", TRACE_MPI, &m, Trace_bytes(count, type));
+   return err;
+}  /* MPI_Reduce */
+
+int MPI_Allreduce(const void* sendbuf, void* recvbuf, int count,
+      MPI_Datatype type, MPI_Op op, MPI_Comm comm) {
+   Trace_mark_t m;
+   int err;
+
+   if (!trace.on)
+      return PMPI_Allreduce(sendbuf, recvbuf, count, type, op, comm);
+   Trace_begin(&m);
+   err = PMPI_Allreduce(sendbuf, recvbuf, count, type, op, comm);
+   Trace_end("MPI_Allreduce", TRACE_MPI, &m, Trace_bytes(count, type));
+   return err;
+}  /* MPI_Allreduce */
+
+int MPI_Iallreduce(const void* sendbuf, void* recvbuf, int count,
+      MPI_Datatype type, MPI_Op op, MPI_Comm comm, MPI_Request* request) {
+   Trace_mark_t m;
+   int err;
+
+   if (!trace.on)
+      return PMPI_Iallreduce(sendbuf, recvbuf, count, type, op, comm,
+            request);
+   Trace_begin(&m);
+   err = PMPI_Iallreduce(sendbuf, recvbuf, count, type, op, comm, request);
+   Trace_end("MPI_Iallreduce", TRACE_MPI, &m, Trace_bytes(count, type));
+   return err;
+}  /* MPI_Iallreduce */
+
+int MPI_Gather(const void* sendbuf, int sendcount, MPI_Datatype sendtype,
+      void* recvbuf, int recvcount, MPI_Datatype recvtype, int root,
+      MPI_Comm comm) {
+   Trace_mark_t m;
+   int err;
+
+   if (!trace.on)
+      return PMPI_Gather(sendbuf, sendcount, sendtype, recvbuf, recvcount,
+            recvtype, root, comm);
+   Trace_begin(&m);
+   err = PMPI_Gather(sendbuf, sendcount, sendtype, recvbuf, recvcount,
+         recvtype, root, comm);
+   Trace_end("MPI_Gather", TRACE_MPI, &m, Trace_bytes(sendcount, sendtype));
+   return err;
+}  /* MPI_Gather */
+
+int MPI_Gatherv(const void* sendbuf, int sendcount, MPI_Datatype sendtype,
+      void* recvbuf, const int recvcounts[], const int displs[],
+      MPI_Datatype recvtype, int root, MPI_Comm comm) {
+   Trace_mark_t m;
+   int err;
+
+   if (!trace.on)
+      return PMPI_Gatherv(sendbuf, sendcount, sendtype, recvbuf,
+            recvcounts, displs, recvtype, root, comm);
+   Trace_begin(&m);
+   err = PMPI_Gatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts,
+         displs, recvtype, root, comm);
+   Trace_end("MPI_Gatherv", TRACE_MPI, &m, Trace_bytes(sendcount, sendtype));
+   return err;
+}  /* MPI_Gatherv */
+
+int MPI_Scatterv(const void* sendbuf, const int sendcounts[],
+      const int displs[], MPI_Datatype sendtype, void* recvbuf,
+      int recvcount, MPI_Datatype recvtype, int root, MPI_Comm comm) {
+   Trace_mark_t m;
+   int err;
+
+   if (!trace.on)
+      return PMPI_Scatterv(sendbuf, sendcounts, displs, sendtype, recvbuf,
+            recvcount, recvtype, root, comm);
+   Trace_begin(&m);
+   err = PMPI_Scatterv(sendbuf, sendcounts, displs, sendtype, recvbuf,
+         recvcount, recvtype, root, comm);
+   Trace_end("MPI_Scatterv", TRACE_MPI, &m,
+         Trace_bytes(recvcount, recvtype));
+   return err;
+}  /* MPI_Scatterv */
+
+int MPI_File_read_at_all(MPI_File fh, MPI_Offset offset, void* buf,
+      int count, MPI_Datatype type, MPI_Status* status) {
+   Trace_mark_t m;
+   int err;
+
+   if (!trace.on)
+      return PMPI_File_read_at_all(fh, offset, buf, count, type, status);
+   Trace_begin(&m);
+   err = PMPI_File_read_at_all(fh, offset, buf, count, type, status);
+   Trace_end("MPI_File_read", TRACE_MPI, &m, Trace_bytes(count, type));
+   return err;
+}  /* MPI_File_read_at_all */
+
+int MPI_File_write_at_all(MPI_File fh, MPI_Offset offset, const void* buf,
+      int count, MPI_Datatype type, MPI_Status* status) {
+   Trace_mark_t m;
+   int err;
+
+   if (!trace.on)
+      return PMPI_File_write_at_all(fh, offset, buf, count, type, status);
+   Trace_begin(&m);
+   err = PMPI_File_write_at_all(fh, offset, buf, count, type, status);
+   Trace_end("MPI_File_write", TRACE_MPI, &m, Trace_bytes(count, type));
+   return err;
+}  /* MPI_File_write_at_all */
+#endif
+
+
+/*-------------------------------------------------------------------
+ * Local kernels
+ *
+ * Every kernel comes in a generic version and, when the compiler
+ * targets the architecture, AVX2+FMA, AVX-512 and NEON versions.  The
+ * dot products keep several independent accumulators to hide the
+ * latency of the adds, and finish the last n % width elements with a
+ * scalar loop.  Loads are unaligned so any block or chunk can be
+ * passed in; on aligned data they're as fast as aligned loads.
+ *-------------------------------------------------------------------*/
+
+static void Scale_generic(double s, elem_t a[], size_t n) {
+   elem_t e = (elem_t) s;
+   size_t i;
+
+   for (i = 0; i < n; i++)
+      a[i] = a[i]*e;
+}  /* Scale_generic */
+
+static double Dot_generic(elem_t x[], elem_t y[], size_t n) {
+   acc_t d0 = 0, d1 = 0, d2 = 0, d3 = 0;
+   size_t i;
+
+   for (i = 0; i + 4 <= n; i += 4) {
+      d0 += (acc_t) x[i]*y[i];
+      d1 += (acc_t) x[i+1]*y[i+1];
+      d2 += (acc_t) x[i+2]*y[i+2];
+      d3 += (acc_t) x[i+3]*y[i+3];
+   }
+   for (; i < n; i++)
+      d0 += (acc_t) x[i]*y[i];
+   return (double) ((d0 + d1) + (d2 + d3));
+}  /* Dot_generic */
+
+static double Scale_dot_generic(double s, elem_t x[], elem_t y[], size_t n) {
+   elem_t e = (elem_t) s;
+   acc_t d0 = 0, d1 = 0;
+   size_t i;
+
+   for (i = 0; i + 2 <= n; i += 2) {
+      x[i] *= e;     y[i] *= e;
+      x[i+1] *= e;   y[i+1] *= e;
+      d0 += (acc_t) x[i]*y[i];
+      d1 += (acc_t) x[i+1]*y[i+1];
+   }
+   for (; i < n; i++) {
+      x[i] *= e;   y[i] *= e;
+      d0 += (acc_t) x[i]*y[i];
+   }
+   return (double) (d0 + d1);
+}  /* Scale_dot_generic */
+
+/* Compensated dot:  four lanes, each summing runs of COMP_RUN products
+ * and adding every run's sum into its (sum, error) pair with
+ * Two_sum_add, so the compensation costs a few adds per run instead of
+ * per product.  The error is then about COMP_RUN*u*sum |x[i]*y[i]|
+ * whatever n is.  With scale set each element is scaled as it's loaded,
+ * and stored back. */
+NO_CONTRACT
+static void Dot_comp_generic(double s, elem_t x[], elem_t y[], size_t n,
+      int scale, double res[]) {
+   elem_t e = (elem_t) s;
+   double d[4], sum[4] = {0.0}, c[4] = {0.0};
+   size_t i, j, len;
+   int l;
+
+   for (i = 0; i < n; i += len) {
+      len = n - i < 4*COMP_RUN ? n - i : 4*COMP_RUN;
+      if (scale)
+         for (j = i; j < i + len; j++) {
+            x[j] *= e;   y[j] *= e;
+         }
+      for (l = 0; l < 4; l++)
+         d[l] = 0.0;
+      for (j = i; j + 4 <= i + len; j += 4)
+         for (l = 0; l < 4; l++)
+            d[l] += (double) x[j+l]*y[j+l];
+      for (; j < i + len; j++)
+         d[0] += (double) x[j]*y[j];
+      for (l = 0; l < 4; l++)
+         Two_sum_add(&sum[l], &c[l], d[l]);
+   }
+   res[0] = res[1] = 0.0;
+   for (l = 0; l < 4; l++) {
+      Two_sum_add(&res[0], &res[1], sum[l]);
+      res[1] += c[l];
+   }
+}  /* Dot_comp_generic */
+
+/* Binned split:  sums[k] gets the exact sum of the fold k pieces of the
+ * products, m[k] = 1.5*2^52*u_k, and the return value is the largest
+ * |product|, so Bin_dot can check the top in the same pass.  The lanes
+ * have no dependences between iterations, so the compiler can vectorize
+ * the inner loops, and every version splits a product into the same
+ * pieces.  With scale set each element is scaled as it's loaded, and
+ * stored back. */
+NO_CONTRACT
+static double Bin_split_generic(double s, elem_t x[], elem_t y[], size_t n,
+      int scale, double m[], double sums[]) {
+   elem_t e = (elem_t) s;
+   double acc[BIN_FOLDS][BIN_LANES] = {{0.0}}, rem[BIN_LANES];
+   double max[BIN_LANES] = {0.0}, r, q;
+   size_t i;
+   int k, l;
+
+   for (i = 0; i + BIN_LANES <= n; i += BIN_LANES) {
+      for (l = 0; l < BIN_LANES; l++) {
+         if (scale) {
+            x[i+l] *= e;   y[i+l] *= e;
+         }
+         rem[l] = (double) x[i+l]*y[i+l];
+         max[l] = fabs(rem[l]) > max[l] ? fabs(rem[l]) : max[l];
+      }
+      for (k = 0; k < BIN_FOLDS; k++)
+         for (l = 0; l < BIN_LANES; l++) {
+            q = (m[k] + rem[l]) - m[k];
+            acc[k][l] += q;
+            rem[l] -= q;
+         }
+   }
+   for (k = 0; k < BIN_FOLDS; k++) {
+      sums[k] = 0.0;
+      for (l = 0; l < BIN_LANES; l++)
+         sums[k] += acc[k][l];
+   }
+   for (; i < n; i++) {
+      if (scale) {
+         x[i] *= e;   y[i] *= e;
+      }
+      r = (double) x[i]*y[i];
+      max[0] = fabs(r) > max[0] ? fabs(r) : max[0];
+      for (k = 0; k < BIN_FOLDS; k++) {
+         q = (m[k] + r) - m[k];
+         sums[k] += q;
+         r -= q;
+      }
+   }
+   for (l = 1; l < BIN_LANES; l++)
+      max[0] = max[l] > max[0] ? max[l] : max[0];
+   return max[0];
+}  /* Bin_split_generic */
+
+static void Axpy_generic(double a, elem_t x[], elem_t y[], elem_t z[],
+      size_t n) {
+   elem_t e = (elem_t) a;
+   size_t i;
+
+   for (i = 0; i < n; i++)
+      z[i] = e*x[i] + y[i];
+}  /* Axpy_generic */
+
+static void Mul_generic(elem_t x[], elem_t y[], elem_t z[], size_t n) {
+   size_t i;
+
+   for (i = 0; i < n; i++)
+      z[i] = x[i]*y[i];
+}  /* Mul_generic */
+
+#if defined(ELEM_DOUBLE) && (defined(__x86_64__) || defined(__i386__))
+__attribute__((target("avx2,fma")))
+static double Hsum_avx2(__m256d v) {
+   __m128d lo = _mm256_castpd256_pd128(v);
+   __m128d hi = _mm256_extractf128_pd(v, 1);
+
+   lo = _mm_add_pd(lo, hi);
+   return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}  /* Hsum_avx2 */
+
+__attribute__((target("avx2,fma")))
+static void Scale_avx2(double s, double a[], size_t n) {
+   __m256d vs = _mm256_set1_pd(s);
+   size_t i;
+
+   for (i = 0; i + 8 <= n; i += 8) {
+      _mm256_storeu_pd(a+i, _mm256_mul_pd(_mm256_loadu_pd(a+i), vs));
+      _mm256_storeu_pd(a+i+4, _mm256_mul_pd(_mm256_loadu_pd(a+i+4), vs));
+   }
+   for (; i < n; i++)
+      a[i] = a[i]*s;
+}  /* Scale_avx2 */
+
+__attribute__((target("avx2,fma")))
+static double Dot_avx2(double x[], double y[], size_t n) {
+   __m256d d0 = _mm256_setzero_pd(), d1 = _mm256_setzero_pd();
+   __m256d d2 = _mm256_setzero_pd(), d3 = _mm256_setzero_pd();
+   double dot;
+   size_t i;
+
+   for (i = 0; i + 16 <= n; i += 16) {
+      d0 = _mm256_fmadd_pd(_mm256_loadu_pd(x+i), _mm256_loadu_pd(y+i), d0);
+      d1 = _mm256_fmadd_pd(_mm256_loadu_pd(x+i+4), _mm256_loadu_pd(y+i+4),
+            d1);
+      d2 = _mm256_fmadd_pd(_mm256_loadu_pd(x+i+8), _mm256_loadu_pd(y+i+8),
+            d2);
+      d3 = _mm256_fmadd_pd(_mm256_loadu_pd(x+i+12),
+            _mm256_loadu_pd(y+i+12), d3);
+   }
+   dot = Hsum_avx2(_mm256_add_pd(_mm256_add_pd(d0, d1),
+            _mm256_add_pd(d2, d3)));
+   for (; i < n; i++)
+      dot += x[i]*y[i];
+   return dot;
+}  /* Dot_avx2 */
+
+__attribute__((target("avx2,fma")))
+static double Scale_dot_avx2(double s, double x[], double y[], size_t n) {
+   __m256d vs = _mm256_set1_pd(s);
+   __m256d d0 = _mm256_setzero_pd(), d1 = _mm256_setzero_pd();
+   __m256d x0, x1, y0, y1;
+   double dot;
+   size_t i;
+
+   for (i = 0; i + 8 <= n; i += 8) {
+      x0 = _mm256_mul_pd(_mm256_loadu_pd(x+i), vs);
+      x1 = _mm256_mul_pd(_mm256_loadu_pd(x+i+4), vs);
+      y0 = _mm256_mul_pd(_mm256_loadu_pd(y+i), vs);
+      y1 = _mm256_mul_pd(_mm256_loadu_pd(y+i+4), vs);
+      _mm256_storeu_pd(x+i, x0);   _mm256_storeu_pd(x+i+4, x1);
+      _mm256_storeu_pd(y+i, y0);   _mm256_storeu_pd(y+i+4, y1);
+      d0 = _mm256_fmadd_pd(x0, y0, d0);
+      d1 = _mm256_fmadd_pd(x1, y1, d1);
+   }
+   dot = Hsum_avx2(_mm256_add_pd(d0, d1));
+   for (; i < n; i++) {
+      x[i] *= s;   y[i] *= s;
+      dot += x[i]*y[i];
+   }
+   return dot;
+}  /* Scale_dot_avx2 */
+
+NO_CONTRACT __attribute__((target("avx2,fma")))
+static void Dot_comp_avx2(double s, double x[], double y[], size_t n,
+      int scale, double res[]) {
+   __m256d vs = _mm256_set1_pd(s);
+   __m256d s0 = _mm256_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+   __m256d c0 = s0, c1 = s0, c2 = s0, c3 = s0;
+   __m256d d0, d1, d2, d3, a, b, t, z;
+   double sl[4], cl[4];
+   size_t i;
+   int j, l;
+
+   // One FMA of a run on accumulator d, scaling the elements first
+#  define COMP_FMA_AVX2(d, off) \
+   a = _mm256_loadu_pd(x+i+off);   b = _mm256_loadu_pd(y+i+off); \
+   if (scale) { \
+      a = _mm256_mul_pd(a, vs);   b = _mm256_mul_pd(b, vs); \
+      _mm256_storeu_pd(x+i+off, a);   _mm256_storeu_pd(y+i+off, b); \
+   } \
+   d = _mm256_fmadd_pd(a, b, d);
+   // Vector Two_sum:  add d to the (s, c) pairs
+#  define COMP_ADD_AVX2(s, c, d) \
+   t = _mm256_add_pd(s, d);   z = _mm256_sub_pd(t, s); \
+   c = _mm256_add_pd(c, _mm256_add_pd(_mm256_sub_pd(s, _mm256_sub_pd(t, z)), \
+            _mm256_sub_pd(d, z))); \
+   s = t;
+   for (i = 0; i + 16 <= n; ) {
+      d0 = d1 = d2 = d3 = _mm256_setzero_pd();
+      for (j = 0; j < COMP_RUN && i + 16 <= n; j++, i += 16) {
+         COMP_FMA_AVX2(d0, 0)
+         COMP_FMA_AVX2(d1, 4)
+         COMP_FMA_AVX2(d2, 8)
+         COMP_FMA_AVX2(d3, 12)
+      }
+      COMP_ADD_AVX2(s0, c0, d0)
+      COMP_ADD_AVX2(s1, c1, d1)
+      COMP_ADD_AVX2(s2, c2, d2)
+      COMP_ADD_AVX2(s3, c3, d3)
+   }
+   // Fold the four pairs into one, so only one vector's lanes are added
+   // one at a time
+   c0 = _mm256_add_pd(c0, c1);   COMP_ADD_AVX2(s0, c0, s1)
+   c2 = _mm256_add_pd(c2, c3);   COMP_ADD_AVX2(s2, c2, s3)
+   c0 = _mm256_add_pd(c0, c2);   COMP_ADD_AVX2(s0, c0, s2)
+#  undef COMP_FMA_AVX2
+#  undef COMP_ADD_AVX2
+   _mm256_storeu_pd(sl, s0);   _mm256_storeu_pd(cl, c0);
+   res[0] = res[1] = 0.0;
+   for (l = 0; l < 4; l++) {
+      Two_sum_add(&res[0], &res[1], sl[l]);
+      res[1] += cl[l];
+   }
+   for (; i < n; i++) {
+      if (scale) {
+         x[i] *= s;   y[i] *= s;
+      }
+      Two_sum_add(&res[0], &res[1], x[i]*y[i]);
+   }
+}  /* Dot_comp_avx2 */
+
+NO_CONTRACT __attribute__((target("avx2,fma")))
+static double Bin_split_avx2(double s, double x[], double y[], size_t n,
+      int scale, double m[], double sums[]) {
+   __m256d vs = _mm256_set1_pd(s), x0, x1, y0, y1;
+   __m256d vm[BIN_FOLDS], acc0[BIN_FOLDS], acc1[BIN_FOLDS];
+   __m256d sign = _mm256_set1_pd(-0.0), m0 = _mm256_setzero_pd(), m1 = m0;
+   __m256d r0, r1, q0, q1;
+   double al[4], max, r, q;
+   size_t i;
+   int k;
+
+   for (k = 0; k < BIN_FOLDS; k++) {
+      vm[k] = _mm256_set1_pd(m[k]);
+      acc0[k] = acc1[k] = _mm256_setzero_pd();
+   }
+   for (i = 0; i + 8 <= n; i += 8) {
+      x0 = _mm256_loadu_pd(x+i);   x1 = _mm256_loadu_pd(x+i+4);
+      y0 = _mm256_loadu_pd(y+i);   y1 = _mm256_loadu_pd(y+i+4);
+      if (scale) {
+         x0 = _mm256_mul_pd(x0, vs);   x1 = _mm256_mul_pd(x1, vs);
+         y0 = _mm256_mul_pd(y0, vs);   y1 = _mm256_mul_pd(y1, vs);
+         _mm256_storeu_pd(x+i, x0);   _mm256_storeu_pd(x+i+4, x1);
+         _mm256_storeu_pd(y+i, y0);   _mm256_storeu_pd(y+i+4, y1);
+      }
+      r0 = _mm256_mul_pd(x0, y0);
+      r1 = _mm256_mul_pd(x1, y1);
+      m0 = _mm256_max_pd(m0, _mm256_andnot_pd(sign, r0));
+      m1 = _mm256_max_pd(m1, _mm256_andnot_pd(sign, r1));
+      for (k = 0; k < BIN_FOLDS; k++) {
+         q0 = _mm256_sub_pd(_mm256_add_pd(vm[k], r0), vm[k]);
+         q1 = _mm256_sub_pd(_mm256_add_pd(vm[k], r1), vm[k]);
+         acc0[k] = _mm256_add_pd(acc0[k], q0);
+         acc1[k] = _mm256_add_pd(acc1[k], q1);
+         r0 = _mm256_sub_pd(r0, q0);
+         r1 = _mm256_sub_pd(r1, q1);
+      }
+   }
+   for (k = 0; k < BIN_FOLDS; k++) {
+      _mm256_storeu_pd(al, _mm256_add_pd(acc0[k], acc1[k]));
+      sums[k] = (al[0] + al[1]) + (al[2] + al[3]);
+   }
+   _mm256_storeu_pd(al, _mm256_max_pd(m0, m1));
+   max = al[0] > al[1] ? al[0] : al[1];
+   max = al[2] > max ? al[2] : max;
+   max = al[3] > max ? al[3] : max;
+   for (; i < n; i++) {
+      if (scale) {
+         x[i] *= s;   y[i] *= s;
+      }
+      r = x[i]*y[i];
+      max = fabs(r) > max ? fabs(r) : max;
+      for (k = 0; k < BIN_FOLDS; k++) {
+         q = (m[k] + r) - m[k];
+         sums[k] += q;
+         r -= q;
+      }
+   }
+   return max;
+}  /* Bin_split_avx2 */
+
+__attribute__((target("avx2,fma")))
+static void Axpy_avx2(double a, double x[], double y[], double z[],
+      size_t n) {
+   __m256d va = _mm256_set1_pd(a);
+   size_t i;
+
+   for (i = 0; i + 8 <= n; i += 8) {
+      _mm256_storeu_pd(z+i, _mm256_fmadd_pd(va, _mm256_loadu_pd(x+i),
+            _mm256_loadu_pd(y+i)));
+      _mm256_storeu_pd(z+i+4, _mm256_fmadd_pd(va, _mm256_loadu_pd(x+i+4),
+            _mm256_loadu_pd(y+i+4)));
+   }
+   for (; i < n; i++)
+      z[i] = a*x[i] + y[i];
+}  /* Axpy_avx2 */
+
+__attribute__((target("avx2,fma")))
+static void Mul_avx2(double x[], double y[], double z[], size_t n) {
+   size_t i;
+
+   for (i = 0; i + 8 <= n; i += 8) {
+      _mm256_storeu_pd(z+i, _mm256_mul_pd(_mm256_loadu_pd(x+i),
+            _mm256_loadu_pd(y+i)));
+      _mm256_storeu_pd(z+i+4, _mm256_mul_pd(_mm256_loadu_pd(x+i+4),
+            _mm256_loadu_pd(y+i+4)));
+   }
+   for (; i < n; i++)
+      z[i] = x[i]*y[i];
+}  /* Mul_avx2 */
+
+__attribute__((target("avx512f")))
+static void Scale_avx512(double s, double a[], size_t n) {
+   __m512d vs = _mm512_set1_pd(s);
+   size_t i;
+
+   for (i = 0; i + 16 <= n; i += 16) {
+      _mm512_storeu_pd(a+i, _mm512_mul_pd(_mm512_loadu_pd(a+i), vs));
+      _mm512_storeu_pd(a+i+8, _mm512_mul_pd(_mm512_loadu_pd(a+i+8), vs));
+   }
+   for (; i < n; i++)
+      a[i] = a[i]*s;
+}  /* Scale_avx512 */
+
+__attribute__((target("avx512f")))
+static double Dot_avx512(double x[], double y[], size_t n) {
+   __m512d d0 = _mm512_setzero_pd(), d1 = _mm512_setzero_pd();
+   __m512d d2 = _mm512_setzero_pd(), d3 = _mm512_setzero_pd();
+   double dot;
+   size_t i;
+
+   for (i = 0; i + 32 <= n; i += 32) {
+      d0 = _mm512_fmadd_pd(_mm512_loadu_pd(x+i), _mm512_loadu_pd(y+i), d0);
+      d1 = _mm512_fmadd_pd(_mm512_loadu_pd(x+i+8), _mm512_loadu_pd(y+i+8),
+            d1);
+      d2 = _mm512_fmadd_pd(_mm512_loadu_pd(x+i+16),
+            _mm512_loadu_pd(y+i+16), d2);
+      d3 = _mm512_fmadd_pd(_mm512_loadu_pd(x+i+24),
+            _mm512_loadu_pd(y+i+24), d3);
+   }
+   dot = _mm512_reduce_add_pd(_mm512_add_pd(_mm512_add_pd(d0, d1),
+            _mm512_add_pd(d2, d3)));
+   for (; i < n; i++)
+      dot += x[i]*y[i];
+   return dot;
+}  /* Dot_avx512 */
+
+__attribute__((target("avx512f")))
+static double Scale_dot_avx512(double s, double x[], double y[], size_t n) {
+   __m512d vs = _mm512_set1_pd(s);
+   __m512d d0 = _mm512_setzero_pd(), d1 = _mm512_setzero_pd();
+   __m512d x0, x1, y0, y1;
+   double dot;
+   size_t i;
+
+   for (i = 0; i + 16 <= n; i += 16) {
+      x0 = _mm512_mul_pd(_mm512_loadu_pd(x+i), vs);
+      x1 = _mm512_mul_pd(_mm512_loadu_pd(x+i+8), vs);
+      y0 = _mm512_mul_pd(_mm512_loadu_pd(y+i), vs);
+      y1 = _mm512_mul_pd(_mm512_loadu_pd(y+i+8), vs);
+      _mm512_storeu_pd(x+i, x0);   _mm512_storeu_pd(x+i+8, x1);
+      _mm512_storeu_pd(y+i, y0);   _mm512_storeu_pd(y+i+8, y1);
+      d0 = _mm512_fmadd_pd(x0, y0, d0);
+      d1 = _mm512_fmadd_pd(x1, y1, d1);
+   }
+   dot = _mm512_reduce_add_pd(_mm512_add_pd(d0, d1));
+   for (; i < n; i++) {
+      x[i] *= s;   y[i] *= s;
+      dot += x[i]*y[i];
+   }
+   return dot;
+}  /* Scale_dot_avx512 */
+
+NO_CONTRACT __attribute__((target("avx512f")))
+static void Dot_comp_avx512(double s, double x[], double y[], size_t n,
+      int scale, double res[]) {
+   __m512d vs = _mm512_set1_pd(s);
+   __m512d s0 = _mm512_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+   __m512d c0 = s0, c1 = s0, c2 = s0, c3 = s0;
+   __m512d d0, d1, d2, d3, a, b, t, z;
+   double sl[8], cl[8];
+   size_t i;
+   int j, l;
+
+   // One FMA of a run on accumulator d, scaling the elements first
+#  define COMP_FMA_AVX512(d, off) \
+   a = _mm512_loadu_pd(x+i+off);   b = _mm512_loadu_pd(y+i+off); \
+   if (scale) { \
+      a = _mm512_mul_pd(a, vs);   b = _mm512_mul_pd(b, vs); \
+      _mm512_storeu_pd(x+i+off, a);   _mm512_storeu_pd(y+i+off, b); \
+   } \
+   d = _mm512_fmadd_pd(a, b, d);
+   // Vector Two_sum:  add d to the (s, c) pairs
+#  define COMP_ADD_AVX512(s, c, d) \
+   t = _mm512_add_pd(s, d);   z = _mm512_sub_pd(t, s); \
+   c = _mm512_add_pd(c, _mm512_add_pd(_mm512_sub_pd(s, _mm512_sub_pd(t, z)), \
+            _mm512_sub_pd(d, z))); \
+   s = t;
+   for (i = 0; i + 32 <= n; ) {
+      d0 = d1 = d2 = d3 = _mm512_setzero_pd();
+      for (j = 0; j < COMP_RUN && i + 32 <= n; j++, i += 32) {
+         COMP_FMA_AVX512(d0, 0)
+         COMP_FMA_AVX512(d1, 8)
+         COMP_FMA_AVX512(d2, 16)
+         COMP_FMA_AVX512(d3, 24)
+      }
+      COMP_ADD_AVX512(s0, c0, d0)
+      COMP_ADD_AVX512(s1, c1, d1)
+      COMP_ADD_AVX512(s2, c2, d2)
+      COMP_ADD_AVX512(s3, c3, d3)
+   }
+   // Fold the four pairs into one, so only one vector's lanes are added
+   // one at a time
+   c0 = _mm512_add_pd(c0, c1);   COMP_ADD_AVX512(s0, c0, s1)
+   c2 = _mm512_add_pd(c2, c3);   COMP_ADD_AVX512(s2, c2, s3)
+   c0 = _mm512_add_pd(c0, c2);   COMP_ADD_AVX512(s0, c0, s2)
+#  undef COMP_FMA_AVX512
+#  undef COMP_ADD_AVX512
+   _mm512_storeu_pd(sl, s0);   _mm512_storeu_pd(cl, c0);
+   res[0] = res[1] = 0.0;
+   for (l = 0; l < 8; l++) {
+      Two_sum_add(&res[0], &res[1], sl[l]);
+      res[1] += cl[l];
+   }
+   for (; i < n; i++) {
+      if (scale) {
+         x[i] *= s;   y[i] *= s;
+      }
+      Two_sum_add(&res[0], &res[1], x[i]*y[i]);
+   }
+}  /* Dot_comp_avx512 */
+
+NO_CONTRACT __attribute__((target("avx512f")))
+static double Bin_split_avx512(double s, double x[], double y[], size_t n,
+      int scale, double m[], double sums[]) {
+   __m512d vs = _mm512_set1_pd(s), x0, x1, y0, y1;
+   __m512d vm[BIN_FOLDS], acc0[BIN_FOLDS], acc1[BIN_FOLDS];
+   __m512d m0 = _mm512_setzero_pd(), m1 = m0;
+   __m512d r0, r1, q0, q1;
+   double al[8], max, r, q;
+   size_t i;
+   int k;
+
+   for (k = 0; k < BIN_FOLDS; k++) {
+      vm[k] = _mm512_set1_pd(m[k]);
+      acc0[k] = acc1[k] = _mm512_setzero_pd();
+   }
+   for (i = 0; i + 16 <= n; i += 16) {
+      x0 = _mm512_loadu_pd(x+i);   x1 = _mm512_loadu_pd(x+i+8);
+      y0 = _mm512_loadu_pd(y+i);   y1 = _mm512_loadu_pd(y+i+8);
+      if (scale) {
+         x0 = _mm512_mul_pd(x0, vs);   x1 = _mm512_mul_pd(x1, vs);
+         y0 = _mm512_mul_pd(y0, vs);   y1 = _mm512_mul_pd(y1, vs);
+         _mm512_storeu_pd(x+i, x0);   _mm512_storeu_pd(x+i+8, x1);
+         _mm512_storeu_pd(y+i, y0);   _mm512_storeu_pd(y+i+8, y1);
+      }
+      r0 = _mm512_mul_pd(x0, y0);
+      r1 = _mm512_mul_pd(x1, y1);
+      m0 = _mm512_max_pd(m0, _mm512_abs_pd(r0));
+      m1 = _mm512_max_pd(m1, _mm512_abs_pd(r1));
+      for (k = 0; k < BIN_FOLDS; k++) {
+         q0 = _mm512_sub_pd(_mm512_add_pd(vm[k], r0), vm[k]);
+         q1 = _mm512_sub_pd(_mm512_add_pd(vm[k], r1), vm[k]);
+         acc0[k] = _mm512_add_pd(acc0[k], q0);
+         acc1[k] = _mm512_add_pd(acc1[k], q1);
+         r0 = _mm512_sub_pd(r0, q0);
+         r1 = _mm512_sub_pd(r1, q1);
+      }
+   }
+   for (k = 0; k < BIN_FOLDS; k++) {
+      _mm512_storeu_pd(al, _mm512_add_pd(acc0[k], acc1[k]));
+      sums[k] = ((al[0] + al[1]) + (al[2] + al[3]))
+            + ((al[4] + al[5]) + (al[6] + al[7]));
+   }
+   max = _mm512_reduce_max_pd(_mm512_max_pd(m0, m1));
+   for (; i < n; i++) {
+      if (scale) {
+         x[i] *= s;   y[i] *= s;
+      }
+      r = x[i]*y[i];
+      max = fabs(r) > max ? fabs(r) : max;
+      for (k = 0; k < BIN_FOLDS; k++) {
+         q = (m[k] + r) - m[k];
+         sums[k] += q;
+         r -= q;
+      }
+   }
+   return max;
+}  /* Bin_split_avx512 */
+
+__attribute__((target("avx512f")))
+static void Axpy_avx512(double a, double x[], double y[], double z[],
+      size_t n) {
+   __m512d va = _mm512_set1_pd(a);
+   size_t i;
+
+   for (i = 0; i + 16 <= n; i += 16) {
+      _mm512_storeu_pd(z+i, _mm512_fmadd_pd(va, _mm512_loadu_pd(x+i),
+            _mm512_loadu_pd(y+i)));
+      _mm512_storeu_pd(z+i+8, _mm512_fmadd_pd(va, _mm512_loadu_pd(x+i+8),
+            _mm512_loadu_pd(y+i+8)));
+   }
+   for (; i < n; i++)
+      z[i] = a*x[i] + y[i];
+}  /* Axpy_avx512 */
+
+__attribute__((target("avx512f")))
+static void Mul_avx512(double x[], double y[], double z[], size_t n) {
+   size_t i;
+
+   for (i = 0; i + 16 <= n; i += 16) {
+      _mm512_storeu_pd(z+i, _mm512_mul_pd(_mm512_loadu_pd(x+i),
+            _mm512_loadu_pd(y+i)));
+      _mm512_storeu_pd(z+i+8, _mm512_mul_pd(_mm512_loadu_pd(x+i+8),
+            _mm512_loadu_pd(y+i+8)));
+   }
+   for (; i < n; i++)
+      z[i] = x[i]*y[i];
+}  /* Mul_avx512 */
+#endif
+
+#if defined(ELEM_DOUBLE) && defined(__aarch64__)
+static void Scale_neon(double s, double a[], size_t n) {
+   float64x2_t vs = vdupq_n_f64(s);
+   size_t i;
+
+   for (i = 0; i + 4 <= n; i += 4) {
+      vst1q_f64(a+i, vmulq_f64(vld1q_f64(a+i), vs));
+      vst1q_f64(a+i+2, vmulq_f64(vld1q_f64(a+i+2), vs));
+   }
+   for (; i < n; i++)
+      a[i] = a[i]*s;
+}  /* Scale_neon */
+
+static double Dot_neon(double x[], double y[], size_t n) {
+   float64x2_t d0 = vdupq_n_f64(0.0), d1 = vdupq_n_f64(0.0);
+   float64x2_t d2 = vdupq_n_f64(0.0), d3 = vdupq_n_f64(0.0);
+   double dot;
+   size_t i;
+
+   for (i = 0; i + 8 <= n; i += 8) {
+      d0 = vfmaq_f64(d0, vld1q_f64(x+i), vld1q_f64(y+i));
+      d1 = vfmaq_f64(d1, vld1q_f64(x+i+2), vld1q_f64(y+i+2));
+      d2 = vfmaq_f64(d2, vld1q_f64(x+i+4), vld1q_f64(y+i+4));
+      d3 = vfmaq_f64(d3, vld1q_f64(x+i+6), vld1q_f64(y+i+6));
+   }
+   dot = vaddvq_f64(vaddq_f64(vaddq_f64(d0, d1), vaddq_f64(d2, d3)));
+   for (; i < n; i++)
+      dot += x[i]*y[i];
+   return dot;
+}  /* Dot_neon */
+
+static double Scale_dot_neon(double s, double x[], double y[], size_t n) {
+   float64x2_t vs = vdupq_n_f64(s);
+   float64x2_t d0 = vdupq_n_f64(0.0), d1 = vdupq_n_f64(0.0);
+   float64x2_t x0, x1, y0, y1;
+   double dot;
+   size_t i;
+
+   for (i = 0; i + 4 <= n; i += 4) {
+      x0 = vmulq_f64(vld1q_f64(x+i), vs);
+      x1 = vmulq_f64(vld1q_f64(x+i+2), vs);
+      y0 = vmulq_f64(vld1q_f64(y+i), vs);
+      y1 = vmulq_f64(vld1q_f64(y+i+2), vs);
+      vst1q_f64(x+i, x0);   vst1q_f64(x+i+2, x1);
+      vst1q_f64(y+i, y0);   vst1q_f64(y+i+2, y1);
+      d0 = vfmaq_f64(d0, x0, y0);
+      d1 = vfmaq_f64(d1, x1, y1);
+   }
+   dot = vaddvq_f64(vaddq_f64(d0, d1));
+   for (; i < n; i++) {
+      x[i] *= s;   y[i] *= s;
+      dot += x[i]*y[i];
+   }
+   return dot;
+}  /* Scale_dot_neon */
+
+NO_CONTRACT
+static void Dot_comp_neon(double s, double x[], double y[], size_t n,
+      int scale, double res[]) {
+   float64x2_t vs = vdupq_n_f64(s);
+   float64x2_t s0 = vdupq_n_f64(0.0), s1 = s0, s2 = s0, s3 = s0;
+   float64x2_t c0 = s0, c1 = s0, c2 = s0, c3 = s0;
+   float64x2_t d0, d1, d2, d3, a, b, t, z;
+   double sl[2], cl[2];
+   size_t i;
+   int j, l;
+
+   // One FMA of a run on accumulator d, scaling the elements first
+#  define COMP_FMA_NEON(d, off) \
+   a = vld1q_f64(x+i+off);   b = vld1q_f64(y+i+off); \
+   if (scale) { \
+      a = vmulq_f64(a, vs);   b = vmulq_f64(b, vs); \
+      vst1q_f64(x+i+off, a);   vst1q_f64(y+i+off, b); \
+   } \
+   d = vfmaq_f64(d, a, b);
+   // Vector Two_sum:  add d to the (s, c) pairs
+#  define COMP_ADD_NEON(s, c, d) \
+   t = vaddq_f64(s, d);   z = vsubq_f64(t, s); \
+   c = vaddq_f64(c, vaddq_f64(vsubq_f64(s, vsubq_f64(t, z)), \
+            vsubq_f64(d, z))); \
+   s = t;
+   for (i = 0; i + 8 <= n; ) {
+      d0 = d1 = d2 = d3 = vdupq_n_f64(0.0);
+      for (j = 0; j < COMP_RUN && i + 8 <= n; j++, i += 8) {
+         COMP_FMA_NEON(d0, 0)
+         COMP_FMA_NEON(d1, 2)
+         COMP_FMA_NEON(d2, 4)
+         COMP_FMA_NEON(d3, 6)
+      }
+      COMP_ADD_NEON(s0, c0, d0)
+      COMP_ADD_NEON(s1, c1, d1)
+      COMP_ADD_NEON(s2, c2, d2)
+      COMP_ADD_NEON(s3, c3, d3)
+   }
+   // Fold the four pairs into one, so only one vector's lanes are added
+   // one at a time
+   c0 = vaddq_f64(c0, c1);   COMP_ADD_NEON(s0, c0, s1)
+   c2 = vaddq_f64(c2, c3);   COMP_ADD_NEON(s2, c2, s3)
+   c0 = vaddq_f64(c0, c2);   COMP_ADD_NEON(s0, c0, s2)
+#  undef COMP_FMA_NEON
+#  undef COMP_ADD_NEON
+   vst1q_f64(sl, s0);   vst1q_f64(cl, c0);
+   res[0] = res[1] = 0.0;
+   for (l = 0; l < 2; l++) {
+      Two_sum_add(&res[0], &res[1], sl[l]);
+      res[1] += cl[l];
+   }
+   for (; i < n; i++) {
+      if (scale) {
+         x[i] *= s;   y[i] *= s;
+      }
+      Two_sum_add(&res[0], &res[1], x[i]*y[i]);
+   }
+}  /* Dot_comp_neon */
+
+NO_CONTRACT
+static double Bin_split_neon(double s, double x[], double y[], size_t n,
+      int scale, double m[], double sums[]) {
+   float64x2_t vs = vdupq_n_f64(s), x0, x1, y0, y1;
+   float64x2_t vm[BIN_FOLDS], acc0[BIN_FOLDS], acc1[BIN_FOLDS];
+   float64x2_t m0 = vdupq_n_f64(0.0), m1 = m0;
+   float64x2_t r0, r1, q0, q1;
+   double max, r, q;
+   size_t i;
+   int k;
+
+   for (k = 0; k < BIN_FOLDS; k++) {
+      vm[k] = vdupq_n_f64(m[k]);
+      acc0[k] = acc1[k] = vdupq_n_f64(0.0);
+   }
+   for (i = 0; i + 4 <= n; i += 4) {
+      x0 = vld1q_f64(x+i);   x1 = vld1q_f64(x+i+2);
+      y0 = vld1q_f64(y+i);   y1 = vld1q_f64(y+i+2);
+      if (scale) {
+         x0 = vmulq_f64(x0, vs);   x1 = vmulq_f64(x1, vs);
+         y0 = vmulq_f64(y0, vs);   y1 = vmulq_f64(y1, vs);
+         vst1q_f64(x+i, x0);   vst1q_f64(x+i+2, x1);
+         vst1q_f64(y+i, y0);   vst1q_f64(y+i+2, y1);
+      }
+      r0 = vmulq_f64(x0, y0);
+      r1 = vmulq_f64(x1, y1);
+      m0 = vmaxq_f64(m0, vabsq_f64(r0));
+      m1 = vmaxq_f64(m1, vabsq_f64(r1));
+      for (k = 0; k < BIN_FOLDS; k++) {
+         q0 = vsubq_f64(vaddq_f64(vm[k], r0), vm[k]);
+         q1 = vsubq_f64(vaddq_f64(vm[k], r1), vm[k]);
+         acc0[k] = vaddq_f64(acc0[k], q0);
+         acc1[k] = vaddq_f64(acc1[k], q1);
+         r0 = vsubq_f64(r0, q0);
+         r1 = vsubq_f64(r1, q1);
+      }
+   }
+   for (k = 0; k < BIN_FOLDS; k++)
+      sums[k] = vaddvq_f64(vaddq_f64(acc0[k], acc1[k]));
+   max = vmaxvq_f64(vmaxq_f64(m0, m1));
+   for (; i < n; i++) {
+      if (scale) {
+         x[i] *= s;   y[i] *= s;
+      }
+      r = x[i]*y[i];
+      max = fabs(r) > max ? fabs(r) : max;
+      for (k = 0; k < BIN_FOLDS; k++) {
+         q = (m[k] + r) - m[k];
+         sums[k] += q;
+         r -= q;
+      }
+   }
+   return max;
+}  /* Bin_split_neon */
+
+static void Axpy_neon(double a, double x[], double y[], double z[],
+      size_t n) {
+   float64x2_t va = vdupq_n_f64(a);
+   size_t i;
+
+   for (i = 0; i + 4 <= n; i += 4) {
+      vst1q_f64(z+i, vfmaq_f64(vld1q_f64(y+i), va, vld1q_f64(x+i)));
+      vst1q_f64(z+i+2, vfmaq_f64(vld1q_f64(y+i+2), va, vld1q_f64(x+i+2)));
+   }
+   for (; i < n; i++)
+      z[i] = a*x[i] + y[i];
+}  /* Axpy_neon */
+
+static void Mul_neon(double x[], double y[], double z[], size_t n) {
+   size_t i;
+
+   for (i = 0; i + 4 <= n; i += 4) {
+      vst1q_f64(z+i, vmulq_f64(vld1q_f64(x+i), vld1q_f64(y+i)));
+      vst1q_f64(z+i+2, vmulq_f64(vld1q_f64(x+i+2), vld1q_f64(y+i+2)));
+   }
+   for (; i < n; i++)
+      z[i] = x[i]*y[i];
+}  /* Mul_neon */
+#endif
+
+/*-------------------------------------------------------------------
+ * Function:  Select_kernels
+ * Purpose:   Fill in the kernels table with the widest kernels the
+ *            CPU running this process supports
+ */
+static void Select_kernels(void) {
+   kernels.name = "generic";
+   kernels.scale = Scale_generic;
+   kernels.dot = Dot_generic;
+   kernels.scale_dot = Scale_dot_generic;
+   kernels.dot_comp = Dot_comp_generic;
+   kernels.bin_split = Bin_split_generic;
+   kernels.axpy = Axpy_generic;
+   kernels.mul = Mul_generic;
+#  if !defined(ELEM_DOUBLE)
+   // the SIMD kernels only take doubles
+#  elif defined(__x86_64__) || defined(__i386__)
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx512f")) {
+      kernels.name = "avx512";
+      kernels.scale = Scale_avx512;
+      kernels.dot = Dot_avx512;
+      kernels.scale_dot = Scale_dot_avx512;
+      kernels.dot_comp = Dot_comp_avx512;
+      kernels.bin_split = Bin_split_avx512;
+      kernels.axpy = Axpy_avx512;
+      kernels.mul = Mul_avx512;
+   } else if (__builtin_cpu_supports("avx2") &&
+              __builtin_cpu_supports("fma")) {
+      kernels.name = "avx2";
+      kernels.scale = Scale_avx2;
+      kernels.dot = Dot_avx2;
+      kernels.scale_dot = Scale_dot_avx2;
+      kernels.dot_comp = Dot_comp_avx2;
+      kernels.bin_split = Bin_split_avx2;
+      kernels.axpy = Axpy_avx2;
+      kernels.mul = Mul_avx2;
+   }
+#  elif defined(__aarch64__)
+   kernels.name = "neon";
+   kernels.scale = Scale_neon;
+   kernels.dot = Dot_neon;
+   kernels.scale_dot = Scale_dot_neon;
+   kernels.dot_comp = Dot_comp_neon;
+   kernels.bin_split = Bin_split_neon;
+   kernels.axpy = Axpy_neon;
+   kernels.mul = Mul_neon;
+#  endif
+}  /* Select_kernels */
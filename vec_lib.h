@@ -0,0 +1,169 @@
+/* File:     vec_lib.h
+ *
+ * Purpose:  The library interface of mpi_vector_add2.c and
+ *           vector_add2.c compiled with -DVEC_LIBRARY:  their context
+ *           types, the modes and error bits their calls take and
+ *           return, the element type and the vector file format
+ *
+ * Notes:
+ * 1. Both .c files include this header, so the definitions a caller
+ *    sees are the ones the objects were built with.  A caller has to
+ *    be compiled with the same -DELEM_FLOAT, -DELEM_INT64 or
+ *    -DELEM_HALF (or none, for doubles) as mpi_vector_add2.c.
+ * 2. The Vec_ctx_* calls of mpi_vector_add2.c are only declared when
+ *    <mpi.h> is included first.  The Vec_serial_* calls of
+ *    vector_add2.c don't need MPI.
+ * 3. The RNG_ engines of Vec_ctx_init and Vec_serial_init come from
+ *    vec_rng.h.
+ * 4. A Vec_ctx_t keeps its communicator, its modes, its pool of
+ *    blocks, and the persistent point-to-point requests
+ *    (MPI_Send_init/MPI_Recv_init) of its dot product reduction.  It
+ *    doesn't keep a persistent collective:  MPI_Reduce_init is MPI 4,
+ *    and the MPI these files are built with is MPI 3.1.  The requests
+ *    point into the context, so it mustn't be copied or moved
+ *    between Vec_ctx_init and Vec_ctx_free.
+ */
+#ifndef VEC_LIB_H
+#define VEC_LIB_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "vec_rng.h"
+
+/* Vector files:  a Vec_header_t, then n elements of the dtype */
+#define VEC_MAGIC  0x31434556   /* "VEC1" in a little-endian file */
+#define VEC_DOUBLE 1
+#define VEC_FLOAT  2
+#define VEC_INT64  3
+#define VEC_HALF   4
+typedef struct {
+   uint32_t  magic;
+   uint32_t  dtype;
+   uint64_t  n;
+} Vec_header_t;
+
+/* Element type of x and y, picked at compile time with -DELEM_FLOAT,
+ * -DELEM_INT64 or -DELEM_HALF (double otherwise).  acc_t is the type
+ * the generic dot kernels add the products in, MPI_ELEM moves the
+ * elements, and the SIMD kernels are only built for doubles.  MPI has
+ * no half type, but halves are only ever moved, never reduced, so
+ * their bits go as 16-bit integers.  vector_add2.c only works on
+ * doubles. */
+#if defined(ELEM_FLOAT)
+typedef float elem_t;
+typedef double acc_t;
+#  define MPI_ELEM   MPI_FLOAT
+#  define ELEM_DTYPE VEC_FLOAT
+#  define ELEM_NAME  "float"
+#elif defined(ELEM_INT64)
+typedef int64_t elem_t;
+typedef int64_t acc_t;
+#  define MPI_ELEM   MPI_INT64_T
+#  define ELEM_DTYPE VEC_INT64
+#  define ELEM_NAME  "int64"
+#elif defined(ELEM_HALF)
+typedef _Float16 elem_t;
+typedef float acc_t;
+#  define MPI_ELEM   MPI_UINT16_T
+#  define ELEM_DTYPE VEC_HALF
+#  define ELEM_NAME  "half"
+#else
+#  define ELEM_DOUBLE
+typedef double elem_t;
+typedef double acc_t;
+#  define MPI_ELEM   MPI_DOUBLE
+#  define ELEM_DTYPE VEC_DOUBLE
+#  define ELEM_NAME  "double"
+#endif
+
+/* Accumulation modes of the dot product (--sum) */
+#define SUM_NAIVE    0
+#define SUM_COMP     1
+#define SUM_PAIRWISE 2
+#define SUM_BINNED   3
+
+/* Ways of combining the processes' dot products (--reduce) */
+#define REDUCE_ROOT 0
+#define REDUCE_ALL  1
+#define REDUCE_IALL 2
+
+/* Errors a process can find.  mpi_vector_add2's Record_error sets them
+ * in local_errors and Check_errors combines them over all the
+ * processes with a single reduction at the end of a phase.  The
+ * library calls keep theirs in the context instead, and
+ * Vec_ctx_errors and Vec_serial_errors return them (ERR_ARG is a bad
+ * mode or argument of a library call). */
+#define ERR_ALLOC_VECTOR 1
+#define ERR_ALLOC_TEMP   2
+#define ERR_ALLOC_BENCH  4
+#define ERR_FILE_READ    8
+#define ERR_FILE_WRITE   16
+#define ERR_ARG          32
+#define ERR_SERIAL       64
+
+/* Serial library context (see Vec_serial_init) */
+typedef struct {
+   int  rng;
+   int  errors;
+} Vec_serial_t;
+
+int Vec_serial_init(Vec_serial_t* ctx, int rng);
+int Vec_serial_errors(Vec_serial_t* ctx);
+double* Vec_serial_alloc(Vec_serial_t* ctx, size_t n);
+void Vec_serial_release(Vec_serial_t* ctx, double a[]);
+int Vec_serial_generate(Vec_serial_t* ctx, double a[], size_t n,
+      uint64_t stream, int randmax, uint64_t seed);
+int Vec_serial_sum(Vec_serial_t* ctx, double x[], double y[], double z[],
+      size_t n);
+int Vec_serial_scale(Vec_serial_t* ctx, int scalar, double a[], size_t n);
+double Vec_serial_dot(Vec_serial_t* ctx, int scalar, double x[],
+      double y[], size_t n, int scale);
+
+#ifdef MPI_VERSION
+/* Library context (see Vec_ctx_init):  a communicator of its own, the
+ * SUM_, REDUCE_ and RNG_ modes of its operations, the ERR_ bits its
+ * calls have found, a pool of aligned blocks that are reused from one
+ * call to the next, and the persistent requests of a binomial tree
+ * that reduces the dot product parts (VEC_PARTS doubles each) up to
+ * process 0 and, unless the mode is REDUCE_ROOT, sends the total back
+ * down.  A process has at most VEC_TREE children. */
+#define POOL_SIZE 16
+#define VEC_PARTS 7
+#define VEC_TREE  32
+typedef struct {
+   MPI_Comm      comm;
+   int           my_rank;
+   int           comm_sz;
+   int           sum;
+   int           reduce;
+   int           rng;
+   int           errors;
+   elem_t*       pool[POOL_SIZE];
+   size_t        pool_n[POOL_SIZE];
+   int           pool_busy[POOL_SIZE];
+   MPI_Datatype  type;
+   MPI_Op        op;
+   int           num_children;
+   MPI_Request   up[VEC_TREE + 1];
+   MPI_Request   down[VEC_TREE + 1];
+   double        part[VEC_PARTS];
+   double        child[VEC_TREE][VEC_PARTS];
+} Vec_ctx_t;
+
+int Vec_ctx_init(Vec_ctx_t* ctx, MPI_Comm comm, int sum, int reduce,
+      int rng);
+void Vec_ctx_free(Vec_ctx_t* ctx);
+int Vec_ctx_errors(Vec_ctx_t* ctx);
+void Vec_ctx_block(Vec_ctx_t* ctx, size_t n, size_t* first_p,
+      size_t* local_n_p);
+elem_t* Vec_ctx_alloc(Vec_ctx_t* ctx, size_t local_n);
+void Vec_ctx_release(Vec_ctx_t* ctx, elem_t local_a[]);
+int Vec_ctx_generate(Vec_ctx_t* ctx, elem_t local_a[], size_t n,
+      uint64_t stream, int randmax, uint64_t seed);
+int Vec_ctx_scale(Vec_ctx_t* ctx, int scalar, elem_t local_a[],
+      size_t local_n);
+double Vec_ctx_dot(Vec_ctx_t* ctx, int scalar, elem_t local_x[],
+      elem_t local_y[], size_t local_n, int scale);
+#endif
+
+#endif
@@ -0,0 +1,320 @@
+/* File:     vec_rng.h
+ *
+ * Purpose:  The random number generators of x and y, shared by
+ *           mpi_vector_add2.c and vector_add2.c so both programs
+ *           generate the same vectors for the same seed and engine
+ *
+ * Notes:
+ * 1. Element i of a vector only depends on the seed, the vector's
+ *    stream (0 for x, 1 for y), i and the engine, so any block of a
+ *    vector can be generated on its own, by any process or thread.
+ * 2. The engines are a counter-based splitmix64 hash (RNG_SPLITMIX),
+ *    Philox4x32-10 (RNG_PHILOX) and xoshiro256** (RNG_XOSHIRO), which
+ *    starts a new sequence every RNG_BATCH elements.  Rng_uniform
+ *    reduces their bits to [0, range) with Lemire's multiply and
+ *    reject method.
+ * 3. Everything is static inline, so each program gets its own copy,
+ *    neither exports these names, and a program that doesn't call
+ *    one of them gets no warning.
+ */
+#ifndef VEC_RNG_H
+#define VEC_RNG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Random number engines (--rng), and the elements generated per call
+ * of Rng_fill.  xoshiro256** starts a new sequence every RNG_BATCH
+ * elements, so any block can be generated without the ones before. */
+#define RNG_SPLITMIX 0
+#define RNG_PHILOX   1
+#define RNG_XOSHIRO  2
+#define RNG_BATCH    256
+
+static inline int Rng_engine(const char name[]);
+static inline uint64_t Counter_rand(uint64_t seed, uint64_t stream,
+      uint64_t i);
+static inline void Rng_fill(int engine, uint64_t seed, uint64_t stream,
+      uint64_t first, size_t count, uint64_t r[]);
+static inline void Philox_fill(uint64_t seed, uint64_t stream,
+      uint64_t first, size_t count, uint64_t r[]);
+static inline void Xoshiro_fill(uint64_t seed, uint64_t stream,
+      uint64_t first, size_t count, uint64_t r[]);
+static inline uint64_t Mul_hi(uint64_t a, uint64_t b, uint64_t* lo_p);
+static inline uint64_t Rand_range(uint64_t seed, uint64_t stream, uint64_t i,
+      uint64_t r, uint64_t range, uint64_t threshold);
+static inline void Rng_uniform(int engine, uint64_t seed, uint64_t stream,
+      uint64_t first, size_t count, uint64_t range, uint64_t threshold,
+      uint64_t r[]);
+
+
+/*-------------------------------------------------------------------
+ * Function:  Rng_engine
+ * Purpose:   Find the engine of an --rng name
+ * In arg:    name:  splitmix, philox or xoshiro
+ * Ret val:   its RNG_ value, or -1 if there's no engine of that name
+ */
+static inline int Rng_engine(const char name[] /* in */) {
+   if (strcmp(name, "splitmix") == 0) return RNG_SPLITMIX;
+   if (strcmp(name, "philox") == 0) return RNG_PHILOX;
+   if (strcmp(name, "xoshiro") == 0) return RNG_XOSHIRO;
+   return -1;
+}  /* Rng_engine */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Counter_rand
+ * Purpose:   Counter-based random number: hash (seed, stream, i) with
+ *            the splitmix64 finalizer.  Element i of a vector doesn't
+ *            depend on which process generates it.
+ * In args:   seed:    global seed
+ *            stream:  vector being generated (0 for x, 1 for y, ...)
+ *            i:       global index of the element
+ * Ret val:   64 random bits
+ */
+static inline uint64_t Counter_rand(
+      uint64_t  seed    /* in */,
+      uint64_t  stream  /* in */,
+      uint64_t  i       /* in */) {
+   uint64_t z = seed ^ (stream * 0xD1B54A32D192ED03ULL);
+
+   z += (i + 1) * 0x9E3779B97F4A7C15ULL;
+   z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+   z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+   return z ^ (z >> 31);
+}  /* Counter_rand */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Rng_fill
+ * Purpose:   Fill r with the raw random numbers of elements first,
+ *            first+1, ..., first+count-1 of a vector
+ * In args:   engine:  RNG_SPLITMIX, RNG_PHILOX or RNG_XOSHIRO
+ *            seed:    global seed
+ *            stream:  vector being generated (0 for x, 1 for y, ...)
+ *            first:   global index of the first element
+ *            count:   number of elements
+ * Out arg:   r:       64 random bits per element
+ *
+ * Note:
+ *    The loops of the engines have no dependences between elements
+ *    (xoshiro256** only within a batch), so they can be vectorized.
+ */
+static inline void Rng_fill(
+      int       engine   /* in  */,
+      uint64_t  seed     /* in  */,
+      uint64_t  stream   /* in  */,
+      uint64_t  first    /* in  */,
+      size_t    count    /* in  */,
+      uint64_t  r[]      /* out */) {
+   size_t j;
+
+   if (engine == RNG_PHILOX) {
+      Philox_fill(seed, stream, first, count, r);
+   } else if (engine == RNG_XOSHIRO) {
+      Xoshiro_fill(seed, stream, first, count, r);
+   } else {
+      for (j = 0; j < count; j++)
+         r[j] = Counter_rand(seed, stream, first + j);
+   }
+}  /* Rng_fill */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Philox_fill
+ * Purpose:   Rng_fill with Philox4x32-10:  each block of 128 bits is
+ *            ten rounds of the Philox bijection over the counter
+ *            (i/2, stream) under the key seed, and gives elements i
+ *            and i+1 (i even)
+ * In args:   seed, stream, first, count:  as in Rng_fill
+ * Out arg:   r:  as in Rng_fill
+ */
+static inline void Philox_fill(
+      uint64_t  seed     /* in  */,
+      uint64_t  stream   /* in  */,
+      uint64_t  first    /* in  */,
+      size_t    count    /* in  */,
+      uint64_t  r[]      /* out */) {
+   uint64_t i, p0, p1;
+   uint32_t c0, c1, c2, c3, k0, k1;
+   size_t j, len;
+   int round;
+
+   for (j = 0; j < count; j += len) {
+      i = (first + j) >> 1;
+      c0 = (uint32_t) i;
+      c1 = (uint32_t) (i >> 32);
+      c2 = (uint32_t) stream;
+      c3 = (uint32_t) (stream >> 32);
+      k0 = (uint32_t) seed;
+      k1 = (uint32_t) (seed >> 32);
+      for (round = 0; round < 10; round++) {
+         p0 = (uint64_t) 0xD2511F53U * c0;
+         p1 = (uint64_t) 0xCD9E8D57U * c2;
+         c0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+         c1 = (uint32_t) p1;
+         c2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+         c3 = (uint32_t) p0;
+         k0 += 0x9E3779B9U;
+         k1 += 0xBB67AE85U;
+      }
+      // A block that starts before first only gives its odd element
+      if ((first + j) & 1) {
+         r[j] = (uint64_t) c3 << 32 | c2;
+         len = 1;
+      } else {
+         r[j] = (uint64_t) c1 << 32 | c0;
+         if (j + 1 < count) r[j+1] = (uint64_t) c3 << 32 | c2;
+         len = 2;
+      }
+   }
+}  /* Philox_fill */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Xoshiro_fill
+ * Purpose:   Rng_fill with xoshiro256**:  every run of RNG_BATCH
+ *            elements, starting at a multiple of RNG_BATCH, is one
+ *            sequence whose state is seeded with Counter_rand
+ * In args:   seed, stream, first, count:  as in Rng_fill
+ * Out arg:   r:  as in Rng_fill
+ *
+ * Note:
+ *    A call that starts inside a run steps over the elements before
+ *    first, so callers should fill whole runs where they can (see
+ *    Rng_uniform).
+ */
+static inline void Xoshiro_fill(
+      uint64_t  seed     /* in  */,
+      uint64_t  stream   /* in  */,
+      uint64_t  first    /* in  */,
+      size_t    count    /* in  */,
+      uint64_t  r[]      /* out */) {
+   uint64_t s0, s1, s2, s3, t, x, i, run;
+   size_t j = 0;
+
+   while (j < count) {
+      i = first + j;
+      run = i / RNG_BATCH;
+      // Stream bit 63 keeps the seeds apart from the splitmix elements
+      s0 = Counter_rand(seed, stream | (1ULL << 63), 4*run);
+      s1 = Counter_rand(seed, stream | (1ULL << 63), 4*run + 1);
+      s2 = Counter_rand(seed, stream | (1ULL << 63), 4*run + 2);
+      s3 = Counter_rand(seed, stream | (1ULL << 63), 4*run + 3);
+      for (i = run*RNG_BATCH; i < (run + 1)*RNG_BATCH && j < count; i++) {
+         x = s1*5;
+         x = ((x << 7) | (x >> 57))*9;
+         t = s1 << 17;
+         s2 ^= s0;
+         s3 ^= s1;
+         s1 ^= s2;
+         s0 ^= s3;
+         s2 ^= t;
+         s3 = (s3 << 45) | (s3 >> 19);
+         if (i >= first) r[j++] = x;
+      }
+   }
+}  /* Xoshiro_fill */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Mul_hi
+ * Purpose:   Multiply two 64-bit numbers
+ * In args:   a, b:  the numbers
+ * Out arg:   lo_p:  the low 64 bits of a*b
+ * Ret val:   the high 64 bits of a*b
+ */
+static inline uint64_t Mul_hi(
+      uint64_t   a     /* in  */,
+      uint64_t   b     /* in  */,
+      uint64_t*  lo_p  /* out */) {
+#  ifdef __SIZEOF_INT128__
+   unsigned __int128 p = (unsigned __int128) a * b;
+
+   *lo_p = (uint64_t) p;
+   return (uint64_t) (p >> 64);
+#  else
+   uint64_t a0 = (uint32_t) a, a1 = a >> 32, b0 = (uint32_t) b, b1 = b >> 32;
+   uint64_t p00 = a0*b0, p01 = a0*b1, p10 = a1*b0, p11 = a1*b1;
+   uint64_t mid = (p00 >> 32) + (uint32_t) p01 + (uint32_t) p10;
+
+   *lo_p = (mid << 32) | (uint32_t) p00;
+   return p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+#  endif
+}  /* Mul_hi */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Rand_range
+ * Purpose:   Turn 64 random bits into a number in [0, range) without
+ *            bias, with Lemire's multiply and reject method
+ * In args:   seed, stream, i:  the element, for redrawing
+ *            r:                its random bits
+ *            range:            size of the range, > 0
+ *            threshold:        2^64 mod range
+ * Ret val:   the number
+ *
+ * Note:
+ *    The high half of r*range is the number unless the low half is
+ *    below threshold, which happens with probability < range/2^64.
+ *    Then the element is redrawn with Counter_rand on a stream that's
+ *    only used for this, so the result still only depends on seed,
+ *    stream and i.
+ */
+static inline uint64_t Rand_range(
+      uint64_t  seed       /* in */,
+      uint64_t  stream     /* in */,
+      uint64_t  i          /* in */,
+      uint64_t  r          /* in */,
+      uint64_t  range      /* in */,
+      uint64_t  threshold  /* in */) {
+   uint64_t hi, lo, attempt = 0;
+
+   hi = Mul_hi(r, range, &lo);
+   while (lo < threshold) {
+      attempt++;
+      r = Counter_rand(seed + attempt, ~stream, i);
+      hi = Mul_hi(r, range, &lo);
+   }
+   return hi;
+}  /* Rand_range */
+
+
+/*-------------------------------------------------------------------
+ * Function:  Rng_uniform
+ * Purpose:   Fill r with elements first, first+1, ..., first+count-1
+ *            of a vector of random numbers in [0, range)
+ * In args:   engine, seed, stream, first, count:  as in Rng_fill
+ *            range:      size of the range, > 0
+ *            threshold:  2^64 mod range, computed once per vector by
+ *                        the caller
+ * Out arg:   r:          the numbers
+ *
+ * Note:
+ *    Callers fill RNG_BATCH elements at a time, in runs that start at
+ *    multiples of RNG_BATCH, so xoshiro256** never steps over elements
+ *    and the batch stays in cache between the two loops.
+ */
+static inline void Rng_uniform(
+      int       engine     /* in  */,
+      uint64_t  seed       /* in  */,
+      uint64_t  stream     /* in  */,
+      uint64_t  first      /* in  */,
+      size_t    count      /* in  */,
+      uint64_t  range      /* in  */,
+      uint64_t  threshold  /* in  */,
+      uint64_t  r[]        /* out */) {
+   uint64_t lo, hi;
+   size_t j;
+
+   Rng_fill(engine, seed, stream, first, count, r);
+   for (j = 0; j < count; j++) {
+      hi = Mul_hi(r[j], range, &lo);
+      r[j] = lo < threshold
+         ? Rand_range(seed, stream, first + j, r[j], range, threshold)
+         : hi;
+   }
+}  /* Rng_uniform */
+
+#endif
@@ -3,59 +3,240 @@
  * Purpose:  Implement vector addition
  *
  * Compile:  gcc -g -Wall -o vector_add vector_add.c
- * Run:      ./vector_add
+ *           (add -lrt with glibc older than 2.34, for the aio_*
+ *           functions)
+ * Run:      ./vector_add [--seed SEED] [--rng ENGINE] [--unfused]
+ *                [[--tile T] XFILE YFILE [ZFILE]]
  *
- * Input:    The order of the vectors, n, and the vectors x and y
- * Output:   The sum vector z = x+y
+ * Input:    The order of the vectors, n, and the vectors x and y, or
+ *           the vector files XFILE and YFILE
+ * Output:   The sum vector z = x+y, written to the vector file ZFILE
+ *           if it's given
  *
- * Note:
- *    If the program detects an error (order of vector <= 0 or malloc
- * failure), it prints a message and terminates
+ * Notes:
+ * 1. After the sum, x and y are multiplied by a scalar and their dot
+ *    product is computed in one fused pass.  --unfused runs the three
+ *    separate passes instead, as in mpi_vector_add2.
+ * 2. Vector_sum uses AVX-512, AVX2 or NEON when the CPU supports
+ *    them; the choice is made at run time.
+ * 3. Vector sizes are size_t, so n can be bigger than INT_MAX.
+ * 4. Vector files have a VEC_HEADER-byte header (the magic "VEC1",
+ *    the dtype and n) followed by the n raw doubles in native byte
+ *    order, as in mpi_vector_add2.  They're mapped with mmap instead
+ *    of read:  x and y are mapped copy-on-write, so scaling them
+ *    doesn't change the files, and z is computed straight into the
+ *    mapping of ZFILE.
+ * 5. With --tile T the vector files are streamed instead of mapped:
+ *    they're read T elements at a time with POSIX AIO into two sets
+ *    of tile buffers, so the next tile is read, and the last z tile
+ *    written, while the current one is summed, scaled and dotted with
+ *    the same kernels.  The program then needs 6*T doubles, whatever
+ *    n is, and the vectors can be bigger than the RAM.
+ * 6. x and y are generated with the generators of vec_rng.h, shared
+ *    with mpi_vector_add2:  --rng splitmix (the default), philox or
+ *    xoshiro, seeded from --seed (default 1), with x as stream 0 and
+ *    y as stream 1, and reduced to [0, randmax) with Lemire's multiply
+ *    and reject method, so there's no modulo bias.  For the same seed
+ *    and engine x and y are the same as in mpi_vector_add2.
+ * 7. Compiled with -DVEC_LIBRARY there's no main, and the program
+ *    that links the file uses the Vec_serial_* functions:  a
+ *    Vec_serial_t holds the --rng engine of its vectors and the
+ *    errors its calls have found, which Vec_serial_errors returns
+ *    instead of ending the program.  They're declared, with the
+ *    Vec_serial_t and the ERR_ bits, in vec_lib.h.  Everything else
+ *    is static, so the objects of this file and of mpi_vector_add2.c
+ *    can be linked into the same program.
+ * 8. If the program detects an error (order of vector <= 0, malloc
+ *    failure or a bad vector file), it prints a message and
+ *    terminates
  *
  * IPP:      Section 3.4.6 (p. 109)
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <aio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#elif defined(__aarch64__)
+#  include <arm_neon.h>
+#endif
+#include "vec_rng.h"
+#include "vec_lib.h"
+
+/* Most of the file isn't called without main */
+#if defined(VEC_LIBRARY) && defined(__GNUC__)
+#  pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+
+/* Bytes before the elements of a vector file (see vec_lib.h) */
+#define VEC_HEADER sizeof(Vec_header_t)
 
-void Read_n(int* n_p);
-void Read_RandMax(int* randmax);
-void Allocate_vectors(double** x_pp, double** y_pp, double** z_pp, int n);
-void Generate_vector(double a[], int n, char vec_name[],int randmax);
-void Print_vector(double b[], int n, char title[]);
-void PrintTopDown_vector(double b[], int n, char title[]);
-void Vector_sum(double x[], double y[], double z[], int n);
+static double Wall_time(void);
+static void Read_n(size_t* n_p);
+static void Read_RandMax(int* randmax);
+static void Allocate_vector(double** a_pp, size_t n);
+static void Generate_vector(double a[], size_t n, char vec_name[],int randmax,
+      int engine, uint64_t seed);
+static void Fill_vector(double a[], size_t n, uint64_t stream, int randmax,
+      int engine, uint64_t seed);
+static int Open_vector_file(char fname[], size_t* n_p);
+static double* Map_vector(char fname[], size_t* n_p);
+static double* Create_vector_file(char fname[], size_t n);
+static void Unmap_vector(double a[], size_t n);
+static void Stream_vectors(char xname[], char yname[], char zname[],
+      size_t tile, int unfused);
+static void Read_sample(int fd, char fname[], size_t n, double head[],
+      double tail[]);
+static void Aio_start(struct aiocb* cb, int fd, double a[], size_t count,
+      size_t first, int write);
+static void Aio_wait(struct aiocb* cb, char fname[]);
+static void Print_preview(double head[], double tail[], size_t n,
+      char title[]);
+static void PrintTopDown_vector(double b[], size_t n, char title[]);
+static void Vector_sum(double x[], double y[], double z[], size_t n);
+static void Read_Scalar(int* scalar);
+static void Vector_scalar(int scalar, double a[], size_t n);
+static double Vector_dot(double x[], double y[], size_t n);
+static double Vector_scalar_dot(int scalar, double x[], double y[], size_t n,
+      int keep_scaled);
+
+/* Sum kernel, picked at run time by Select_kernels */
+typedef struct {
+   const char* name;
+   void (*sum)(double x[], double y[], double z[], size_t n);
+} Sum_kernels_t;
+static Sum_kernels_t sum_kernels;
+static void Select_kernels(void);
+static void Sum_generic(double x[], double y[], double z[], size_t n);
 
 /*---------------------------------------------------------------------*/
-int main(void) {
-   clock_t start = clock();
-   int n, randmax;
+#ifndef VEC_LIBRARY
+int main(int argc, char* argv[]) {
+   double start = Wall_time();
+   size_t n, n_y;
+   long long tile = 0;
+   uint64_t seed = 1;
+   char* prog = argv[0];
+   int randmax = 0, engine = RNG_SPLITMIX, unfused = 0, scalar;
    double *x, *y, *z;
+   double result;
 
-   Read_n(&n);
-   Read_RandMax(&randmax);
-   Allocate_vectors(&x, &y, &z, n);
-   
-   Generate_vector(x, n, "x",randmax);
-   Generate_vector(y, n, "y",randmax);
+   if (argc > 2 && strcmp(argv[1], "--seed") == 0) {
+      seed = strtoull(argv[2], NULL, 10);
+      argv += 2;
+      argc -= 2;
+   }
+   if (argc > 2 && strcmp(argv[1], "--rng") == 0) {
+      engine = Rng_engine(argv[2]);
+      argv += 2;
+      argc -= 2;
+      if (engine < 0) argc = 0;
+   }
+   if (argc > 1 && strcmp(argv[1], "--unfused") == 0) {
+      unfused = 1;
+      argv++;
+      argc--;
+   }
+   if (argc > 2 && strcmp(argv[1], "--tile") == 0) {
+      tile = strtoll(argv[2], NULL, 10);
+      argv += 2;
+      argc -= 2;
+      if (tile <= 0 || argc == 1) argc = 0;
+   }
+   if (argc != 1 && argc != 3 && argc != 4) {
+      fprintf(stderr,
+            "usage: %s [--seed SEED] [--rng splitmix|philox|xoshiro]\n"
+            "          [--unfused] [[--tile T] XFILE YFILE [ZFILE]]\n",
+            prog);
+      exit(-1);
+   }
+   Select_kernels();
+   if (tile > 0) {
+      Stream_vectors(argv[1], argv[2], argc == 4 ? argv[3] : NULL, tile,
+            unfused);
+      printf("\nTook %.3lf s to run\n", Wall_time() - start);
+      return 0;
+   }
+   if (argc > 1) {
+      x = Map_vector(argv[1], &n);
+      y = Map_vector(argv[2], &n_y);
+      if (n_y != n) {
+         fprintf(stderr, "%s and %s have different sizes\n", argv[1],
+               argv[2]);
+         exit(-1);
+      }
+   } else {
+      Read_n(&n);
+      Read_RandMax(&randmax);
+      // Each vector is allocated by the step that first needs it
+      Allocate_vector(&x, n);
+      Generate_vector(x, n, "x",randmax, engine, seed);
+      Allocate_vector(&y, n);
+      Generate_vector(y, n, "y",randmax, engine, seed);
+   }
    PrintTopDown_vector(x, n, "Vector x");
    PrintTopDown_vector(y, n, "Vector y");
 
+   if (argc == 4)
+      z = Create_vector_file(argv[3], n);
+   else
+      Allocate_vector(&z, n);
    Vector_sum(x, y, z, n);
 
-   // Print_vector(z, n, "The sum is");
+   // PrintTopDown_vector(z, n, "The sum is");
+   if (argc == 4)
+      Unmap_vector(z, n);
+   else
+      free(z);
 
-   free(x);
-   free(y);
-   free(z);
+   Read_Scalar(&scalar);
+   if (unfused) {
+      Vector_scalar(scalar, x, n);
+      Vector_scalar(scalar, y, n);
+      result = Vector_dot(x, y, n);
+   } else {
+      result = Vector_scalar_dot(scalar, x, y, n, 1);
+   }
+   PrintTopDown_vector(x, n, "Vector x by scalar");
+   PrintTopDown_vector(y, n, "Vector y by scalar");
+   printf("\nResult of dot product: %lf\n", result);
 
-   clock_t difference = clock() - start;
-   int msec = difference * 1000 / CLOCKS_PER_SEC;
+   if (argc > 1) {
+      Unmap_vector(x, n);
+      Unmap_vector(y, n);
+   } else {
+      free(x);
+      free(y);
+   }
 
-   printf("\nTook %d.%d s to run\n",msec/1000,msec%1000);
+   printf("\nTook %.3lf s to run\n", Wall_time() - start);
 
    return 0;
 }  /* main */
+#endif
+
+/*---------------------------------------------------------------------
+ * Function:  Wall_time
+ * Purpose:   Read a monotonic wall clock.  clock() measures CPU time,
+ *            which leaves out the time the process is blocked, so it
+ *            can't be compared with the MPI_Wtime times of
+ *            mpi_vector_add2.
+ * Ret val:   time in seconds since an arbitrary point
+ */
+static double Wall_time(void) {
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + 1e-9*ts.tv_nsec;
+}  /* Wall_time */
 
 /*---------------------------------------------------------------------
  * Function:  Read_n
@@ -64,13 +245,16 @@ int main(void) {
  *
  * Errors:    If n <= 0, the program terminates
  */
-void Read_n(int* n_p /* out */) {
+static void Read_n(size_t* n_p /* out */) {
+   long long n_in = 0;
+
    printf("What's the order of the vectors?\n");
-   scanf("%d", n_p);
-   if (*n_p <= 0) {
+   scanf("%lld", &n_in);
+   if (n_in <= 0) {
       fprintf(stderr, "Order should be positive\n");
       exit(-1);
    }
+   *n_p = (size_t) n_in;
 }  /* Read_n */
 
 /*---------------------------------------------------------------------
@@ -80,95 +264,440 @@ void Read_n(int* n_p /* out */) {
  *
  * Errors:    If randmax <= 0, the program terminates
  */
-void Read_RandMax(int* randmax /* out */) {
+static void Read_RandMax(int* randmax /* out */) {
    printf("What's the max number for random?\n");
    scanf("%d", randmax);
-   if (randmax <= 0) {
+   if (*randmax <= 0) {
       fprintf(stderr, "Max number should be positive\n");
       exit(-1);
    }
 }  /* Read_RandMax */
 
 /*---------------------------------------------------------------------
- * Function:  Allocate_vectors
- * Purpose:   Allocate storage for the vectors
- * In arg:    n:  the order of the vectors
- * Out args:  x_pp, y_pp, z_pp:  pointers to storage for the vectors
+ * Function:  Allocate_vector
+ * Purpose:   Allocate storage for one vector
+ * In arg:    n:  the order of the vector
+ * Out arg:   a_pp:  pointer to storage for the vector
  *
- * Errors:    If one of the mallocs fails, the program terminates
+ * Errors:    If the malloc fails, the program terminates
  */
-void Allocate_vectors(
-      double**  x_pp  /* out */, 
-      double**  y_pp  /* out */, 
-      double**  z_pp  /* out */, 
-      int       n     /* in  */) {
-   *x_pp = malloc(n*sizeof(double));
-   *y_pp = malloc(n*sizeof(double));
-   *z_pp = malloc(n*sizeof(double));
-   if (*x_pp == NULL || *y_pp == NULL || *z_pp == NULL) {
+static void Allocate_vector(
+      double**  a_pp  /* out */, 
+      size_t    n     /* in  */) {
+   *a_pp = malloc(n*sizeof(double));
+   if (*a_pp == NULL) {
       fprintf(stderr, "Can't allocate vectors\n");
       exit(-1);
    }
-}  /* Allocate_vectors */
+}  /* Allocate_vector */
 
 /*---------------------------------------------------------------------
  * Function:  Generate_vector
- * Purpose:   Read a vector from stdin
+ * Purpose:   Fill a vector with random numbers in [0, randmax)
  * In args:   n:  order of the vector
- *            vec_name:  name of vector (e.g., x)
- * Out arg:   a:  the vector to be read in
- */
-void Generate_vector(
-      double  a[]         /* out */, 
-      int     n           /* in  */, 
-      char    vec_name[]  /* in  */,
-      int     randmax     /* in  */) {
-   int i;
-   for (i = 0; i < n; i++)
-      a[i] = rand() % randmax;
+ *            vec_name:  name of vector (x is stream 0, y stream 1)
+ *            randmax:   random limit
+ *            engine:    RNG_ engine of vec_rng.h
+ *            seed:      seed of the generator
+ * Out arg:   a:  the vector to be generated
+ */
+static void Generate_vector(
+      double    a[]         /* out */, 
+      size_t    n           /* in  */, 
+      char      vec_name[]  /* in  */,
+      int       randmax     /* in  */,
+      int       engine      /* in  */,
+      uint64_t  seed        /* in  */) {
+   Fill_vector(a, n, vec_name[0] == 'y', randmax, engine, seed);
    printf("Vector %s generated ...\n", vec_name);
-}  /* Read_vector */  
+}  /* Read_vector */
+
+/*---------------------------------------------------------------------
+ * Function:  Fill_vector
+ * Purpose:   Fill a vector with stream stream of the generator
+ * In args:   n:         order of the vector
+ *            stream:    which vector of the seed (0 for x, 1 for y)
+ *            randmax:   the elements are in [0, randmax)
+ *            engine:    RNG_ engine of vec_rng.h
+ *            seed:      seed of the generator
+ * Out arg:   a:         the vector
+ *
+ * Note:
+ *    The vector is filled RNG_BATCH elements at a time with
+ *    Rng_uniform, the same way mpi_vector_add2 fills its blocks.
+ */
+static void Fill_vector(
+      double    a[]      /* out */,
+      size_t    n        /* in  */,
+      uint64_t  stream   /* in  */,
+      int       randmax  /* in  */,
+      int       engine   /* in  */,
+      uint64_t  seed     /* in  */) {
+   uint64_t r[RNG_BATCH];
+   uint64_t range = randmax;
+   uint64_t threshold = (0 - range) % range;
+   size_t i, j, len;
+
+   for (i = 0; i < n; i += len) {
+      len = n - i < RNG_BATCH ? n - i : RNG_BATCH;
+      Rng_uniform(engine, seed, stream, i, len, range, threshold, r);
+      for (j = 0; j < len; j++)
+         a[i + j] = r[j];
+   }
+}  /* Fill_vector */
+
+/*---------------------------------------------------------------------
+ * Function:  Map_vector
+ * Purpose:   Map the elements of a vector file into memory
+ * In arg:    fname:  name of the file
+ * Out arg:   n_p:    order of the vector
+ * Ret val:   the elements of the vector
+ *
+ * Errors:    If the file can't be mapped or isn't a vector file, the
+ *            program terminates
+ *
+ * Note:
+ *    The mapping is private, so the vector can be changed in memory
+ *    without changing the file.  Pages are only read from the file
+ *    when they're first touched.
+ */
+static double* Map_vector(
+      char     fname[]  /* in  */,
+      size_t*  n_p      /* out */) {
+   char* base;
+   int fd = Open_vector_file(fname, n_p);
+
+   base = mmap(NULL, VEC_HEADER + *n_p*sizeof(double),
+         PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (base == MAP_FAILED) {
+      fprintf(stderr, "Can't map %s: %s\n", fname, strerror(errno));
+      exit(-1);
+   }
+   return (double*) (base + VEC_HEADER);
+}  /* Map_vector */
+
+/*---------------------------------------------------------------------
+ * Function:  Open_vector_file
+ * Purpose:   Open a vector file for reading and check its header
+ * In arg:    fname:  name of the file
+ * Out arg:   n_p:    order of the vector
+ * Ret val:   the file descriptor
+ *
+ * Errors:    If the file can't be opened or isn't a vector file of
+ *            doubles, the program terminates
+ */
+static int Open_vector_file(
+      char     fname[]  /* in  */,
+      size_t*  n_p      /* out */) {
+   Vec_header_t header;
+   struct stat st;
+   int fd = open(fname, O_RDONLY);
+
+   if (fd < 0 || fstat(fd, &st) != 0) {
+      fprintf(stderr, "Can't open %s: %s\n", fname, strerror(errno));
+      exit(-1);
+   }
+   if ((size_t) st.st_size < VEC_HEADER
+         || pread(fd, &header, sizeof(header), 0) != sizeof(header)) {
+      fprintf(stderr, "%s isn't a vector file\n", fname);
+      exit(-1);
+   }
+   if (header.magic != VEC_MAGIC || header.dtype != VEC_DOUBLE
+         || header.n > (st.st_size - VEC_HEADER)/sizeof(double)) {
+      fprintf(stderr, "%s isn't a vector file of doubles\n", fname);
+      exit(-1);
+   }
+   *n_p = header.n;
+   return fd;
+}  /* Open_vector_file */
+
+/*---------------------------------------------------------------------
+ * Function:  Create_vector_file
+ * Purpose:   Create a vector file for a vector of order n and map its
+ *            elements into memory
+ * In args:   fname:  name of the file
+ *            n:      order of the vector
+ * Ret val:   the elements of the vector; what's stored in them ends
+ *            up in the file
+ *
+ * Errors:    If the file can't be created or mapped, the program
+ *            terminates
+ */
+static double* Create_vector_file(
+      char    fname[]  /* in */,
+      size_t  n        /* in */) {
+   Vec_header_t header = {VEC_MAGIC, VEC_DOUBLE, n};
+   size_t size = VEC_HEADER + n*sizeof(double);
+   char* base;
+   int fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+   if (fd < 0 || ftruncate(fd, size) != 0) {
+      fprintf(stderr, "Can't create %s: %s\n", fname, strerror(errno));
+      exit(-1);
+   }
+   base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if (base == MAP_FAILED) {
+      fprintf(stderr, "Can't map %s: %s\n", fname, strerror(errno));
+      exit(-1);
+   }
+   memcpy(base, &header, sizeof(header));
+   return (double*) (base + VEC_HEADER);
+}  /* Create_vector_file */
+
+/*---------------------------------------------------------------------
+ * Function:  Unmap_vector
+ * Purpose:   Unmap a vector from Map_vector or Create_vector_file
+ * In args:   a:  the elements of the vector
+ *            n:  order of the vector
+ */
+static void Unmap_vector(
+      double  a[]  /* in */,
+      size_t  n    /* in */) {
+   munmap((char*) a - VEC_HEADER, VEC_HEADER + n*sizeof(double));
+}  /* Unmap_vector */
+
+/*---------------------------------------------------------------------
+ * Function:  Stream_vectors
+ * Purpose:   Run the whole program on vector files one tile at a
+ *            time:  print x and y, write z = x+y, and print the
+ *            scaled vectors and their dot product
+ * In args:   xname, yname:  the vector files of x and y
+ *            zname:         the vector file for z, or NULL
+ *            tile:          number of elements in a tile
+ *            unfused:       nonzero to scale and dot in three passes
+ *
+ * Errors:    If a file can't be opened, read or written, the program
+ *            terminates
+ *
+ * Note:
+ *    Round k waits for the z write of tile k-1, whose buffers then
+ *    take the reads of tile k+1, and starts the z write of tile k
+ *    once it's been computed.  The previews are read before the
+ *    loop, so the output is the same as without --tile.
+ */
+static void Stream_vectors(
+      char    xname[]  /* in */,
+      char    yname[]  /* in */,
+      char    zname[]  /* in */,
+      size_t  tile     /* in */,
+      int     unfused  /* in */) {
+   Vec_header_t header;
+   struct aiocb cb[2][3];
+   double head[2][10], tail[2][10];
+   double *buf, *x, *y, *z;
+   double result = 0.0;
+   size_t n, n_y, c, len, next;
+   char* names[3] = {xname, yname, zname};
+   int fd[3] = {-1, -1, -1};
+   int scalar, b, v, j;
+
+   fd[0] = Open_vector_file(xname, &n);
+   fd[1] = Open_vector_file(yname, &n_y);
+   if (n_y != n) {
+      fprintf(stderr, "%s and %s have different sizes\n", xname, yname);
+      exit(-1);
+   }
+   if (tile > n) tile = n;
+   for (v = 0; v < 2; v++) {
+      Read_sample(fd[v], names[v], n, head[v], tail[v]);
+      Print_preview(head[v], tail[v], n, v == 0 ? "Vector x" : "Vector y");
+   }
+   if (zname != NULL) {
+      header = (Vec_header_t) {VEC_MAGIC, VEC_DOUBLE, n};
+      fd[2] = open(zname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (fd[2] < 0 || ftruncate(fd[2], VEC_HEADER + n*sizeof(double)) != 0
+            || pwrite(fd[2], &header, sizeof(header), 0) != sizeof(header)) {
+         fprintf(stderr, "Can't create %s: %s\n", zname, strerror(errno));
+         exit(-1);
+      }
+   }
+   Read_Scalar(&scalar);
+
+   if (n > 0) {
+      // Two sets of x, y and z tiles
+      Allocate_vector(&buf, 6*tile);
+      memset(cb, 0, sizeof(cb));
+      for (v = 0; v < 2; v++)
+         Aio_start(&cb[0][v], fd[v], buf + v*tile, tile, 0, 0);
+      for (c = 0, b = 0; c < n; c += tile, b = 1 - b) {
+         len = n - c < tile ? n - c : tile;
+         next = c + tile;
+         if (next < n) {
+            Aio_wait(&cb[1-b][2], zname);
+            for (v = 0; v < 2; v++)
+               Aio_start(&cb[1-b][v], fd[v], buf + (3*(1-b) + v)*tile,
+                     n - next < tile ? n - next : tile, next, 0);
+         }
+         for (v = 0; v < 2; v++)
+            Aio_wait(&cb[b][v], names[v]);
+         x = buf + 3*b*tile;
+         y = x + tile;
+         z = y + tile;
+         Vector_sum(x, y, z, len);
+         if (fd[2] >= 0) Aio_start(&cb[b][2], fd[2], z, len, c, 1);
+         if (unfused) {
+            Vector_scalar(scalar, x, len);
+            Vector_scalar(scalar, y, len);
+            result += Vector_dot(x, y, len);
+         } else {
+            result += Vector_scalar_dot(scalar, x, y, len, 1);
+         }
+      }
+      for (b = 0; b < 2; b++)
+         Aio_wait(&cb[b][2], zname);
+      free(buf);
+   }
+   for (v = 0; v < 3; v++)
+      if (fd[v] >= 0) close(fd[v]);
+
+   for (v = 0; v < 2; v++) {
+      for (j = 0; j < 10 && (size_t) j < n; j++) {
+         head[v][j] *= scalar;
+         tail[v][j] *= scalar;
+      }
+      Print_preview(head[v], tail[v], n,
+            v == 0 ? "Vector x by scalar" : "Vector y by scalar");
+   }
+   printf("\nResult of dot product: %lf\n", result);
+}  /* Stream_vectors */
+
+/*---------------------------------------------------------------------
+ * Function:  Read_sample
+ * Purpose:   Read the first and last 10 elements of a vector file,
+ *            the ones PrintTopDown_vector prints
+ * In args:   fd:     the open vector file
+ *            fname:  name of the file
+ *            n:      order of the vector
+ * Out args:  head:   the first 10 elements (all of them if n < 10)
+ *            tail:   the last 10 elements (all of them if n < 10)
+ *
+ * Errors:    If the file can't be read, the program terminates
+ */
+static void Read_sample(
+      int     fd       /* in  */,
+      char    fname[]  /* in  */,
+      size_t  n        /* in  */,
+      double  head[]   /* out */,
+      double  tail[]   /* out */) {
+   size_t len = n < 10 ? n : 10;
+   size_t bytes = len*sizeof(double);
+
+   if (n == 0) return;
+   if (pread(fd, head, bytes, VEC_HEADER) != (ssize_t) bytes
+         || pread(fd, tail, bytes, VEC_HEADER + (n-len)*sizeof(double))
+            != (ssize_t) bytes) {
+      fprintf(stderr, "Can't read %s\n", fname);
+      exit(-1);
+   }
+}  /* Read_sample */
+
+/*---------------------------------------------------------------------
+ * Function:  Aio_start
+ * Purpose:   Start reading or writing count elements of a vector file
+ * In args:   fd:     the open vector file
+ *            count:  number of elements
+ *            first:  index of the first element
+ *            write:  nonzero to write a, zero to read it
+ * In/out:    a:      the elements
+ * Out arg:   cb:     the control block of the request
+ *
+ * Errors:    If the request can't be queued, the program terminates
+ */
+static void Aio_start(
+      struct aiocb*  cb     /* out    */,
+      int            fd     /* in     */,
+      double         a[]    /* in/out */,
+      size_t         count  /* in     */,
+      size_t         first  /* in     */,
+      int            write  /* in     */) {
+   memset(cb, 0, sizeof(*cb));
+   cb->aio_fildes = fd;
+   cb->aio_buf = a;
+   cb->aio_nbytes = count*sizeof(double);
+   cb->aio_offset = VEC_HEADER + first*sizeof(double);
+   if ((write ? aio_write(cb) : aio_read(cb)) != 0) {
+      fprintf(stderr, "Can't start I/O: %s\n", strerror(errno));
+      exit(-1);
+   }
+}  /* Aio_start */
+
+/*---------------------------------------------------------------------
+ * Function:  Aio_wait
+ * Purpose:   Wait for a request from Aio_start, if one was started
+ * In args:   fname:  name of the file, for the error message
+ * In/out:    cb:     the control block; it's cleared, so a second
+ *                    wait returns at once
+ *
+ * Errors:    If the request failed or was short, the program
+ *            terminates
+ */
+static void Aio_wait(
+      struct aiocb*  cb       /* in/out */,
+      char           fname[]  /* in     */) {
+   const struct aiocb* list[1] = {cb};
+   int err;
+
+   if (cb->aio_nbytes == 0) return;
+   while ((err = aio_error(cb)) == EINPROGRESS)
+      aio_suspend(list, 1, NULL);
+   if (err != 0 || aio_return(cb) != (ssize_t) cb->aio_nbytes) {
+      fprintf(stderr, "Can't read or write %s: %s\n", fname,
+            strerror(err != 0 ? err : EIO));
+      exit(-1);
+   }
+   cb->aio_nbytes = 0;
+}  /* Aio_wait */
 
 /*---------------------------------------------------------------------
- * Function:  Print_vector
+ * Function:  PrintTopDown_vector
  * Purpose:   Print the contents of a vector
  * In args:   b:  the vector to be printed
  *            n:  the order of the vector
  *            title:  title for print out
  */
-void Print_vector(
+static void PrintTopDown_vector(
       double  b[]     /* in */, 
-      int     n       /* in */, 
+      size_t  n       /* in */, 
       char    title[] /* in */) {
-   int i;
-   printf("%s\n", title);
-   for (i = 0; i < n; i++)
-      printf("%f ", b[i]);
-   printf("\n");
-}  /* Print_vector */
+   Print_preview(b, b + n - (n < 10 ? n : 10), n, title);
+}  /* PrintTopDown_vector */
 
 /*---------------------------------------------------------------------
- * Function:  PrintTopDown_vector
- * Purpose:   Print the contents of a vector
- * In args:   b:  the vector to be printed
- *            n:  the order of the vector
+ * Function:  Print_preview
+ * Purpose:   Print the first and last 10 elements of a vector
+ * In args:   head:   the first 10 elements (all of them if n < 10)
+ *            tail:   the last 10 elements (all of them if n < 10)
+ *            n:      the order of the vector
  *            title:  title for print out
+ *
+ * Note:      When n < 20 the tail line starts after the head, so no
+ *            element is printed twice, and when n <= 10 there's no
+ *            tail line.
  */
-void PrintTopDown_vector(
-      double  b[]     /* in */, 
-      int     n       /* in */, 
+static void Print_preview(
+      double  head[]  /* in */,
+      double  tail[]  /* in */,
+      size_t  n       /* in */,
       char    title[] /* in */) {
-   int i;
+   size_t len = n < 10 ? n : 10;
+   size_t start = n - len > len ? n - len : len;
+   size_t i;
+
+   if (n == 0) return;
    printf("%s\n", title);
-   printf("0 - 10: [");
-   for(int i = 0;i < 9;i++) 
-      printf("%lf,",b[i]);
-   printf("%lf]\n",b[9]);
-   printf("%d - %d: [",n-10,n);
-   for(int i = n-10;i < n-1;i++) 
-      printf("%lf,",b[i]);
-   printf("%lf]\n",b[n-1]);
-}  /* PrintTopDown_vector */
+   printf("0 - %zu: [", len);
+   for(i = 0;i < len-1;i++) 
+      printf("%lf,",head[i]);
+   printf("%lf]\n",head[len-1]);
+   if (start >= n) return;
+   printf("%zu - %zu: [",start,n);
+   // tail[j] is element n-len+j
+   for(i = start;i < n-1;i++) 
+      printf("%lf,",tail[i - (n-len)]);
+   printf("%lf]\n",tail[len-1]);
+}  /* Print_preview */
 
 /*---------------------------------------------------------------------
  * Function:  Vector_sum
@@ -178,13 +707,339 @@ void PrintTopDown_vector(
  *            n:  the order of the vectors
  * Out arg:   z:  the sum vector
  */
-void Vector_sum(
+static void Vector_sum(
       double  x[]  /* in  */, 
       double  y[]  /* in  */, 
       double  z[]  /* out */, 
-      int     n    /* in  */) {
-   int i;
+      size_t  n    /* in  */) {
+   sum_kernels.sum(x, y, z, n);
+}  /* Vector_sum */
+
+/*---------------------------------------------------------------------
+ * Function:  Read_Scalar
+ * Purpose:   Get the scalar to multiply the vectors with
+ * Out arg:   scalar:  the scalar
+ */
+static void Read_Scalar(int* scalar /* out */) {
+   printf("\nWhat's the number for the scalar?\n");
+   scanf("%d", scalar);
+}  /* Read_Scalar */
+
+/*---------------------------------------------------------------------
+ * Function:  Vector_scalar
+ * Purpose:   Multiply a vector by a scalar
+ * In args:   scalar:  the scalar
+ *            n:       the order of the vector
+ * In/out:    a:       the vector
+ */
+static void Vector_scalar(
+      int     scalar  /* in     */,
+      double  a[]     /* in/out */,
+      size_t  n       /* in     */) {
+   size_t i;
+
+   for (i = 0; i < n; i++)
+      a[i] = a[i] * scalar;
+}  /* Vector_scalar */
+
+/*---------------------------------------------------------------------
+ * Function:  Vector_dot
+ * Purpose:   Compute the dot product of two vectors
+ * In args:   x, y:  the vectors
+ *            n:     the order of the vectors
+ * Ret val:   x . y
+ */
+static double Vector_dot(
+      double  x[]  /* in */,
+      double  y[]  /* in */,
+      size_t  n    /* in */) {
+   double dot = 0.0;
+   size_t i;
+
+   for (i = 0; i < n; i++)
+      dot += x[i]*y[i];
+   return dot;
+}  /* Vector_dot */
+
+/*---------------------------------------------------------------------
+ * Function:  Vector_scalar_dot
+ * Purpose:   Compute the dot product of scalar*x and scalar*y in a
+ *            single pass
+ * In args:   scalar:       the scalar
+ *            n:            the order of the vectors
+ *            keep_scaled:  if nonzero, x and y are overwritten with
+ *                          the scaled vectors; otherwise they're left
+ *                          unchanged and scalar^2 * (x . y) is returned
+ * In/out:    x, y:         the vectors
+ * Ret val:   (scalar*x) . (scalar*y)
+ */
+static double Vector_scalar_dot(
+      int     scalar       /* in     */,
+      double  x[]          /* in/out */,
+      double  y[]          /* in/out */,
+      size_t  n            /* in     */,
+      int     keep_scaled  /* in     */) {
+   double s = scalar;
+   double dot = 0.0;
+   double sx, sy;
+   size_t i;
+
+   if (keep_scaled) {
+      for (i = 0; i < n; i++) {
+         sx = x[i]*s;
+         sy = y[i]*s;
+         x[i] = sx;
+         y[i] = sy;
+         dot += sx*sy;
+      }
+   } else {
+      dot = Vector_dot(x, y, n)*s*s;
+   }
+   return dot;
+}  /* Vector_scalar_dot */
+
+/*---------------------------------------------------------------------
+ * Function:  Vec_serial_init
+ * Purpose:   Set up a library context
+ * In arg:    rng:  RNG_ engine of Vec_serial_generate
+ * Out arg:   ctx:  the context
+ * Ret val:   0, or ERR_ARG if rng isn't an engine
+ */
+int Vec_serial_init(
+      Vec_serial_t*  ctx  /* out */,
+      int            rng  /* in  */) {
+   memset(ctx, 0, sizeof(*ctx));
+   if (rng < RNG_SPLITMIX || rng > RNG_XOSHIRO) return ERR_ARG;
+   ctx->rng = rng;
+   if (sum_kernels.name == NULL) Select_kernels();
+   return 0;
+}  /* Vec_serial_init */
+
+/*---------------------------------------------------------------------
+ * Function:  Vec_serial_errors
+ * Purpose:   Get the errors of the context's calls since the last
+ *            Vec_serial_errors
+ * In/out:    ctx:  the context; its errors are cleared
+ * Ret val:   the ERR_ bits, or 0
+ */
+int Vec_serial_errors(Vec_serial_t* ctx /* in/out */) {
+   int errors = ctx->errors;
+
+   ctx->errors = 0;
+   return errors;
+}  /* Vec_serial_errors */
+
+/*---------------------------------------------------------------------
+ * Function:  Vec_serial_alloc
+ * Purpose:   Allocate a vector of order n
+ * In arg:    n:    order of the vector
+ * In/out:    ctx:  the context
+ * Ret val:   the vector, or NULL (and ERR_ALLOC_VECTOR is set in the
+ *            context) if it can't be allocated
+ */
+double* Vec_serial_alloc(
+      Vec_serial_t*  ctx  /* in/out */,
+      size_t         n    /* in     */) {
+   double* a = malloc((n > 0 ? n : 1)*sizeof(double));
+
+   if (a == NULL) ctx->errors |= ERR_ALLOC_VECTOR;
+   return a;
+}  /* Vec_serial_alloc */
+
+/*---------------------------------------------------------------------
+ * Function:  Vec_serial_release
+ * Purpose:   Free a vector from Vec_serial_alloc
+ * In args:   ctx:  the context
+ *            a:    the vector (NULL is ignored)
+ */
+void Vec_serial_release(
+      Vec_serial_t*  ctx  /* in */,
+      double         a[]  /* in */) {
+   (void) ctx;  // Nothing can go wrong
+   free(a);
+}  /* Vec_serial_release */
+
+/*---------------------------------------------------------------------
+ * Function:  Vec_serial_generate
+ * Purpose:   Generate a vector of order n, the same one
+ *            mpi_vector_add2's Vec_ctx_generate makes for the same
+ *            engine, seed and stream
+ * In args:   n:        order of the vector
+ *            stream:   which vector of the seed
+ *            randmax:  the elements are in [0, randmax)
+ *            seed:     the seed
+ * Out arg:   a:        the vector
+ * In/out:    ctx:      the context
+ * Ret val:   0, or ERR_ARG (also set in the context) if randmax <= 0
+ *            or a is NULL
+ */
+int Vec_serial_generate(
+      Vec_serial_t*  ctx      /* in/out */,
+      double         a[]      /* out    */,
+      size_t         n        /* in     */,
+      uint64_t       stream   /* in     */,
+      int            randmax  /* in     */,
+      uint64_t       seed     /* in     */) {
+   if (randmax <= 0 || (a == NULL && n > 0)) {
+      ctx->errors |= ERR_ARG;
+      return ERR_ARG;
+   }
+   Fill_vector(a, n, stream, randmax, ctx->rng, seed);
+   return 0;
+}  /* Vec_serial_generate */
+
+/*---------------------------------------------------------------------
+ * Function:  Vec_serial_sum
+ * Purpose:   Compute z = x + y
+ * In args:   x, y:  the vectors
+ *            n:     order of the vectors
+ * Out arg:   z:     the sum
+ * In/out:    ctx:   the context
+ * Ret val:   0, or ERR_ARG (also set in the context) if a vector is
+ *            NULL
+ */
+int Vec_serial_sum(
+      Vec_serial_t*  ctx  /* in/out */,
+      double         x[]  /* in     */,
+      double         y[]  /* in     */,
+      double         z[]  /* out    */,
+      size_t         n    /* in     */) {
+   if (n > 0 && (x == NULL || y == NULL || z == NULL)) {
+      ctx->errors |= ERR_ARG;
+      return ERR_ARG;
+   }
+   Vector_sum(x, y, z, n);
+   return 0;
+}  /* Vec_serial_sum */
+
+/*---------------------------------------------------------------------
+ * Function:  Vec_serial_scale
+ * Purpose:   Multiply a vector by a scalar
+ * In args:   scalar:  the scalar
+ *            n:       order of the vector
+ * In/out:    ctx:     the context
+ *            a:       the vector
+ * Ret val:   0, or ERR_ARG (also set in the context) if a is NULL
+ */
+int Vec_serial_scale(
+      Vec_serial_t*  ctx     /* in/out */,
+      int            scalar  /* in     */,
+      double         a[]     /* in/out */,
+      size_t         n       /* in     */) {
+   if (a == NULL && n > 0) {
+      ctx->errors |= ERR_ARG;
+      return ERR_ARG;
+   }
+   Vector_scalar(scalar, a, n);
+   return 0;
+}  /* Vec_serial_scale */
+
+/*---------------------------------------------------------------------
+ * Function:  Vec_serial_dot
+ * Purpose:   Compute the dot product of x and y, or of scalar*x and
+ *            scalar*y if scale is nonzero
+ * In args:   scalar:  the scalar
+ *            n:       order of the vectors
+ *            scale:   if nonzero, x and y are overwritten with the
+ *                     scaled vectors
+ * In/out:    ctx:     the context
+ *            x, y:    the vectors
+ * Ret val:   the dot product, or 0 (and ERR_ARG is set in the
+ *            context) if a vector is NULL
+ */
+double Vec_serial_dot(
+      Vec_serial_t*  ctx     /* in/out */,
+      int            scalar  /* in     */,
+      double         x[]     /* in/out */,
+      double         y[]     /* in/out */,
+      size_t         n       /* in     */,
+      int            scale   /* in     */) {
+   if (n > 0 && (x == NULL || y == NULL)) {
+      ctx->errors |= ERR_ARG;
+      return 0.0;
+   }
+   if (scale) return Vector_scalar_dot(scalar, x, y, n, 1);
+   return Vector_dot(x, y, n);
+}  /* Vec_serial_dot */
+
+/*---------------------------------------------------------------------
+ * Sum kernels
+ *
+ * A generic version plus AVX2, AVX-512 and NEON versions when the
+ * compiler targets the architecture.  The last n % width elements are
+ * done with a scalar loop, and loads are unaligned so any pointer can
+ * be passed in.
+ *---------------------------------------------------------------------*/
+
+static void Sum_generic(double x[], double y[], double z[], size_t n) {
+   size_t i;
 
    for (i = 0; i < n; i++)
       z[i] = x[i] + y[i];
-}  /* Vector_sum */
+}  /* Sum_generic */
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static void Sum_avx2(double x[], double y[], double z[], size_t n) {
+   size_t i;
+
+   for (i = 0; i + 8 <= n; i += 8) {
+      _mm256_storeu_pd(z+i, _mm256_add_pd(_mm256_loadu_pd(x+i),
+            _mm256_loadu_pd(y+i)));
+      _mm256_storeu_pd(z+i+4, _mm256_add_pd(_mm256_loadu_pd(x+i+4),
+            _mm256_loadu_pd(y+i+4)));
+   }
+   for (; i < n; i++)
+      z[i] = x[i] + y[i];
+}  /* Sum_avx2 */
+
+__attribute__((target("avx512f")))
+static void Sum_avx512(double x[], double y[], double z[], size_t n) {
+   size_t i;
+
+   for (i = 0; i + 16 <= n; i += 16) {
+      _mm512_storeu_pd(z+i, _mm512_add_pd(_mm512_loadu_pd(x+i),
+            _mm512_loadu_pd(y+i)));
+      _mm512_storeu_pd(z+i+8, _mm512_add_pd(_mm512_loadu_pd(x+i+8),
+            _mm512_loadu_pd(y+i+8)));
+   }
+   for (; i < n; i++)
+      z[i] = x[i] + y[i];
+}  /* Sum_avx512 */
+#endif
+
+#if defined(__aarch64__)
+static void Sum_neon(double x[], double y[], double z[], size_t n) {
+   size_t i;
+
+   for (i = 0; i + 4 <= n; i += 4) {
+      vst1q_f64(z+i, vaddq_f64(vld1q_f64(x+i), vld1q_f64(y+i)));
+      vst1q_f64(z+i+2, vaddq_f64(vld1q_f64(x+i+2), vld1q_f64(y+i+2)));
+   }
+   for (; i < n; i++)
+      z[i] = x[i] + y[i];
+}  /* Sum_neon */
+#endif
+
+/*---------------------------------------------------------------------
+ * Function:  Select_kernels
+ * Purpose:   Fill in the kernels table with the widest kernels the CPU
+ *            supports
+ */
+static void Select_kernels(void) {
+   sum_kernels.name = "generic";
+   sum_kernels.sum = Sum_generic;
+#  if defined(__x86_64__) || defined(__i386__)
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx512f")) {
+      sum_kernels.name = "avx512";
+      sum_kernels.sum = Sum_avx512;
+   } else if (__builtin_cpu_supports("avx2")) {
+      sum_kernels.name = "avx2";
+      sum_kernels.sum = Sum_avx2;
+   }
+#  elif defined(__aarch64__)
+   sum_kernels.name = "neon";
+   sum_kernels.sum = Sum_neon;
+#  endif
+}  /* Select_kernels */